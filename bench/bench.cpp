@@ -0,0 +1,125 @@
+/**
+ * bench.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+
+#ifdef __unix__
+#include <unistd.h>
+#endif
+
+using namespace libdane;
+
+namespace
+{
+	std::atomic<std::size_t> g_allocations(0);
+	
+	// OpenSSL has its own allocator hooks; count those allocations too
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+	void* crypto_malloc(std::size_t size, const char*, int)
+	{
+		++g_allocations;
+		return std::malloc(size);
+	}
+	
+	void* crypto_realloc(void *ptr, std::size_t size, const char*, int)
+	{
+		++g_allocations;
+		return std::realloc(ptr, size);
+	}
+	
+	void crypto_free(void *ptr, const char*, int)
+	{
+		std::free(ptr);
+	}
+#else
+	void* crypto_malloc(std::size_t size)
+	{
+		++g_allocations;
+		return std::malloc(size);
+	}
+	
+	void* crypto_realloc(void *ptr, std::size_t size)
+	{
+		++g_allocations;
+		return std::realloc(ptr, size);
+	}
+#endif
+	
+	// This has to run before OpenSSL allocates anything at all
+	__attribute__((constructor(101))) void init_crypto_mem()
+	{
+#if OPENSSL_VERSION_NUMBER >= 0x10100000L
+		CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc, crypto_free);
+#else
+		CRYPTO_set_mem_functions(crypto_malloc, crypto_realloc, std::free);
+#endif
+	}
+	
+	int verify_cb(int preverified, X509_STORE_CTX *ctx)
+	{
+		auto cb = static_cast<bench::VerifyCallback*>(X509_STORE_CTX_get_app_data(ctx));
+		return (*cb)(preverified != 0, ctx);
+	}
+}
+
+void* operator new(std::size_t size)
+{
+	++g_allocations;
+	if (void *ptr = std::malloc(size ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+std::size_t bench::allocations()
+{
+	return g_allocations.load();
+}
+
+std::size_t bench::rss()
+{
+#ifdef __unix__
+	std::ifstream fs("/proc/self/statm");
+	std::size_t size = 0, resident = 0;
+	if (fs >> size >> resident) {
+		return resident * sysconf(_SC_PAGESIZE);
+	}
+#endif
+	return 0;
+}
+
+bool bench::handshake(const std::deque<Certificate> &chain, VerifyCallback cb)
+{
+	auto store = std::shared_ptr<X509_STORE>(X509_STORE_new(), X509_STORE_free);
+	X509_STORE_add_cert(&*store, chain.back().x509());
+	
+	STACK_OF(X509) *untrusted = sk_X509_new_null();
+	for (auto it = chain.begin() + 1; it != chain.end(); ++it) {
+		sk_X509_push(untrusted, it->x509());
+	}
+	
+	auto ctx = std::shared_ptr<X509_STORE_CTX>(X509_STORE_CTX_new(), X509_STORE_CTX_free);
+	X509_STORE_CTX_init(&*ctx, &*store, chain.front().x509(), untrusted);
+	X509_STORE_CTX_set_flags(&*ctx, X509_V_FLAG_PARTIAL_CHAIN);
+	X509_STORE_CTX_set_time(&*ctx, 0, 1441065600);	// 2015-09-01
+	X509_STORE_CTX_set_app_data(&*ctx, &cb);
+	X509_STORE_CTX_set_verify_cb(&*ctx, verify_cb);
+	
+	bool result = X509_verify_cert(&*ctx) > 0;
+	sk_X509_free(untrusted);
+	return result;
+}
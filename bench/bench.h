@@ -0,0 +1,81 @@
+/**
+ * bench.h
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_BENCH_BENCH_H
+#define LIBDANE_BENCH_BENCH_H
+
+#include <libdane/Certificate.h>
+#include <chrono>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <string>
+
+namespace libdane
+{
+	namespace bench
+	{
+		/**
+		 * Returns the number of heap allocations made by the process so far.
+		 */
+		std::size_t allocations();
+		
+		/**
+		 * Returns the process' current resident set size, in bytes.
+		 * 
+		 * Returns 0 on platforms where this can't be determined.
+		 */
+		std::size_t rss();
+		
+		/**
+		 * Runs fn a number of times, and prints the time and number of heap
+		 * allocations per iteration.
+		 * 
+		 * @param name       Name to print
+		 * @param iterations Number of times to run fn
+		 * @param fn         Function to benchmark
+		 * @return           Nanoseconds per iteration
+		 */
+		template<typename FnT>
+		inline double measure(const std::string &name, std::size_t iterations, FnT fn)
+		{
+			// Warm up any caches first, so they don't skew the numbers
+			fn();
+			
+			std::size_t allocs = allocations();
+			auto start = std::chrono::steady_clock::now();
+			for (std::size_t i = 0; i < iterations; ++i) {
+				fn();
+			}
+			auto end = std::chrono::steady_clock::now();
+			allocs = allocations() - allocs;
+			
+			double ns = std::chrono::duration<double, std::nano>(end - start).count() / iterations;
+			std::printf("%-48s %12.1f ns/op %10.2f allocs/op\n", name.c_str(), ns, static_cast<double>(allocs) / iterations);
+			return ns;
+		}
+		
+		/**
+		 * Callback type for handshake().
+		 */
+		typedef std::function<bool(bool preverified, X509_STORE_CTX *ctx)> VerifyCallback;
+		
+		/**
+		 * Runs OpenSSL's chain verification like a TLS handshake would.
+		 * 
+		 * The last certificate in the chain is used as a trust anchor, and the
+		 * verification time is set to when the test resources were valid.
+		 * 
+		 * @param chain A certificate chain, leaf first
+		 * @param cb    Verify callback, invoked for every depth
+		 * @return      The verification result
+		 */
+		bool handshake(const std::deque<Certificate> &chain, VerifyCallback cb);
+	}
+}
+
+#endif
@@ -0,0 +1,52 @@
+/**
+ * bench_BatchVerifier.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ * 
+ * Usage: bench_BatchVerifier [jobs]
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include "../test/resources.h"
+#include <cstdlib>
+#include <thread>
+
+using namespace libdane;
+
+int main(int argc, char **argv)
+{
+	std::size_t count = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 2000;
+	
+	// Every job gets its own freshly parsed chain, like chains loaded from an
+	// audit database would be, so nothing is shared between them
+	std::deque<std::deque<Certificate>> chains;
+	std::vector<DANERecord> records;
+	for (std::size_t i = 0; i < count; ++i) {
+		chains.push_back(Certificate::parsePEM(i % 2 ? resources::microsoftPEM : resources::googlePEM));
+		if (i < 2) {
+			records.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chains.back().front());
+		}
+	}
+	DANERecordSet set(records.begin(), records.end());
+	
+	std::vector<BatchVerifier::Job> jobs;
+	for (const std::deque<Certificate> &chain : chains) {
+		jobs.emplace_back(chain, set);
+	}
+	
+	// Don't let repeated runs skip the signature checks
+	SignatureCache::shared().setCapacity(0);
+	
+	std::printf("%zu jobs, %u cores\n", count, std::thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= std::max(std::thread::hardware_concurrency(), 4u); threads *= 2) {
+		BatchVerifier verifier(threads);
+		double ns = bench::measure("BatchVerifier::run(), " + std::to_string(threads) + " threads", 5, [&]() {
+			verifier.run(jobs);
+		});
+		std::printf("%.0f jobs/s\n", count / ns * 1e9);
+	}
+	
+	return 0;
+}
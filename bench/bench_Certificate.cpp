@@ -0,0 +1,75 @@
+/**
+ * bench_Certificate.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include <algorithm>
+#include "../test/resources.h"
+
+using namespace libdane;
+
+int main()
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	
+	bench::measure("Certificate copy", 100000, [&]() {
+		Certificate cert(chain.front());
+	});
+	
+	bench::measure("Chain copy (3 certificates)", 100000, [&]() {
+		std::deque<Certificate> copy(chain);
+	});
+	
+	// What the verify callback does at every depth: wrap the context, grab
+	// the current certificate, and look at the chain
+	bench::measure("Handshake (3 certificates)", 5000, [&]() {
+		bench::handshake(chain, [](bool preverified, X509_STORE_CTX *ctx) {
+			VerifyContext vctx(ctx);
+			Certificate cert = vctx.currentCert();
+			std::deque<Certificate> copy = vctx.chain();
+			return preverified;
+		});
+	});
+	
+	bench::measure("Handshake (no-op callback)", 5000, [&]() {
+		bench::handshake(chain, [](bool preverified, X509_STORE_CTX *ctx) {
+			return preverified;
+		});
+	});
+	
+	bench::measure("parsePEM (3 certificates)", 2000, [&]() {
+		Certificate::parsePEM(resources::googlePEM);
+	});
+	
+	CertificatePool pool;
+	bench::measure("parsePEM (3 certificates), pooled", 2000, [&]() {
+		Certificate::parsePEM(resources::googlePEM, &pool);
+	});
+	
+	// Separately parsed, so they don't share an X509 object
+	Certificate other(resources::googlePEM);
+	volatile bool equal = false;
+	bench::measure("Certificate == (distinct X509 objects)", 1000000, [&]() {
+		equal = chain[0] == other;
+	});
+	
+	bench::measure("Chain position lookup (std::find)", 1000000, [&]() {
+		equal = std::find(chain.begin(), chain.end(), other) != chain.end();
+	});
+	
+		SignatureCache::shared().setCapacity(0);
+	bench::measure("Certificate::verify, uncached", 2000, [&]() {
+		chain[0].verify(chain[1]);
+	});
+	
+	SignatureCache::shared().setCapacity(4096);
+	bench::measure("Certificate::verify, cached", 100000, [&]() {
+		chain[0].verify(chain[1]);
+	});
+	
+	return 0;
+}
@@ -0,0 +1,35 @@
+/**
+ * bench_CertificateLoader.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ * 
+ * Usage: bench_CertificateLoader [file...]
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include <thread>
+
+using namespace libdane;
+
+int main(int argc, char **argv)
+{
+	std::vector<std::string> paths(argv + 1, argv + argc);
+	if (paths.empty()) {
+		paths.push_back("/etc/ssl/certs/ca-certificates.crt");
+	}
+	
+	std::size_t count = CertificateLoader(1).loadFiles(paths).size();
+	std::printf("%zu files, %zu certificates, %u cores\n", paths.size(), count, std::thread::hardware_concurrency());
+	
+	for (unsigned int threads = 1; threads <= std::max(std::thread::hardware_concurrency(), 4u); threads *= 2) {
+		CertificateLoader loader(threads);
+		double ns = bench::measure("loadFiles(), " + std::to_string(threads) + " threads", 10, [&]() {
+			loader.loadFiles(paths);
+		});
+		std::printf("%.0f certificates/s\n", count / ns * 1e9);
+	}
+	
+	return 0;
+}
@@ -0,0 +1,111 @@
+/**
+ * bench_DANERecord.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include "../test/resources.h"
+#include <vector>
+
+using namespace libdane;
+
+int main()
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::deque<Certificate> other = Certificate::parsePEM(resources::microsoftPEM);
+	
+	// A typical MX host's RRset: a few records for other keys, then the one
+	// that actually matches
+	std::vector<DANERecord> records;
+	for (int i = 0; i < 7; ++i) {
+		records.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, other[i % 2]);
+	}
+	records.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain.front());
+	
+	bench::measure("DANERecord::verify(cert), 3 1 1", 100000, [&]() {
+		records.back().verify(chain.front());
+	});
+	
+	volatile std::size_t sink = 0;
+	bench::measure("DANERecord::data()", 1000000, [&]() {
+		sink = sink + records.back().data().size();
+	});
+	
+	bench::measure("verify(cert) over 8 records, 3 1 1", 100000, [&]() {
+		for (const DANERecord &rec : records) {
+			if (rec.verify(chain.front())) {
+				break;
+			}
+		}
+	});
+	
+	DANERecordSet set(records.begin(), records.end());
+	
+	bench::measure("verify(leaf) over 8 records", 100000, [&]() {
+		for (const DANERecord &rec : records) {
+			if (rec.verify(false, chain.front(), chain)) {
+				break;
+			}
+		}
+	});
+	
+	bench::measure("DANERecordSet::verify(leaf), 8 records", 100000, [&]() {
+		set.verify(false, chain.front(), chain);
+	});
+	
+	bench::measure("Handshake, 8 records", 5000, [&]() {
+		bench::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+			return verify(preverified, ctx, records.begin(), records.end());
+		});
+	});
+	
+	bench::measure("Handshake, 8 records, DANERecordSet", 5000, [&]() {
+		bench::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+			return set.verify(preverified, ctx);
+		});
+	});
+	
+	// A rollover RRset mixing types, with the matching record last
+	std::vector<DANERecord> mixed;
+	for (int i = 0; i < 2; ++i) {
+		mixed.emplace_back(TrustAnchorAssertion, SubjectPublicKeyInfo, SHA256Hash, other[1]);
+		mixed.emplace_back(DomainIssuedCertificate, FullCertificate, SHA512Hash, other[0]);
+		mixed.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, other[0]);
+	}
+	mixed.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain.front());
+	DANERecordSet mixedSet(mixed.begin(), mixed.end());
+	
+	bench::measure("Handshake, 7 mixed records", 5000, [&]() {
+		bench::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+			return verify(preverified, ctx, mixed.begin(), mixed.end());
+		});
+	});
+	
+	bench::measure("Handshake, 7 mixed records, DANERecordSet", 5000, [&]() {
+		bench::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+			return mixedSet.verify(preverified, ctx);
+		});
+	});
+	
+	// Memory use of a large record cache, holding SHA-256 digests
+	const std::size_t count = 1000000;
+	std::vector<unsigned char> digest = chain.front().digest(SubjectPublicKeyInfo, SHA256Hash);
+	std::size_t rss = bench::rss(), allocs = bench::allocations();
+	{
+		std::vector<DANERecord> cache;
+		cache.reserve(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			cache.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, digest);
+		}
+		
+		rss = bench::rss() - rss;
+		allocs = bench::allocations() - allocs;
+		std::printf("%-48s %12zu bytes/record %6.2f allocs/record (sizeof %zu)\n",
+			"1M \"3 1 1\" records", rss / count, static_cast<double>(allocs) / count, sizeof(DANERecord));
+	}
+	
+	return 0;
+}
@@ -0,0 +1,82 @@
+/**
+ * bench_DANERecordSet.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include "../test/resources.h"
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace libdane;
+
+int main()
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::mt19937 rng(1);
+	
+	// RRsets of random "3 1 1" records, as seen during key rollovers, with
+	// the one that actually matches last
+	for (std::size_t count : { 1, 10, 100, 1000 }) {
+		std::vector<DANERecord> records;
+		for (std::size_t i = 1; i < count; ++i) {
+			std::vector<unsigned char> data(32);
+			for (unsigned char &c : data) {
+				c = rng() & 0xFF;
+			}
+			records.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, data);
+		}
+		records.emplace_back(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain.front());
+		
+		DANERecordSet set(records.begin(), records.end());
+		std::size_t iterations = 1000000 / count + 1000;
+		
+		bench::measure("verify(leaf), " + std::to_string(count) + " records", iterations, [&]() {
+			for (const DANERecord &rec : records) {
+				if (rec.verify(false, chain.front(), chain)) {
+					break;
+				}
+			}
+		});
+		
+		bench::measure("DANERecordSet::verify(leaf), " + std::to_string(count) + " records", iterations, [&]() {
+			set.verify(false, chain.front(), chain);
+		});
+	}
+	
+	// Exact matches, for operators who publish full certificates
+	for (Selector selector : { FullCertificate, SubjectPublicKeyInfo }) {
+		std::vector<DANERecord> records = {
+			DANERecord(TrustAnchorAssertion, selector, ExactMatch, chain.back()),
+			DANERecord(DomainIssuedCertificate, selector, ExactMatch, chain.front()),
+		};
+		DANERecordSet set(records.begin(), records.end());
+		
+		bench::measure(std::string("DANERecordSet::verify(leaf), exact ") + (selector == FullCertificate ? "3 0 0" : "3 1 0"), 1000000, [&]() {
+			set.verify(false, chain.front(), chain);
+		});
+	}
+	
+	// Published by an operator rolling over from SHA-256 to SHA-512, where
+	// the record that matches is in the group that's tried last
+	{
+		std::vector<DANERecord> records = {
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, std::vector<unsigned char>(32, 0xAB)),
+			DANERecord(DomainIssuedCertificate, FullCertificate, SHA256Hash, std::vector<unsigned char>(32, 0xCD)),
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA512Hash, chain.front()),
+		};
+		DANERecordSet set(records.begin(), records.end());
+		
+		const std::size_t iterations = 1000000;
+		bench::measure("DANERecordSet::verify(leaf), rollover", iterations, [&]() {
+			set.verify(false, chain.front(), chain);
+		});
+		std::printf("%-48s %12.2f per handshake\n", "  groups looked up in", static_cast<double>(set.lookups()) / (iterations + 1));
+	}
+	
+	return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * bench_HandshakeVerifier.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include "../test/resources.h"
+#include <functional>
+#include <memory>
+
+using namespace libdane;
+
+namespace
+{
+	typedef std::function<bool(bool preverified, X509_STORE_CTX *ctx)> Callback;
+	
+	int verify_cb(int preverified, X509_STORE_CTX *ctx)
+	{
+		return (*static_cast<Callback*>(X509_STORE_CTX_get_app_data(ctx)))(preverified, ctx);
+	}
+	
+	/// Runs OpenSSL's verification on a chain, like a handshake would
+	void handshake(X509_STORE *store, const std::deque<Certificate> &chain, Callback &cb)
+	{
+		STACK_OF(X509) *untrusted = sk_X509_new_null();
+		for (auto it = chain.begin() + 1; it != chain.end(); ++it) {
+			sk_X509_push(untrusted, it->x509());
+		}
+		
+		X509_STORE_CTX *ctx = X509_STORE_CTX_new();
+		X509_STORE_CTX_init(ctx, store, chain.front().x509(), untrusted);
+		X509_STORE_CTX_set_flags(ctx, X509_V_FLAG_PARTIAL_CHAIN);
+		X509_STORE_CTX_set_time(ctx, 0, 1441065600);	// 2015-09-01
+		X509_STORE_CTX_set_app_data(ctx, &cb);
+		X509_STORE_CTX_set_verify_cb(ctx, verify_cb);
+		X509_verify_cert(ctx);
+		X509_STORE_CTX_free(ctx);
+		sk_X509_free(untrusted);
+	}
+}
+
+int main()
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	auto store = std::shared_ptr<X509_STORE>(X509_STORE_new(), X509_STORE_free);
+	X509_STORE_add_cert(&*store, chain.back().x509());
+	
+	// The current leaf key, plus the root as a fallback
+	std::vector<DANERecord> records = {
+		DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain.front()),
+		DANERecord(TrustAnchorAssertion, FullCertificate, SHA256Hash, chain.back()),
+	};
+	DANERecordSet set(records.begin(), records.end());
+	
+	// OpenSSL's own signature checks dwarf the callbacks, so time just those
+	std::chrono::steady_clock::duration spent;
+	auto timed = [&](std::function<bool(bool, X509_STORE_CTX*)> fn) -> Callback {
+		return [&spent, fn](bool preverified, X509_STORE_CTX *ctx) {
+			auto start = std::chrono::steady_clock::now();
+			bool result = fn(preverified, ctx);
+			spent += std::chrono::steady_clock::now() - start;
+			return result;
+		};
+	};
+	
+	Callback perDepth = timed([&](bool preverified, X509_STORE_CTX *ctx) {
+		return set.verify(preverified, VerifyContext(ctx));
+	});
+	Callback once = timed([&](bool preverified, X509_STORE_CTX *ctx) {
+		return HandshakeVerifier::verify(set, preverified, ctx);
+	});
+	
+	const std::size_t iterations = 20000;
+	for (auto test : { std::make_pair("DANERecordSet::verify() at every depth", &perDepth), std::make_pair("HandshakeVerifier::verify()", &once) }) {
+		spent = std::chrono::steady_clock::duration::zero();
+		bench::measure(std::string("handshake, ") + test.first, iterations, [&]() {
+			handshake(&*store, chain, *test.second);
+		});
+		std::printf("%-48s %12.1f ns/handshake\n", "  of which in callbacks", std::chrono::duration<double, std::nano>(spent).count() / (iterations + 1));
+	}
+	
+	// Self-signed roots and private CAs aren't in any trust store, which is
+	// where DANE has to check the links itself; don't let caching hide that
+	auto untrusted = std::shared_ptr<X509_STORE>(X509_STORE_new(), X509_STORE_free);
+	SignatureCache::shared().setCapacity(0);
+	for (const DANERecord &rec : records) {
+		std::vector<DANERecord> single(1, rec);
+		DANERecordSet set(single.begin(), single.end());
+		Callback perDepth = timed([&](bool preverified, X509_STORE_CTX *ctx) {
+			set.verify(preverified, VerifyContext(ctx));
+			return true;
+		});
+		
+		spent = std::chrono::steady_clock::duration::zero();
+		bench::measure(std::string("handshake, untrusted, uncached, ") + (rec.usage() == DomainIssuedCertificate ? "3 1 1" : "2 0 1"), iterations / 10, [&]() {
+			handshake(&*untrusted, chain, perDepth);
+		});
+		std::printf("%-48s %12.1f ns/handshake\n", "  of which in callbacks", std::chrono::duration<double, std::nano>(spent).count() / (iterations / 10 + 1));
+	}
+	
+	return 0;
+}
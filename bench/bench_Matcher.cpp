@@ -0,0 +1,46 @@
+/**
+ * bench_Matcher.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include "../test/resources.h"
+#include <sstream>
+
+using namespace libdane;
+
+int main()
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	volatile bool sink = false;
+	
+	// Every combination, against the certificate it applies to, so the
+	// data is actually compared
+	for (int u = CAConstraints; u <= DomainIssuedCertificate; ++u) {
+		for (int s = FullCertificate; s <= SubjectPublicKeyInfo; ++s) {
+			for (int m = ExactMatch; m <= SHA512Hash; ++m) {
+				bool anchor = (u == CAConstraints || u == TrustAnchorAssertion);
+				const Certificate &cert = anchor ? chain.back() : chain.front();
+				DANERecord rec(Usage(u), Selector(s), MatchingType(m), cert);
+				
+				std::stringstream ss;
+				ss << u << " " << s << " " << m;
+				
+				bench::measure("DANERecord::verify, " + ss.str(), 1000000, [&]() {
+					sink = rec.verify(true, cert, chain);
+				});
+				
+				const MatcherFunctions *matcher = matcher_for(Usage(u), Selector(s), MatchingType(m));
+				ByteView data = rec.data();
+				bench::measure("Matcher::verify, " + ss.str(), 1000000, [&]() {
+					sink = matcher->verify(data, true, cert, chain);
+				});
+			}
+		}
+	}
+	
+	return 0;
+}
@@ -0,0 +1,52 @@
+/**
+ * bench_PEM.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ * 
+ * Usage: bench_PEM [bundle.pem]
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+using namespace libdane;
+
+int main(int argc, char **argv)
+{
+	std::string path = argc > 1 ? argv[1] : "/etc/ssl/certs/ca-certificates.crt";
+	std::ifstream fs(path, std::ios::binary);
+	if (!fs.is_open()) {
+		std::cerr << "Couldn't open " << path << std::endl;
+		return 1;
+	}
+	
+	std::stringstream ss;
+	ss << fs.rdbuf();
+	std::string pem = ss.str();
+	
+	std::size_t count = Certificate::parsePEM(pem).size();
+	std::printf("%s: %zu bytes, %zu certificates\n", path.c_str(), pem.size(), count);
+	
+	double ns = bench::measure("Certificate::parsePEM", 20, [&]() {
+		Certificate::parsePEM(pem);
+	});
+	std::printf("%.1f MB/s, %.0f certificates/s\n", pem.size() / ns * 1000.0, count / ns * 1e9);
+	
+	// The scanning and decoding alone, without OpenSSL's parsing
+	std::vector<unsigned char> der;
+	ns = bench::measure("pem_find + base64_decode", 200, [&]() {
+		const char *it = pem.data(), *end = pem.data() + pem.size();
+		const char *body_begin, *body_end;
+		while ((it = pem_find(it, end, "CERTIFICATE", body_begin, body_end))) {
+			der.clear();
+			base64_decode(body_begin, body_end, der);
+		}
+	});
+	std::printf("%.1f MB/s\n", pem.size() / ns * 1000.0);
+	
+	return 0;
+}
@@ -0,0 +1,173 @@
+/**
+ * bench_Resolver.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/net/Resolver.h>
+#include <libdane/DANERecord.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace libdane;
+using namespace libdane::net;
+
+namespace
+{
+	/**
+	 * A stub nameserver on the loopback interface.
+	 * 
+	 * Every query is answered over UDP or TCP by echoing it back with the QR
+	 * bit set, which makes a valid, empty response; what's measured is the
+	 * transport, not the server.
+	 */
+	class StubServer
+	{
+	public:
+		StubServer(asio::io_service &service):
+			m_service(service),
+			m_udp(service, asio::ip::udp::endpoint(asio::ip::address_v4::loopback(), 0)),
+			m_tcp(service)
+		{
+			// Listen for TCP on the same port the UDP socket got
+			asio::ip::tcp::endpoint endpoint(asio::ip::address_v4::loopback(), this->port());
+			m_tcp.open(endpoint.protocol());
+			m_tcp.set_option(asio::ip::tcp::acceptor::reuse_address(true));
+			m_tcp.bind(endpoint);
+			m_tcp.listen();
+			
+			this->receive();
+			this->accept();
+		}
+		
+		unsigned short port() const { return m_udp.local_endpoint().port(); }
+		
+	private:
+		struct Session
+		{
+			Session(asio::io_service &service): sock(service) {}
+			
+			asio::ip::tcp::socket sock;
+			std::vector<unsigned char> buffer;
+		};
+		
+		static void answer(std::vector<unsigned char> &msg, std::size_t offset)
+		{
+			msg[offset + 2] |= 0x80;
+		}
+		
+		void receive()
+		{
+			m_buffer.resize(65535);
+			m_udp.async_receive_from(asio::buffer(m_buffer), m_peer, [this](const asio::error_code &err, std::size_t size) {
+				if (err) {
+					return;
+				}
+				
+				m_buffer.resize(size);
+				answer(m_buffer, 0);
+				asio::error_code ignored;
+				m_udp.send_to(asio::buffer(m_buffer), m_peer, 0, ignored);
+				this->receive();
+			});
+		}
+		
+		void accept()
+		{
+			auto session = std::make_shared<Session>(m_service);
+			m_tcp.async_accept(session->sock, [this, session](const asio::error_code &err) {
+				if (err) {
+					return;
+				}
+				
+				// Responses to pipelined queries go out one by one; don't
+				// let Nagle hold them back waiting for ACKs
+				session->sock.set_option(asio::ip::tcp::no_delay(true));
+				this->serve(session);
+				this->accept();
+			});
+		}
+		
+		static void serve(std::shared_ptr<Session> session)
+		{
+			session->buffer.resize(2);
+			asio::async_read(session->sock, asio::buffer(session->buffer), [session](const asio::error_code &err, std::size_t size) {
+				if (err) {
+					return;
+				}
+				
+				std::size_t len = (session->buffer[0] << 8) | session->buffer[1];
+				session->buffer.resize(2 + len);
+				asio::async_read(session->sock, asio::buffer(&session->buffer[2], len), [session](const asio::error_code &err, std::size_t size) {
+					if (err) {
+						return;
+					}
+					
+					answer(session->buffer, 2);
+					asio::async_write(session->sock, asio::buffer(session->buffer), [session](const asio::error_code &err, std::size_t size) {
+						if (!err) {
+							serve(session);
+						}
+					});
+				});
+			});
+		}
+		
+		asio::io_service &m_service;
+		
+		asio::ip::udp::socket m_udp;
+		asio::ip::udp::endpoint m_peer;
+		std::vector<unsigned char> m_buffer;
+		
+		asio::ip::tcp::acceptor m_tcp;
+	};
+}
+
+int main()
+{
+	asio::io_service service;
+	StubServer server(service);
+	
+	Resolver res(service);
+	res.config().setNameServers({ asio::ip::address_v4::loopback() });
+	res.config().setPort(server.port());
+	
+	// Runs the service until a lookup is done; the server never runs out of work
+	auto wait = [&](bool &done) {
+		while (!done) {
+			service.run_one();
+		}
+	};
+	
+	// UDP, TCP with a new connection per batch, and pooled TCP connections
+	for (int mode = 0; mode < 3; ++mode) {
+		std::string transport = mode == 0 ? "UDP" : mode == 1 ? "TCP" : "TCP, pooled";
+		res.config().setForceTCP(mode > 0);
+		res.pool().setMaxIdle(mode == 2 ? 4 : 0);
+		
+		bench::measure("lookupDANE(), " + transport, 5000, [&]() {
+			bool done = false;
+			res.lookupDANE("_25._tcp.example.com", [&](const asio::error_code &err, std::vector<DANERecord> records, bool dnssec) {
+				done = true;
+			});
+			wait(done);
+		});
+		
+		std::vector<std::shared_ptr<ldns_pkt>> pkts;
+		for (int i = 0; i < 8; ++i) {
+			pkts.push_back(res.makeQuery("_25._tcp.mx" + std::to_string(i) + ".example.com", LDNS_RR_TYPE_TLSA));
+		}
+		bench::measure("query(), " + transport + ", 8 packets", 1000, [&]() {
+			bool done = false;
+			res.query(pkts, [&](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+				done = true;
+			});
+			wait(done);
+		});
+	}
+	
+	return 0;
+}
@@ -0,0 +1,136 @@
+/**
+ * bench_Util.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/Util.h>
+#include <deque>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace libdane;
+
+namespace
+{
+	void throughput(const std::string &name, std::size_t bytes, double ns)
+	{
+		std::printf("%-48s %12.3f GB/s\n", ("  " + name).c_str(), bytes / ns);
+	}
+}
+
+int main()
+{
+	std::mt19937 rng(1);
+	
+	// A SHA-256 digest, as in a record, and a full certificate
+	for (std::size_t size : { 32, 4096 }) {
+		std::vector<unsigned char> data(size);
+		for (unsigned char &c : data) {
+			c = rng() & 0xFF;
+		}
+		std::string str = to_hex(data);
+		std::size_t iterations = 10000000 / size + 1000;
+		
+		double ns = bench::measure("to_hex(), " + std::to_string(size) + " bytes", iterations, [&]() {
+			to_hex(data);
+		});
+		throughput("to_hex()", size, ns);
+		
+		ns = bench::measure("from_hex(), " + std::to_string(size) + " bytes", iterations, [&]() {
+			from_hex(str);
+		});
+		throughput("from_hex()", size, ns);
+		
+		for (const internal::HexKernel *kernel : internal::hex_kernels()) {
+			std::string out(size * 2, '\0');
+			ns = bench::measure(std::string("encode, ") + kernel->name + ", " + std::to_string(size) + " bytes", iterations * 10, [&]() {
+				kernel->encode(data.data(), size, &out[0]);
+			});
+			throughput("encode", size, ns);
+			
+			std::vector<unsigned char> decoded(size);
+			ns = bench::measure(std::string("decode, ") + kernel->name + ", " + std::to_string(size) + " bytes", iterations * 10, [&]() {
+				kernel->decode(str.data(), size, decoded.data());
+			});
+			throughput("decode", size, ns);
+		}
+	}
+	
+	// Hashing a digest's worth of data is dominated by per-call overhead;
+	// with several threads at it, any lock taken per call shows up too
+	const std::vector<unsigned char> data(32, 0xAB);
+	unsigned char digest[EVP_MAX_MD_SIZE];
+	for (MatchingType type : { SHA256Hash, SHA512Hash }) {
+		const EVP_MD *md = md_from_matching_type(type);
+		std::string name = type == SHA256Hash ? "SHA-256" : "SHA-512";
+		bench::measure("hash(), " + name + ", 32 bytes", 1000000, [&]() {
+			hash(md, digest, data.data(), data.data() + data.size());
+		});
+		bench::measure("match(), " + name + ", 32 bytes", 1000000, [&]() {
+			match(type, data.begin(), data.end());
+		});
+	}
+	
+	// Inputs that aren't a vector of bytes, like a record's data in a deque
+	// or a certificate's DER in a string; these used to be copied first
+	const std::string der(1500, 'x');
+	const std::deque<unsigned char> deque(der.begin(), der.end());
+	bench::measure("hash(), SHA-256, deque, 1500 bytes", 100000, [&]() {
+		hash(EVP_sha256(), digest, deque.begin(), deque.end());
+	});
+	bench::measure("hash(), SHA-256, string, 1500 bytes", 100000, [&]() {
+		hash(EVP_sha256(), der);
+	});
+	bench::measure("match(), SHA-256, const char*, 1500 bytes", 100000, [&]() {
+		match(SHA256Hash, der.c_str());
+	});
+	
+	// Certificate-sized buffers, like a trust bundle being turned into records
+	for (std::size_t count : { 4, 8, 64 }) {
+		std::vector<std::vector<unsigned char>> buffers(count, std::vector<unsigned char>(1500));
+		for (std::vector<unsigned char> &buf : buffers) {
+			for (unsigned char &c : buf) {
+				c = rng() & 0xFF;
+			}
+		}
+		std::vector<ByteView> views(buffers.begin(), buffers.end());
+		std::vector<unsigned char> out(count * EVP_MAX_MD_SIZE);
+		
+		for (const EVP_MD *md : { EVP_sha256(), EVP_sha512() }) {
+			for (const internal::HashKernel *kernel : internal::hash_kernels(md)) {
+				std::string name = std::string("hash_batch(), ") + EVP_MD_name(md) + ", " + kernel->name + ", " + std::to_string(count) + " x 1500 bytes";
+				double ns = bench::measure(name, 20000 / count, [&]() {
+					kernel->hash(md, views.data(), count, out.data());
+				});
+				throughput("hash_batch()", count * 1500, ns);
+			}
+		}
+	}
+	
+	std::printf("%u cores\n", std::thread::hardware_concurrency());
+	for (unsigned int threads = 1; threads <= std::max(std::thread::hardware_concurrency(), 4u); threads *= 2) {
+		const std::size_t count = 200000;
+		double ns = bench::measure("hash(), SHA-256, " + std::to_string(threads) + " threads, " + std::to_string(count) + " hashes", 1, [&]() {
+			std::vector<std::thread> pool;
+			for (unsigned int i = 0; i < threads; ++i) {
+				pool.emplace_back([&]() {
+					unsigned char out[EVP_MAX_MD_SIZE];
+					for (std::size_t n = 0; n < count / threads; ++n) {
+						hash(EVP_sha256(), out, data.data(), data.data() + data.size());
+					}
+				});
+			}
+			for (std::thread &thread : pool) {
+				thread.join();
+			}
+		});
+		std::printf("%-48s %12.1f ns/hash\n", "  hash()", ns / count);
+	}
+	
+	return 0;
+}
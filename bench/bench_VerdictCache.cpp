@@ -0,0 +1,118 @@
+/**
+ * bench_VerdictCache.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "bench.h"
+#include <libdane/libdane.h>
+#include "../test/resources.h"
+#include <memory>
+
+using namespace libdane;
+
+namespace
+{
+	struct State
+	{
+		DANERecordSet *set;
+		VerdictCache *cache;
+	};
+	
+	int verify_cb(int preverified, X509_STORE_CTX *ctx)
+	{
+		// Benchmark verification of the leaf, as a handshake would see it
+		State *state = static_cast<State*>(X509_STORE_CTX_get_app_data(ctx));
+		VerifyContext vctx(ctx);
+		if (vctx.depth() != 0) {
+			return 1;
+		}
+		
+		state->set->setVerdictCache(nullptr);
+		bench::measure("DANERecordSet::verify(ctx), uncached", 100000, [&]() {
+			state->set->verify(preverified, vctx);
+		});
+		
+		state->set->setVerdictCache(state->cache);
+		bench::measure("DANERecordSet::verify(ctx), cached", 100000, [&]() {
+			state->set->verify(preverified, vctx);
+		});
+		
+		// Every connection gets its own copy of the chain off the wire, with
+		// nothing computed for it yet; this is what verify(ctx) does with them
+		const std::size_t count = 10000;
+		auto fresh = [&]() {
+			std::vector<std::deque<Certificate>> chains(count + 1);
+			for (std::deque<Certificate> &chain : chains) {
+				for (const Certificate &cert : vctx.chain()) {
+					chain.emplace_back(std::shared_ptr<X509>(X509_dup(cert.x509()), X509_free).get());
+				}
+			}
+			return chains;
+		};
+		
+		std::size_t i = 0;
+		std::vector<std::deque<Certificate>> chains = fresh();
+		bench::measure("verify, uncached, fresh chain", count, [&]() {
+			const std::deque<Certificate> &chain = chains[i++];
+			chain[0].verify(chain[1]) && state->set->verify(preverified, chain[0], chain);
+		});
+		
+		// Signature checks are cached too, but not for as long
+		i = 0;
+		chains = fresh();
+		SignatureCache::shared().clear();
+		SignatureCache::shared().setCapacity(0);
+		bench::measure("verify, uncached, fresh chain, no signature cache", count, [&]() {
+			const std::deque<Certificate> &chain = chains[i++];
+			chain[0].verify(chain[1]) && state->set->verify(preverified, chain[0], chain);
+		});
+		
+		i = 0;
+		chains = fresh();
+		bench::measure("verify, cached, fresh chain", count, [&]() {
+			const std::deque<Certificate> &chain = chains[i++];
+			bool verdict;
+			state->cache->lookup(VerdictCache::makeKey(state->set->digest(), preverified, 0, chain), verdict);
+		});
+		
+		std::printf("hit ratio: %.4f\n", state->cache->hitRatio());
+		
+		return 1;
+	}
+}
+
+int main()
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	
+	// A typical RRset during a key rollover: the current and next keys
+	std::vector<DANERecord> records = {
+		DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, std::vector<unsigned char>(32, 0xAB)),
+		DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain.front()),
+	};
+	DANERecordSet set(records.begin(), records.end());
+	set.setTTL(300);
+	
+	VerdictCache cache;
+	State state = { &set, &cache };
+	
+	auto store = std::shared_ptr<X509_STORE>(X509_STORE_new(), X509_STORE_free);
+	X509_STORE_add_cert(&*store, chain.back().x509());
+	STACK_OF(X509) *untrusted = sk_X509_new_null();
+	for (auto it = chain.begin() + 1; it != chain.end(); ++it) {
+		sk_X509_push(untrusted, it->x509());
+	}
+	
+	auto ctx = std::shared_ptr<X509_STORE_CTX>(X509_STORE_CTX_new(), X509_STORE_CTX_free);
+	X509_STORE_CTX_init(&*ctx, &*store, chain.front().x509(), untrusted);
+	X509_STORE_CTX_set_flags(&*ctx, X509_V_FLAG_PARTIAL_CHAIN);
+	X509_STORE_CTX_set_time(&*ctx, 0, 1441065600);	// 2015-09-01
+	X509_STORE_CTX_set_app_data(&*ctx, &state);
+	X509_STORE_CTX_set_verify_cb(&*ctx, verify_cb);
+	X509_verify_cert(&*ctx);
+	sk_X509_free(untrusted);
+	
+	return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * bench_select.cpp
+ * bench_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ * 
+ * Usage: bench_select [selections]
+ * 
+ * Exits with a non-zero status if the resident set grows while selecting.
+ */
+
+#include "bench.h"
+#include "../test/resources.h"
+#include <libdane/libdane.h>
+#include <cstdlib>
+
+using namespace libdane;
+
+namespace
+{
+	/// Allowed RSS growth, to account for allocator noise
+	const std::size_t slack = 1024 * 1024;
+	
+	/// Checks and prints the RSS growth since a previous reading
+	bool check_rss(const char *name, std::size_t before)
+	{
+		std::size_t after = bench::rss();
+		long growth = static_cast<long>(after) - static_cast<long>(before);
+		std::printf("%-48s %12ld bytes RSS growth\n", name, growth);
+		return growth <= static_cast<long>(slack);
+	}
+}
+
+int main(int argc, char **argv)
+{
+	std::size_t selections = argc > 1 ? std::strtoul(argv[1], NULL, 10) : 10000000;
+	bool ok = true;
+	
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::deque<Certificate> microsoft = Certificate::parsePEM(resources::microsoftPEM);
+	chain.insert(chain.end(), microsoft.begin(), microsoft.end());
+	std::vector<unsigned char> der = chain[0].encoded();
+	
+	volatile std::size_t sink = 0;
+	
+	bench::measure("Certificate::select(SubjectPublicKeyInfo)", 1000000, [&]() {
+		sink = sink + chain[0].select(SubjectPublicKeyInfo).size();
+	});
+	bench::measure("Certificate::view(SubjectPublicKeyInfo)", 1000000, [&]() {
+		sink = sink + chain[0].view(SubjectPublicKeyInfo).size();
+	});
+	bench::measure("Certificate::view(FullCertificate)", 1000000, [&]() {
+		sink = sink + chain[0].view(FullCertificate).size();
+	});
+	
+	// Selections on long-lived certificates
+	std::size_t before = bench::rss();
+	for (std::size_t i = 0; i < selections; ++i) {
+		const Certificate &cert = chain[i % chain.size()];
+		sink = sink + cert.view(static_cast<Selector>(i & 1)).size();
+	}
+	ok = check_rss("view() on a chain", before) && ok;
+	
+	before = bench::rss();
+	for (std::size_t i = 0; i < selections / 10; ++i) {
+		sink = sink + chain[i % chain.size()].publicKey().size();
+	}
+	ok = check_rss("publicKey() on a chain", before) && ok;
+	
+	// Fresh certificates, so nothing can be served from a cache
+	before = bench::rss();
+	for (std::size_t i = 0; i < selections / 100; ++i) {
+		Certificate cert = Certificate::fromDER(der.data(), der.size());
+		sink = sink + cert.publicKey().size();
+	}
+	ok = check_rss("publicKey() on fresh certificates", before) && ok;
+	
+	if (!ok) {
+		std::printf("RSS grew by more than %zu bytes; something is leaking\n", slack);
+		return 1;
+	}
+	return 0;
+}
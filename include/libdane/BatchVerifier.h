@@ -0,0 +1,92 @@
+/**
+ * BatchVerifier.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_BATCHVERIFIER_H
+#define LIBDANE_BATCHVERIFIER_H
+
+#include "Certificate.h"
+#include "DANERecordSet.h"
+#include <deque>
+#include <vector>
+
+namespace libdane
+{
+	/**
+	 * Verifies large numbers of chains against record sets, in parallel.
+	 * 
+	 * This is meant for offline audits, such as checking every stored peer
+	 * chain against freshly fetched TLSA records. Each job is verified with
+	 * DANERecordSet::verifyChain(), on a pool of threads that steal work from
+	 * each other as they run out.
+	 */
+	class BatchVerifier
+	{
+	public:
+		/**
+		 * A chain to verify against a set of records.
+		 * 
+		 * Jobs only refer to their chains and record sets, which must outlive
+		 * the call to run(). Any number of jobs can share a record set.
+		 */
+		struct Job
+		{
+			/**
+			 * Constructs a job.
+			 * 
+			 * @param chain       Certificate chain, leaf first
+			 * @param records     Records to verify against
+			 * @param preverified Is the chain trusted by the system?
+			 */
+			Job(const std::deque<Certificate> &chain, const DANERecordSet &records, bool preverified = false):
+				chain(&chain), records(&records), preverified(preverified) {}
+			
+			const std::deque<Certificate> *chain;	///< Certificate chain, leaf first
+			const DANERecordSet *records;			///< Records to verify against
+			bool preverified;						///< Is the chain trusted by the system?
+		};
+		
+		/**
+		 * Constructs a verifier.
+		 * 
+		 * @param threads Number of threads to verify on, or 0 for one per core
+		 */
+		BatchVerifier(unsigned int threads = 0);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~BatchVerifier();
+		
+		
+		
+		/**
+		 * Verifies a number of jobs.
+		 * 
+		 * Jobs that fail with an exception are reported as failed.
+		 * 
+		 * @param  jobs  Pointer to the first job
+		 * @param  count Number of jobs
+		 * @return       Whether each job passed, in the same order
+		 */
+		std::vector<bool> run(const Job *jobs, std::size_t count) const;
+		
+		/**
+		 * Overload that takes a vector.
+		 */
+		std::vector<bool> run(const std::vector<Job> &jobs) const;
+		
+		
+		
+		unsigned int threads() const;					///< Number of threads, 0 = one per core
+		void setThreads(unsigned int v);				///< Sets threads()
+		
+	private:
+		unsigned int m_threads;
+	};
+}
+
+#endif
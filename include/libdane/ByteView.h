@@ -0,0 +1,74 @@
+/**
+ * ByteView.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_BYTEVIEW_H
+#define LIBDANE_BYTEVIEW_H
+
+#include <cstddef>
+#include <cstring>
+#include <vector>
+
+namespace libdane
+{
+	/**
+	 * A non-owning view of a sequence of bytes.
+	 * 
+	 * Views are only valid for as long as whatever they're viewing is.
+	 */
+	class ByteView
+	{
+	public:
+		typedef unsigned char value_type;				///< Element type
+		typedef const unsigned char* iterator;			///< Iterator type
+		typedef const unsigned char* const_iterator;	///< Iterator type
+		
+		/**
+		 * Constructs an empty view.
+		 */
+		ByteView(): m_data(nullptr), m_size(0) {}
+		
+		/**
+		 * Constructs a view of a buffer.
+		 */
+		ByteView(const unsigned char *data, std::size_t size): m_data(data), m_size(size) {}
+		
+		/**
+		 * Constructs a view of a vector's contents.
+		 */
+		ByteView(const std::vector<unsigned char> &vec): m_data(vec.data()), m_size(vec.size()) {}
+		
+		const unsigned char *data() const { return m_data; }			///< Pointer to the data
+		std::size_t size() const { return m_size; }						///< Number of bytes
+		bool empty() const { return m_size == 0; }						///< Is the view empty?
+		
+		iterator begin() const { return m_data; }						///< Iterator to the start
+		iterator end() const { return m_data + m_size; }				///< Iterator to the end
+		unsigned char operator[](std::size_t i) const { return m_data[i]; }	///< Byte at an index
+		
+		/**
+		 * Copies the viewed bytes into a vector.
+		 */
+		std::vector<unsigned char> toVector() const { return std::vector<unsigned char>(begin(), end()); }
+		
+	private:
+		const unsigned char *m_data;
+		std::size_t m_size;
+	};
+	
+	/**
+	 * Two views are equal if their contents are.
+	 */
+	inline bool operator==(const ByteView &a, const ByteView &b)
+	{
+		return a.size() == b.size() && (a.data() == b.data() || a.empty() || std::memcmp(a.data(), b.data(), a.size()) == 0);
+	}
+	
+	/// Negated operator==
+	inline bool operator!=(const ByteView &a, const ByteView &b) { return !(a == b); }
+}
+
+#endif
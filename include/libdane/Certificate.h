@@ -10,18 +10,32 @@
 
 #include "_internal/openssl.h"
 #include "common.h"
+#include "ByteView.h"
+#include <array>
+#include <cstring>
+#include <functional>
 #include <vector>
 #include <deque>
 #include <string>
 
 namespace libdane
 {
+	class CertificatePool;
+	
+	namespace internal
+	{
+		struct CertificateCache;
+	}
+	
 	/**
 	 * Wrapper around an OpenSSL certificate.
 	 */
 	class Certificate
 	{
 	public:
+		/// A SHA-256 hash of a certificate's DER encoding
+		typedef std::array<unsigned char, 32> Fingerprint;
+		
 		/**
 		 * Parses a PEM file into a list of Certificates.
 		 * 
@@ -29,16 +43,36 @@ namespace libdane
 		 * can be parsed. This is a convenience function that splits a PEM file
 		 * into multiple pieces and parses each one.
 		 * 
-		 * @param pem A PEM-encoded certificate or certificate chain
+		 * Blocks that aren't valid certificates are skipped.
+		 * 
+		 * @param pem  A PEM-encoded certificate or certificate chain
+		 * @param pool A pool to draw certificates from, if any
 		 */
-		static std::deque<Certificate> parsePEM(const std::string &pem);
+		static std::deque<Certificate> parsePEM(const std::string &pem, CertificatePool *pool = nullptr);
 		
 		/**
-		 * Creates a certificate from an X509 object.
+		 * Parses a PEM buffer into a list of Certificates.
+		 * 
+		 * @param data Pointer to PEM-encoded data
+		 * @param size Size of the data
+		 * @param pool A pool to draw certificates from, if any
+		 */
+		static std::deque<Certificate> parsePEM(const char *data, std::size_t size, CertificatePool *pool = nullptr);
+		
+		/**
+		 * Creates a certificate from its DER encoding.
 		 * 
-		 * The certificate is copied, and destroyed with this object.
+		 * @param  data Pointer to DER-encoded data
+		 * @param  size Size of the data
+		 * @return      A certificate, which is falsy if parsing failed
+		 */
+		static Certificate fromDER(const unsigned char *data, std::size_t size);
+		
+		/**
+		 * Creates a certificate from an X509 object.
 		 * 
-		 * @todo Increment the reference count instead of duplicating
+		 * The certificate is not copied; its reference count is incremented,
+		 * and decremented again when this object is destroyed.
 		 * 
 		 * @param x509 Underlying representation
 		 */
@@ -53,14 +87,33 @@ namespace libdane
 		
 		/**
 		 * Copy constructor.
+		 * 
+		 * Both certificates will share the same underlying representation.
 		 */
 		Certificate(const Certificate &other);
 		
+		/**
+		 * Move constructor.
+		 * 
+		 * The other certificate is left empty.
+		 */
+		Certificate(Certificate &&other);
+		
 		/**
 		 * Destructor.
 		 */
 		virtual ~Certificate();
 		
+		/**
+		 * Copy assignment operator.
+		 */
+		Certificate &operator=(const Certificate &other);
+		
+		/**
+		 * Move assignment operator.
+		 */
+		Certificate &operator=(Certificate &&other);
+		
 		/**
 		 * Returns the underlying representation.
 		 */
@@ -78,11 +131,17 @@ namespace libdane
 		
 		/**
 		 * Returns the certificate's public key.
+		 * 
+		 * The key is only encoded once; subsequent calls return a copy. Use
+		 * view() to avoid the copy.
 		 */
 		std::vector<unsigned char> publicKey() const;
 		
 		/**
 		 * Returns the DER representation of the certificate.
+		 * 
+		 * The certificate is only encoded once; subsequent calls return a copy.
+		 * Use view() to avoid the copy.
 		 */
 		std::vector<unsigned char> encoded() const;
 		
@@ -94,9 +153,82 @@ namespace libdane
 		 */
 		std::vector<unsigned char> select(Selector sel) const;
 		
+		/**
+		 * Returns a view of the data matching the given selector.
+		 * 
+		 * Nothing is copied; the public key is a slice of the DER encoding.
+		 * The view is valid for as long as the underlying X509 object is,
+		 * which is at least as long as any Certificate wrapping it.
+		 * 
+		 * @param  sel Selector to use
+		 * @return     A view of the selected data
+		 * @throws     std::runtime_error for an invalid selector
+		 */
+		ByteView view(Selector sel) const;
+		
+		/**
+		 * Returns the selected data, hashed according to a matching type.
+		 * 
+		 * This is what DANE records are compared against. The result is
+		 * computed on first use and cached with the underlying X509 object, so
+		 * it's shared by every Certificate wrapping it, and it's safe to call
+		 * from multiple threads at once. If the selection is empty, so is
+		 * the digest.
+		 * 
+		 * @param  sel  Selector to use
+		 * @param  type Matching type to use; ExactMatch returns the selection
+		 * @return      A reference that lives as long as the X509 object
+		 * @throws      std::runtime_error for an invalid selector or type
+		 */
+		const std::vector<unsigned char>& digest(Selector sel, MatchingType type) const;
+		
+		/**
+		 * Returns the selected data, hashed according to a matching type.
+		 * 
+		 * Like digest(Selector, MatchingType), but resolved at compile time.
+		 * Instantiated for every valid selector and matching type.
+		 */
+		template<Selector S, MatchingType M>
+		const std::vector<unsigned char>& digest() const;
+		
+		/**
+		 * Computes the digests of a number of certificates at once.
+		 * 
+		 * Certificates whose digests are already cached are skipped; the rest
+		 * are hashed together with hash_batch(), and cached as if digest() had
+		 * been called on each of them. This is considerably faster than
+		 * calling digest() on each for large numbers of certificates.
+		 * 
+		 * @param certs Certificates to hash
+		 * @param sel   Selector to use
+		 * @param type  Matching type to use; ExactMatch does nothing
+		 * @throws      std::runtime_error for an invalid selector or type
+		 */
+		static void prefetchDigests(const std::vector<Certificate> &certs, Selector sel, MatchingType type);
+		
+		/**
+		 * Returns the certificate's fingerprint.
+		 * 
+		 * This is the SHA-256 hash of its DER encoding, computed on first use
+		 * and cached like digest(). If the certificate is empty or can't be
+		 * encoded, it's all zeroes; see hasFingerprint().
+		 */
+		const Fingerprint& fingerprint() const;
+		
+		/**
+		 * Does the certificate have a fingerprint?
+		 * 
+		 * Certificates without one can't be told apart by content, so they
+		 * only compare equal to copies sharing the same X509 object.
+		 */
+		bool hasFingerprint() const;
+		
 		/**
 		 * Verifies that the certificate was issued by another one.
 		 * 
+		 * Successful checks are remembered in SignatureCache::shared(), so
+		 * checking the same pair again is just a lookup.
+		 * 
 		 * @param  other Another certificate
 		 * @return       true if other was used to issue this
 		 */
@@ -109,8 +241,11 @@ namespace libdane
 		
 		/**
 		 * Two certificates are equal if the underlying certs are.
+		 * 
+		 * Certificates sharing an X509 object are trivially equal; others are
+		 * compared by fingerprint(), and never equal if either lacks one.
 		 */
-		inline bool operator==(const Certificate &other) const { return X509_cmp(m_x509, other.x509()) == 0; };
+		bool operator==(const Certificate &other) const;
 		
 		/// Negated operator==
 		inline bool operator!=(const Certificate &other) const { return !(*this == other); };
@@ -125,7 +260,36 @@ namespace libdane
 		std::string nameStr(X509_NAME *name) const;
 		
 	private:
+		/// Returns the (cached) DER encoding of the certificate
+		const std::vector<unsigned char>& der() const;
+		
 		X509 *m_x509;
+		
+		/// Lazily computed encodings; owned by the X509 object, as ex_data
+		internal::CertificateCache *m_cache;
+	};
+}
+
+namespace std
+{
+	/**
+	 * Hashes a Certificate by its fingerprint, for use in unordered containers.
+	 */
+	template<>
+	struct hash<libdane::Certificate>
+	{
+		std::size_t operator()(const libdane::Certificate &cert) const
+		{
+			// Certificates without a fingerprint only equal themselves
+			if (!cert.hasFingerprint()) {
+				return std::hash<const void*>()(cert.x509());
+			}
+			
+			// The fingerprint is already a good hash; just take a piece of it
+			std::size_t h;
+			std::memcpy(&h, cert.fingerprint().data(), sizeof(h));
+			return h;
+		}
 	};
 }
 
@@ -0,0 +1,125 @@
+/**
+ * CertificateLoader.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_CERTIFICATELOADER_H
+#define LIBDANE_CERTIFICATELOADER_H
+
+#include "Certificate.h"
+#include <string>
+#include <vector>
+
+namespace libdane
+{
+	/**
+	 * Bulk loader for large numbers of certificates.
+	 * 
+	 * This is meant for loading trust bundles and directories of pinned
+	 * certificates at startup. Files are memory mapped, split into individual
+	 * certificates, and parsed on a number of threads at once.
+	 * 
+	 * Files can contain either PEM-encoded certificates, or DER-encoded ones
+	 * simply concatenated together. Anything that can't be parsed is skipped.
+	 */
+	class CertificateLoader
+	{
+	public:
+		/**
+		 * Constructs a loader.
+		 * 
+		 * @param threads Number of threads to parse on, or 0 for one per core
+		 */
+		CertificateLoader(unsigned int threads = 0);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~CertificateLoader();
+		
+		
+		
+		/**
+		 * Loads certificates from a buffer.
+		 * 
+		 * @param data Pointer to PEM or concatenated DER data
+		 * @param size Size of the data
+		 * @return     All certificates found, in order
+		 */
+		std::vector<Certificate> load(const char *data, std::size_t size) const;
+		
+		/**
+		 * Loads certificates from a file.
+		 * 
+		 * @param  path Path to a PEM or concatenated DER file
+		 * @return      All certificates found, in order
+		 * @throws      std::runtime_error if the file can't be read
+		 */
+		std::vector<Certificate> loadFile(const std::string &path) const;
+		
+		/**
+		 * Loads certificates from a number of files.
+		 * 
+		 * All files are split up before anything is parsed, so the work is
+		 * spread evenly over the threads regardless of file sizes.
+		 * 
+		 * @param  paths Paths to PEM or concatenated DER files
+		 * @return       All certificates found, in order
+		 * @throws       std::runtime_error if a file can't be read
+		 */
+		std::vector<Certificate> loadFiles(const std::vector<std::string> &paths) const;
+		
+		/**
+		 * Loads certificates from every file in a directory.
+		 * 
+		 * Subdirectories are not descended into.
+		 * 
+		 * @param  path Path to a directory
+		 * @return      All certificates found, ordered by file name
+		 * @throws      std::runtime_error if the directory can't be read
+		 */
+		std::vector<Certificate> loadDirectory(const std::string &path) const;
+		
+		
+		
+		unsigned int threads() const;			///< Number of threads, 0 = one per core
+		void setThreads(unsigned int v);		///< Sets threads()
+		
+	protected:
+		/**
+		 * A single certificate's worth of data.
+		 */
+		struct Chunk {
+			const char *begin;		///< Start of the data
+			const char *end;		///< End of the data
+			bool pem;				///< Is the data a base64 PEM body?
+		};
+		
+		/**
+		 * Splits a buffer into chunks containing one certificate each.
+		 * 
+		 * If the buffer contains any PEM certificates, it's treated as PEM;
+		 * otherwise, it's treated as concatenated DER.
+		 * 
+		 * @param data   Pointer to the data
+		 * @param size   Size of the data
+		 * @param chunks Container to append chunks to
+		 */
+		virtual void split(const char *data, std::size_t size, std::vector<Chunk> &chunks) const;
+		
+		/**
+		 * Parses chunks into certificates, in parallel.
+		 * 
+		 * @param  chunks Chunks to parse
+		 * @return        Parsed certificates, in order, minus unparseable ones
+		 */
+		virtual std::vector<Certificate> parse(const std::vector<Chunk> &chunks) const;
+		
+	private:
+		unsigned int m_threads;
+	};
+}
+
+#endif
@@ -0,0 +1,127 @@
+/**
+ * CertificatePool.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_CERTIFICATEPOOL_H
+#define LIBDANE_CERTIFICATEPOOL_H
+
+#include "Certificate.h"
+#include "_internal/lru.h"
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <functional>
+#include <mutex>
+
+namespace libdane
+{
+	/**
+	 * Pool of interned certificates.
+	 * 
+	 * Connections to the same hosts keep presenting the same handful of
+	 * certificates. Interning them means every connection shares one X509
+	 * object per distinct certificate, along with everything cached on it
+	 * (encodings, digests, signature checks), rather than each building its
+	 * own copy.
+	 * 
+	 * Certificates are keyed by the SHA-256 of their DER encoding, and the
+	 * least recently used ones are dropped from the pool once it's full;
+	 * certificates handed out remain valid regardless.
+	 * 
+	 * All methods are thread safe.
+	 */
+	class CertificatePool
+	{
+	public:
+		/**
+		 * Returns a process-wide pool.
+		 */
+		static CertificatePool &shared();
+		
+		
+		
+		/**
+		 * Constructs a pool.
+		 * 
+		 * @param capacity Maximum number of certificates; 0 disables pooling
+		 */
+		CertificatePool(std::size_t capacity = 1024);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~CertificatePool();
+		
+		
+		
+		/**
+		 * Interns a certificate.
+		 * 
+		 * @param  cert A certificate
+		 * @return      The pooled certificate identical to cert; cert itself
+		 *              if there was none, which is then added to the pool
+		 */
+		Certificate intern(const Certificate &cert);
+		
+		/**
+		 * Interns a DER-encoded certificate.
+		 * 
+		 * The data is only parsed if it isn't already in the pool.
+		 * 
+		 * @param  data Pointer to DER-encoded data
+		 * @param  size Size of the data
+		 * @return      The pooled certificate, or a falsy one if the data
+		 *              couldn't be parsed
+		 */
+		Certificate intern(const unsigned char *data, std::size_t size);
+		
+		/**
+		 * Removes all certificates, and resets the counters.
+		 */
+		void clear();
+		
+		
+		
+		std::size_t size() const;				///< Number of certificates
+		std::size_t capacity() const;			///< Maximum number of certificates
+		void setCapacity(std::size_t v);		///< Sets capacity()
+		
+		uint64_t hits() const;					///< Number of lookups that hit
+		uint64_t misses() const;				///< Number of lookups that missed
+		uint64_t evictions() const;				///< Number of evicted certificates
+		
+	protected:
+		/// SHA-256 of a certificate's DER encoding
+		typedef std::array<unsigned char, 32> Key;
+		
+		/// Hash function for keys; they're digests, so any bytes will do
+		struct KeyHash {
+			std::size_t operator()(const Key &key) const {
+				std::size_t h;
+				std::memcpy(&h, key.data(), sizeof(h));
+				return h;
+			}
+		};
+		
+		/**
+		 * Looks up a certificate, or inserts one if there's none.
+		 * 
+		 * @param  key  Key to look up
+		 * @param  make Function that makes a certificate to insert
+		 * @return      The pooled certificate
+		 */
+		Certificate lookup(const Key &key, std::function<Certificate()> make);
+		
+	private:
+		mutable std::mutex m_mutex;
+		internal::LRUCache<Key, Certificate, KeyHash> m_certs;
+		
+		std::atomic<uint64_t> m_hits;
+		std::atomic<uint64_t> m_misses;
+	};
+}
+
+#endif
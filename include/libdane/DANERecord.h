@@ -8,9 +8,11 @@
 #ifndef LIBDANE_DANERECORD_H
 #define LIBDANE_DANERECORD_H
 
+#include <cstdint>
 #include <string>
 #include <vector>
 #include "_internal/openssl.h"
+#include "ByteView.h"
 #include "VerifyContext.h"
 #include "common.h"
 
@@ -18,6 +20,10 @@ namespace libdane
 {
 	/**
 	 * Represents a single DANE DNS record.
+	 * 
+	 * Records are meant to be cached in large numbers, so they're kept
+	 * compact: data up to 64 bytes, which covers SHA-256 and SHA-512 digests,
+	 * is stored inline, and only longer data (exact matches) goes on the heap.
 	 */
 	class DANERecord
 	{
@@ -30,7 +36,7 @@ namespace libdane
 		/**
 		 * Constructs a DANE record with the given values.
 		 */
-		DANERecord(Usage usage, Selector selector, MatchingType matching, std::vector<unsigned char> data);
+		DANERecord(Usage usage, Selector selector, MatchingType matching, ByteView data);
 		
 		/**
 		 * Constructs a DANE record matching the given certificate.
@@ -40,10 +46,40 @@ namespace libdane
 		 */
 		DANERecord(Usage usage, Selector selector, MatchingType matching, const Certificate &cert);
 		
+		/**
+		 * Constructs DANE records matching a number of certificates.
+		 * 
+		 * The certificates are hashed together with
+		 * Certificate::prefetchDigests(), rather than one at a time.
+		 * 
+		 * @return One record per certificate, in the same order
+		 */
+		static std::vector<DANERecord> fromCertificates(Usage usage, Selector selector, MatchingType matching, const std::vector<Certificate> &certs);
+		
+		/**
+		 * Copy constructor.
+		 */
+		DANERecord(const DANERecord &other);
+		
+		/**
+		 * Move constructor.
+		 */
+		DANERecord(DANERecord &&other);
+		
 		/**
 		 * Destructor.
 		 */
-		virtual ~DANERecord();
+		~DANERecord();
+		
+		/**
+		 * Copy assignment operator.
+		 */
+		DANERecord &operator=(const DANERecord &other);
+		
+		/**
+		 * Move assignment operator.
+		 */
+		DANERecord &operator=(DANERecord &&other);
 		
 		/**
 		 * Verifies the presented context against this record.
@@ -75,6 +111,25 @@ namespace libdane
 		 */
 		bool verify(const Certificate &cert) const;
 		
+		/**
+		 * Checks if the record can ever match anything.
+		 * 
+		 * Records with unknown usages, selectors or matching types, and
+		 * records whose data isn't the length of their digest, must be
+		 * ignored as per RFC 7671, section 4.1.
+		 */
+		bool usable() const;
+		
+		/**
+		 * Returns the record in canonical form, for matching.
+		 * 
+		 * Exact matches are replaced with a SHA-256 digest of their data,
+		 * which is equivalent, but can be compared against a certificate's
+		 * cached digest instead of a freshly encoded selection. Other records
+		 * are returned as-is.
+		 */
+		DANERecord normalized() const;
+		
 		/**
 		 * Returns a human-readable representation of the record.
 		 * 
@@ -93,8 +148,8 @@ namespace libdane
 		MatchingType matching() const;					///< Matching Type
 		void setMatching(MatchingType v);				///< Sets matching()
 		
-		std::vector<unsigned char> data() const;		///< Binary data
-		void setData(std::vector<unsigned char> v);		///< Sets data()
+		ByteView data() const;							///< Binary data; valid until modified
+		void setData(ByteView v);						///< Sets data()
 		
 	protected:
 		/// Implementation for verify() with DANERecord::CAConstraints
@@ -110,10 +165,24 @@ namespace libdane
 		bool verifyDomainIssuedCertificate(bool preverified, const Certificate &cert, const std::deque<Certificate> &chain) const;
 		
 	private:
-		Usage m_usage;
-		Selector m_selector;
-		MatchingType m_matching;
-		std::vector<unsigned char> m_data;
+		/// Data up to this size is stored inline
+		static const std::size_t InlineSize = 64;
+		
+		/// Is the data stored on the heap?
+		bool isHeap() const { return m_size > InlineSize; }
+		
+		/// Releases heap-allocated data, if any
+		void release();
+		
+		union {
+			unsigned char m_inline[InlineSize];
+			unsigned char *m_heap;
+		};
+		std::uint32_t m_size;
+		
+		std::uint8_t m_usage;
+		std::uint8_t m_selector;
+		std::uint8_t m_matching;
 	};
 }
 
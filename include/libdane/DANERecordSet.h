@@ -0,0 +1,267 @@
+/**
+ * DANERecordSet.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_DANERECORDSET_H
+#define LIBDANE_DANERECORDSET_H
+
+#include "DANERecord.h"
+#include "Matcher.h"
+#include "VerifyContext.h"
+#include "common.h"
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <unordered_set>
+#include <vector>
+
+namespace libdane
+{
+	class VerdictCache;
+	
+	/**
+	 * A set of DANE records, prepared for verifying certificates against.
+	 * 
+	 * This is meant to be built once from a TLSA RRset, and then used from
+	 * an OpenSSL verify callback in place of libdane::verify().
+	 * 
+	 * Records are grouped by usage, selector and matching type, so each
+	 * certificate is selected and hashed at most once per group, and looked
+	 * up in a hash set regardless of how many records there are. Groups that
+	 * don't depend on the system's trust store are checked first.
+	 * 
+	 * A set is meant to be kept around per destination, and the same record
+	 * nearly always matches for a given destination, so the group that last
+	 * matched is tried before the rest.
+	 */
+	class DANERecordSet
+	{
+	public:
+		/// A SHA-256 digest identifying the set's records
+		typedef std::array<unsigned char, 32> Digest;
+		
+		/**
+		 * Constructs an empty set.
+		 */
+		DANERecordSet();
+		
+		/**
+		 * Constructs a set from a range of records.
+		 * 
+		 * @throws std::runtime_error if a record is invalid
+		 */
+		template<typename IterT>
+		DANERecordSet(IterT begin, IterT end):
+			DANERecordSet()
+		{
+			for (IterT it = begin; it != end; ++it) {
+				this->add(*it);
+			}
+		}
+		
+		/**
+		 * Copy constructor.
+		 */
+		DANERecordSet(const DANERecordSet &other);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~DANERecordSet();
+		
+		/**
+		 * Copy assignment operator.
+		 */
+		DANERecordSet &operator=(const DANERecordSet &other);
+		
+		
+		
+		/**
+		 * Adds a record to the set.
+		 * 
+		 * @param  rec A record to add
+		 * @throws     std::runtime_error if the record's usage, selector or
+		 *             matching type is invalid, or its data doesn't fit its
+		 *             matching type
+		 */
+		void add(const DANERecord &rec);
+		
+		/**
+		 * Removes all records from the set.
+		 */
+		void clear();
+		
+		/**
+		 * Returns the records in the set, in the order they were added.
+		 */
+		const std::vector<DANERecord>& records() const;
+		
+		std::size_t size() const;						///< Number of records
+		bool empty() const;								///< Is the set empty?
+		
+		/**
+		 * Returns a digest of the records in the set.
+		 * 
+		 * The order records were added in doesn't matter.
+		 */
+		const Digest& digest() const;
+		
+		std::uint32_t ttl() const;						///< TTL of the records, in seconds
+		void setTTL(std::uint32_t v);					///< Sets ttl()
+		
+		VerdictCache *verdictCache() const;				///< Verdict cache, if any
+		void setVerdictCache(VerdictCache *v);			///< Sets verdictCache()
+		
+		uint64_t verifications() const;					///< Number of certificates verified
+		uint64_t lookups() const;						///< Number of groups looked up in
+		
+		/**
+		 * Returns the average number of groups looked up in per certificate.
+		 */
+		double averageLookups() const;
+		
+		/**
+		 * Resets verifications() and lookups().
+		 */
+		void resetStats();
+		
+		
+		
+		/**
+		 * Verifies the presented context against the set.
+		 * 
+		 * This is meant to be called from an OpenSSL verify callback. The
+		 * current certificate's issuer is only checked once, rather than once
+		 * per record.
+		 * 
+		 * If a verdictCache() is set, and the records have a nonzero ttl(),
+		 * verdicts are looked up there first, and recorded there for up to
+		 * ttl() seconds.
+		 * 
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  ctx         The active verification context
+		 * @return             Whether any record in the set passed
+		 */
+		bool verify(bool preverified, const VerifyContext &ctx) const;
+		
+		/**
+		 * Verifies a certificate at a given depth in a context's chain.
+		 * 
+		 * This is verify(bool, const VerifyContext&) for a certificate other
+		 * than the current one; see HandshakeVerifier.
+		 * 
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  ctx         The active verification context
+		 * @param  depth       Position of the certificate in the chain
+		 * @return             Whether any record in the set passed
+		 */
+		bool verify(bool preverified, const VerifyContext &ctx, int depth) const;
+		
+		/**
+		 * Verifies a certificate at a given depth, bypassing verdictCache().
+		 * 
+		 * For verdicts that mustn't outlive the handshake they came from.
+		 * 
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  ctx         The active verification context
+		 * @param  depth       Position of the certificate in the chain
+		 * @return             Whether any record in the set passed
+		 */
+		bool verifyUncached(bool preverified, const VerifyContext &ctx, int depth) const;
+		
+		/**
+		 * Verifies the presented certificate and chain against the set.
+		 * 
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  cert        Current certificate to process
+		 * @param  chain       Full certificate chain
+		 * @return             Whether any record in the set passed
+		 */
+		bool verify(bool preverified, const Certificate &cert, const std::deque<Certificate> &chain) const;
+		
+		/**
+		 * Verifies a whole chain against the set, outside of a handshake.
+		 * 
+		 * This does what an OpenSSL verify callback using this set would do
+		 * over the course of a handshake: every certificate, from the root
+		 * down, must have been issued by the next one up, and must pass
+		 * verify(). Nothing is checked against a trust store; that is up to
+		 * the caller, and reflected in preverified.
+		 * 
+		 * @param  preverified Is the chain trusted by the system?
+		 * @param  chain       Full certificate chain, leaf first
+		 * @return             Whether the chain passed at every depth
+		 */
+		bool verifyChain(bool preverified, const std::deque<Certificate> &chain) const;
+		
+	protected:
+		/**
+		 * Hash function for record data.
+		 * 
+		 * All data is stored as digests, which are already uniformly
+		 * distributed, so they're hashed by taking their first few bytes;
+		 * data too short for that is hashed properly.
+		 */
+		struct DataHash
+		{
+			std::size_t operator()(const std::vector<unsigned char> &data) const;
+		};
+		
+		/**
+		 * Records sharing a usage, selector and matching type.
+		 */
+		struct Group
+		{
+			const MatcherFunctions *matcher;
+			std::unordered_set<std::vector<unsigned char>, DataHash> data;
+		};
+		
+		/**
+		 * Returns the index of the i:th group to try.
+		 * 
+		 * This is the group that last matched, followed by the rest in order.
+		 * 
+		 * @param  i      Position in the order to try groups in
+		 * @param  isLeaf Is the certificate being verified the leaf?
+		 * @return        An index into the groups
+		 */
+		std::size_t groupAt(std::size_t i, bool isLeaf) const;
+		
+		/**
+		 * Verifies a certificate against a group.
+		 * 
+		 * @param  index       Index of the group to verify against
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  cert        Current certificate to process
+		 * @param  isLeaf      Is cert the first certificate in the chain?
+		 * @param  isRoot      Is cert the last certificate in the chain?
+		 * @return             Whether any record in the group passed
+		 */
+		bool verify(std::size_t index, bool preverified, const Certificate &cert, bool isLeaf, bool isRoot) const;
+		
+	private:
+		std::vector<DANERecord> m_records;
+		
+		/// Sorted by cost, cheapest first
+		std::vector<Group> m_groups;
+		
+		/// Digests of the individual records, sorted
+		std::vector<Digest> m_recordDigests;
+		Digest m_digest;
+		
+		std::uint32_t m_ttl;
+		VerdictCache *m_verdictCache;
+		
+		/// The group that last matched, for leaves and other certificates
+		mutable std::atomic<std::size_t> m_preferred[2];
+		
+		mutable std::atomic<uint64_t> m_verifications;
+		mutable std::atomic<uint64_t> m_lookups;
+	};
+}
+
+#endif
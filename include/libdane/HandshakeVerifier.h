@@ -0,0 +1,110 @@
+/**
+ * HandshakeVerifier.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_HANDSHAKEVERIFIER_H
+#define LIBDANE_HANDSHAKEVERIFIER_H
+
+#include "_internal/openssl.h"
+#include "DANERecordSet.h"
+#include "VerifyContext.h"
+#include <vector>
+
+namespace libdane
+{
+	class CertificatePool;
+	
+	/**
+	 * Evaluates a record set once per handshake.
+	 * 
+	 * OpenSSL calls its verify callback once for every certificate in the
+	 * chain, and verifying each one on its own means reading the chain out
+	 * of the context over and over. Instead, the first callback evaluates
+	 * every depth in one go, and attaches the results to the context; the
+	 * rest just look theirs up.
+	 * 
+	 * Only untrusted verdicts are evaluated up front. A trusted verdict is
+	 * evaluated the first time one is asked for, and only recorded in the
+	 * set's verdict cache once OpenSSL has called back about every link.
+	 * 
+	 * The simplest way to use this is to call verify() from the callback:
+	 * 
+	 *     ctx->set_verify_callback([=](bool preverified, asio::ssl::verify_context &ctx) {
+	 *         return libdane::HandshakeVerifier::verify(set, preverified, ctx.native_handle());
+	 *     });
+	 */
+	class HandshakeVerifier
+	{
+	public:
+		/**
+		 * Verifies the current certificate in a verify callback.
+		 * 
+		 * The first call for a context evaluates the whole chain, and attaches
+		 * the verifier to the context, which frees it along with itself. If
+		 * OpenSSL rebuilds the chain afterwards, it's evaluated again.
+		 * 
+		 * @param  set         Records to verify against; must outlive ctx
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  ctx         The active verification context
+		 * @param  pool        A pool to intern the chain's certificates in, if any
+		 * @return             Whether the current certificate passed
+		 */
+		static bool verify(const DANERecordSet &set, bool preverified, X509_STORE_CTX *ctx, CertificatePool *pool = nullptr);
+		
+		/**
+		 * Returns the verifier attached to a context, if any.
+		 */
+		static HandshakeVerifier *attached(X509_STORE_CTX *ctx);
+		
+		
+		
+		/**
+		 * Evaluates a set against every untrusted certificate in a context's chain.
+		 * 
+		 * @param set Records to verify against
+		 * @param ctx The active verification context
+		 */
+		HandshakeVerifier(const DANERecordSet &set, const VerifyContext &ctx);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~HandshakeVerifier();
+		
+		/**
+		 * Returns the verdict for a certificate in the chain.
+		 * 
+		 * Trusted verdicts for certificates that failed untrusted are
+		 * evaluated on first use.
+		 * 
+		 * @param  depth       Position of the certificate in the chain
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @return             The verdict; false for depths outside the chain
+		 */
+		bool verdict(int depth, bool preverified) const;
+		
+		/**
+		 * Returns the verdict for the context's current certificate.
+		 */
+		bool verdict(bool preverified) const;
+		
+		
+		
+		const DANERecordSet &set() const;				///< Records verified against
+		const VerifyContext &context() const;			///< Context verified
+		
+	private:
+		/// Verdicts per depth, for untrusted and trusted certificates, and
+		/// whether the trusted one has been evaluated yet
+		enum { Untrusted = 1 << 0, Trusted = 1 << 1, Evaluated = 1 << 2 };
+		
+		const DANERecordSet *m_set;
+		VerifyContext m_ctx;
+		mutable std::vector<unsigned char> m_verdicts;
+	};
+}
+
+#endif
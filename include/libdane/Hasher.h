@@ -0,0 +1,232 @@
+/**
+ * Hasher.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_HASHER_H
+#define LIBDANE_HASHER_H
+
+#include "_internal/openssl.h"
+#include "ByteView.h"
+#include <algorithm>
+#include <iterator>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace libdane
+{
+	namespace internal
+	{
+		/**
+		 * Returns an explicitly fetched equivalent of a digest.
+		 * 
+		 * On OpenSSL 3, initializing a context with eg. EVP_sha256() looks
+		 * up its implementation in the provider store, under a lock, every
+		 * time. SHA-256 and SHA-512 are fetched once instead, and kept for the
+		 * lifetime of the library; anything else, or anything on an older
+		 * OpenSSL, is returned as-is.
+		 * 
+		 * @param  md A digest, or nullptr
+		 * @return    A digest to initialize contexts with
+		 */
+		const EVP_MD *fetched_md(const EVP_MD *md);
+		
+		/**
+		 * Returns the calling thread's digest context.
+		 * 
+		 * The context is created on first use and freed when the thread exits;
+		 * reinitializing it with EVP_DigestInit_ex() rather than creating a new
+		 * one saves an allocation per hash, and lets OpenSSL 3 reuse the
+		 * provider's state if the digest didn't change.
+		 */
+		EVP_MD_CTX *digest_context();
+		
+		/**
+		 * Is an iterator known to point into contiguous memory?
+		 * 
+		 * True for pointers, and iterators into vectors and strings.
+		 */
+		template<typename IterT, typename T = typename std::iterator_traits<IterT>::value_type>
+		struct is_contiguous_iterator: std::integral_constant<bool,
+			std::is_pointer<IterT>::value ||
+			(!std::is_same<T, bool>::value && (
+				std::is_same<IterT, typename std::vector<T>::iterator>::value ||
+				std::is_same<IterT, typename std::vector<T>::const_iterator>::value)) ||
+			std::is_same<IterT, std::string::iterator>::value ||
+			std::is_same<IterT, std::string::const_iterator>::value ||
+			std::is_same<IterT, std::wstring::iterator>::value ||
+			std::is_same<IterT, std::wstring::const_iterator>::value>
+		{};
+	}
+	
+	/**
+	 * Incremental hash calculation.
+	 * 
+	 * Data can be fed in any number of pieces, from anything iterable,
+	 * without first being copied into one buffer; contiguous ranges go
+	 * straight to OpenSSL, anything else through a small buffer on the stack.
+	 * Values wider than a byte are hashed as their in-memory representation.
+	 * 
+	 *     Hasher hasher(EVP_sha256());
+	 *     hasher.update(header);
+	 *     hasher.update(chunks.begin(), chunks.end());
+	 *     std::vector<unsigned char> digest(hasher.size());
+	 *     hasher.final(digest.data());
+	 */
+	class Hasher
+	{
+	public:
+		/**
+		 * Starts a hash, with a context of its own.
+		 * 
+		 * @param type Type of hash to calculate
+		 * @throws std::runtime_error if the context can't be set up
+		 */
+		explicit Hasher(const EVP_MD *type);
+		
+		/**
+		 * Starts a hash, with a borrowed context.
+		 * 
+		 * Nothing else may use the context until the hasher is destroyed;
+		 * this is how hash() uses internal::digest_context().
+		 * 
+		 * @param type Type of hash to calculate
+		 * @param ctx  Context to use
+		 * @throws std::runtime_error if the context can't be set up
+		 */
+		Hasher(const EVP_MD *type, EVP_MD_CTX *ctx);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~Hasher();
+		
+		Hasher(const Hasher&) = delete;
+		Hasher &operator=(const Hasher&) = delete;
+		
+		
+		
+		/**
+		 * Feeds a buffer to the hash.
+		 * 
+		 * @throws std::runtime_error if OpenSSL fails
+		 */
+		void update(const void *data, std::size_t size);
+		
+		/**
+		 * Feeds a view to the hash.
+		 */
+		void update(ByteView data) { this->update(data.data(), data.size()); }
+		
+		/**
+		 * Feeds a string's characters to the hash.
+		 */
+		template<typename CharT>
+		void update(const std::basic_string<CharT> &str) { this->update(str.data(), str.size() * sizeof(CharT)); }
+		
+		/**
+		 * Feeds a range to the hash.
+		 * 
+		 * @param begin Iterator to the start of the data
+		 * @param end   Iterator to the end of the data
+		 */
+		template<typename IterT>
+		void update(IterT begin, IterT end)
+		{
+			this->updateRange(begin, end, internal::is_contiguous_iterator<IterT>());
+		}
+		
+		/**
+		 * Finishes the hash; the hasher can't be updated after this.
+		 * 
+		 * @param  out Receives size() bytes
+		 * @return     Number of bytes written
+		 * @throws     std::runtime_error if OpenSSL fails
+		 */
+		std::size_t final(unsigned char *out);
+		
+		/**
+		 * Finishes the hash into an output iterator.
+		 * 
+		 * @param  first An insert iterator into a container
+		 * @return       Iterator past the last element inserted
+		 */
+		template<typename OutputIt>
+		OutputIt final(OutputIt first)
+		{
+			unsigned char buf[EVP_MAX_MD_SIZE];
+			std::size_t len = this->final(buf);
+			return std::copy(buf, buf + len, first);
+		}
+		
+		/**
+		 * Returns the size of the finished hash, in bytes.
+		 */
+		std::size_t size() const;
+		
+	protected:
+		/// Number of bytes to buffer at a time from non-contiguous ranges
+		static const std::size_t ChunkSize = 256;
+		
+		/// Contiguous ranges are hashed in place
+		template<typename IterT>
+		void updateRange(IterT begin, IterT end, std::true_type)
+		{
+			if (begin != end) {
+				this->update(&*begin, std::distance(begin, end) * sizeof(*begin));
+			}
+		}
+		
+		/// Everything else goes through a buffer
+		template<typename IterT>
+		void updateRange(IterT begin, IterT end, std::false_type)
+		{
+			this->bufferRange(begin, end, typename std::iterator_traits<IterT>::iterator_category());
+		}
+		
+		/// Random access ranges are copied a chunk at a time, which is a
+		/// memmove per block for deques
+		template<typename IterT>
+		void bufferRange(IterT begin, IterT end, std::random_access_iterator_tag)
+		{
+			typedef typename std::iterator_traits<IterT>::value_type T;
+			T buf[ChunkSize / sizeof(T) > 0 ? ChunkSize / sizeof(T) : 1];
+			const std::size_t capacity = sizeof(buf) / sizeof(T);
+			
+			while (begin != end) {
+				std::size_t size = std::min<std::size_t>(end - begin, capacity);
+				std::copy(begin, begin + size, buf);
+				this->update(buf, size * sizeof(T));
+				begin += size;
+			}
+		}
+		
+		/// Anything else is copied an element at a time
+		template<typename IterT>
+		void bufferRange(IterT begin, IterT end, std::input_iterator_tag)
+		{
+			typedef typename std::iterator_traits<IterT>::value_type T;
+			T buf[ChunkSize / sizeof(T) > 0 ? ChunkSize / sizeof(T) : 1];
+			const std::size_t capacity = sizeof(buf) / sizeof(T);
+			
+			std::size_t size = 0;
+			for (; begin != end; ++begin) {
+				buf[size] = *begin;
+				if (++size == capacity) {
+					this->update(buf, size * sizeof(T));
+					size = 0;
+				}
+			}
+			this->update(buf, size * sizeof(T));
+		}
+		
+	private:
+		EVP_MD_CTX *m_ctx;
+		bool m_owned;
+	};
+}
+
+#endif
@@ -0,0 +1,123 @@
+/**
+ * Matcher.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_MATCHER_H
+#define LIBDANE_MATCHER_H
+
+#include "ByteView.h"
+#include "Certificate.h"
+#include "common.h"
+#include <deque>
+#include <vector>
+
+namespace libdane
+{
+	/**
+	 * Verification logic for one combination of usage, selector and matching
+	 * type, resolved at compile time.
+	 * 
+	 * DANERecord and DANERecordSet look these up with matcher_for() when
+	 * records are added, rather than switching on the record's fields for
+	 * every certificate.
+	 * 
+	 * @tparam U Certificate usage
+	 * @tparam S Selector
+	 * @tparam M Matching type
+	 */
+	template<Usage U, Selector S, MatchingType M>
+	struct Matcher
+	{
+		/**
+		 * Returns the certificate data records of this type hold.
+		 */
+		static const std::vector<unsigned char>& digest(const Certificate &cert)
+		{
+			return cert.digest<S, M>();
+		}
+		
+		/**
+		 * Decides the outcome for a certificate without looking at the data,
+		 * if its position in the chain makes that possible.
+		 * 
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  isLeaf      Is it the first certificate in the chain?
+		 * @param  isRoot      Is it the last certificate in the chain?
+		 * @param  result      Receives the outcome, if decided
+		 * @return             Whether the outcome was decided
+		 */
+		static bool decide(bool preverified, bool isLeaf, bool isRoot, bool &result)
+		{
+			// Reject untrusted certificates
+			if ((U == CAConstraints || U == ServiceCertificateConstraint) && !preverified) {
+				result = false;
+				return true;
+			}
+			
+			// Pass everything but the certificate the record applies to; the
+			// rest of the chain is verified link by link
+			bool target = (U == CAConstraints || U == TrustAnchorAssertion) ? isRoot : isLeaf;
+			if (!target) {
+				result = true;
+				return true;
+			}
+			
+			return false;
+		}
+		
+		/**
+		 * Checks a certificate against a record's data.
+		 */
+		static bool match(ByteView data, const Certificate &cert)
+		{
+			return ByteView(digest(cert)) == data;
+		}
+		
+		/**
+		 * Verifies a certificate and chain against a record's data.
+		 * 
+		 * @see DANERecord::verify(bool, const Certificate&, const std::deque<Certificate>&)
+		 */
+		static bool verify(ByteView data, bool preverified, const Certificate &cert, const std::deque<Certificate> &chain)
+		{
+			// Only compare against the end of the chain that matters
+			bool anchor = (U == CAConstraints || U == TrustAnchorAssertion);
+			bool isLeaf = !anchor && cert == chain.front();
+			bool isRoot = anchor && cert == chain.back();
+			
+			bool result;
+			if (decide(preverified, isLeaf, isRoot, result)) {
+				return result;
+			}
+			return match(data, cert);
+		}
+	};
+	
+	/**
+	 * Type-erased functions of a Matcher.
+	 */
+	struct MatcherFunctions
+	{
+		Usage usage;				///< Certificate usage
+		Selector selector;			///< Selector
+		MatchingType matching;		///< Matching type
+		
+		const std::vector<unsigned char>& (*digest)(const Certificate &cert);						///< Matcher::digest()
+		bool (*decide)(bool preverified, bool isLeaf, bool isRoot, bool &result);					///< Matcher::decide()
+		bool (*match)(ByteView data, const Certificate &cert);										///< Matcher::match()
+		bool (*verify)(ByteView data, bool preverified, const Certificate &cert, const std::deque<Certificate> &chain);	///< Matcher::verify()
+	};
+	
+	/**
+	 * Looks up the Matcher for a combination of usage, selector and matching
+	 * type.
+	 * 
+	 * @return The Matcher's functions, or nullptr for invalid combinations
+	 */
+	const MatcherFunctions *matcher_for(Usage usage, Selector selector, MatchingType matching);
+}
+
+#endif
@@ -0,0 +1,45 @@
+/**
+ * PEM.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_PEM_H
+#define LIBDANE_PEM_H
+
+#include <cstddef>
+#include <vector>
+
+namespace libdane
+{
+	/**
+	 * Finds the next PEM block with the given label.
+	 * 
+	 * This scans the input exactly once, without copying anything; the
+	 * block's body is returned as a range into the input.
+	 * 
+	 * @param  begin     Start of the data to search
+	 * @param  end       End of the data to search
+	 * @param  label     Label to look for, eg. "CERTIFICATE"
+	 * @param  bodyBegin Set to the start of the block's base64 body
+	 * @param  bodyEnd   Set to the end of the block's base64 body
+	 * @return           Pointer past the block's END line, or nullptr if no
+	 *                   complete block was found
+	 */
+	const char *pem_find(const char *begin, const char *end, const char *label, const char *&bodyBegin, const char *&bodyEnd);
+	
+	/**
+	 * Decodes base64 data, ignoring any whitespace in it.
+	 * 
+	 * The decoded data is appended to out.
+	 * 
+	 * @param  begin Start of the base64 data
+	 * @param  end   End of the base64 data
+	 * @param  out   Container to append the decoded data to
+	 * @return       false if the data isn't valid base64
+	 */
+	bool base64_decode(const char *begin, const char *end, std::vector<unsigned char> &out);
+}
+
+#endif
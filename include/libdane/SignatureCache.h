@@ -0,0 +1,118 @@
+/**
+ * SignatureCache.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_SIGNATURECACHE_H
+#define LIBDANE_SIGNATURECACHE_H
+
+#include "_internal/lru.h"
+#include <array>
+#include <atomic>
+#include <cstring>
+#include <mutex>
+
+namespace libdane
+{
+	class Certificate;
+	
+	/**
+	 * Cache of successful issuer signature checks.
+	 * 
+	 * Checking a certificate's signature is expensive, and the same few
+	 * intermediates tend to be checked against the same issuers over and over.
+	 * Certificate::verify() consults the shared instance of this class before
+	 * doing the real check, and records every check that passes in it.
+	 * 
+	 * Entries are keyed by the SHA-256 of the issuer's public key, and of the
+	 * whole subject certificate; the latter covers both the signed data and
+	 * the signature itself. Failed checks are never cached.
+	 * 
+	 * All methods are thread safe.
+	 */
+	class SignatureCache
+	{
+	public:
+		/**
+		 * Returns the process-wide instance used by Certificate::verify().
+		 */
+		static SignatureCache &shared();
+		
+		
+		
+		/**
+		 * Constructs a cache.
+		 * 
+		 * @param capacity Maximum number of entries; 0 disables the cache
+		 */
+		SignatureCache(std::size_t capacity = 4096);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~SignatureCache();
+		
+		
+		
+		/**
+		 * Checks if a signature check has passed before.
+		 * 
+		 * This counts as either a hit or a miss.
+		 * 
+		 * @param  subject A certificate
+		 * @param  issuer  The certificate that supposedly issued it
+		 * @return         Whether subject is known to be issued by issuer
+		 */
+		bool contains(const Certificate &subject, const Certificate &issuer);
+		
+		/**
+		 * Records a passed signature check.
+		 * 
+		 * @param subject A certificate
+		 * @param issuer  The certificate that issued it
+		 */
+		void insert(const Certificate &subject, const Certificate &issuer);
+		
+		/**
+		 * Removes all entries, and resets the counters.
+		 */
+		void clear();
+		
+		
+		
+		std::size_t size() const;				///< Number of entries
+		std::size_t capacity() const;			///< Maximum number of entries
+		void setCapacity(std::size_t v);		///< Sets capacity()
+		
+		uint64_t hits() const;					///< Number of lookups that hit
+		uint64_t misses() const;				///< Number of lookups that missed
+		uint64_t evictions() const;				///< Number of evicted entries
+		
+	protected:
+		/// Issuer SPKI digest followed by the subject's digest
+		typedef std::array<unsigned char, 64> Key;
+		
+		/// Hash function for keys; they're digests, so any bytes will do
+		struct KeyHash {
+			std::size_t operator()(const Key &key) const {
+				std::size_t h;
+				std::memcpy(&h, key.data(), sizeof(h));
+				return h;
+			}
+		};
+		
+		/// Builds a key for a pair of certificates
+		static bool makeKey(const Certificate &subject, const Certificate &issuer, Key &key);
+		
+	private:
+		mutable std::mutex m_mutex;
+		internal::LRUCache<Key, bool, KeyHash> m_cache;
+		
+		std::atomic<uint64_t> m_hits;
+		std::atomic<uint64_t> m_misses;
+	};
+}
+
+#endif
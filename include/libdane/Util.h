@@ -10,12 +10,14 @@
 
 #include "VerifyContext.h"
 #include "DANERecord.h"
-#include <sstream>
-#include <iomanip>
+#include "Hasher.h"
 #include <iterator>
 #include <memory>
 #include <algorithm>
 #include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <vector>
 
 namespace libdane
 {
@@ -35,9 +37,92 @@ namespace libdane
 		return false;
 	}
 	
+	namespace internal
+	{
+		/**
+		 * Hex encoding and decoding functions, for a particular instruction set.
+		 */
+		struct HexKernel
+		{
+			/// Name of the instruction set
+			const char *name;
+			
+			/// Encodes size bytes into size * 2 lowercase hex digits
+			void (*encode)(const unsigned char *in, std::size_t size, char *out);
+			
+			/// Decodes size * 2 hex digits into size bytes; false if any of them aren't
+			bool (*decode)(const char *in, std::size_t size, unsigned char *out);
+		};
+		
+		/**
+		 * Returns the fastest kernel the CPU supports.
+		 */
+		const HexKernel &hex_kernel();
+		
+		/**
+		 * Returns every kernel the CPU supports, fastest last.
+		 */
+		std::vector<const HexKernel*> hex_kernels();
+		
+		/**
+		 * Batch hashing function, for a particular digest and instruction set.
+		 */
+		struct HashKernel
+		{
+			/// Name of the instruction set
+			const char *name;
+			
+			/// NID of the digest it implements, or NID_undef for any digest
+			int nid;
+			
+			/// Hashes count buffers into count digests, back to back
+			void (*hash)(const EVP_MD *md, const ByteView *data, std::size_t count, unsigned char *out);
+		};
+		
+		/**
+		 * Returns the fastest batch kernel the CPU supports for a digest.
+		 * 
+		 * On CPUs with the SHA extensions, OpenSSL's single-buffer SHA-256 is
+		 * faster than hashing 8 buffers at a time with AVX2.
+		 */
+		const HashKernel &hash_kernel(const EVP_MD *md);
+		
+		/**
+		 * Returns every batch kernel the CPU supports for a digest; the first
+		 * one just calls hash() for each buffer.
+		 */
+		std::vector<const HashKernel*> hash_kernels(const EVP_MD *md);
+		
+		/// Number of bytes to encode or decode at a time, through a buffer
+		static const std::size_t HexChunkSize = 256;
+		
+		/**
+		 * Copies decoded bytes into an output iterator, cast through T.
+		 * 
+		 * The common case needs no casting, and std::copy turns it into a
+		 * memmove for contiguous containers.
+		 */
+		template<typename T, typename OutputIt>
+		inline OutputIt hex_copy(const unsigned char *begin, const unsigned char *end, OutputIt first)
+		{
+			if (std::is_same<T, unsigned char>::value) {
+				return std::copy(begin, end, first);
+			}
+			
+			for (auto it = begin; it != end; ++it) {
+				*first++ = static_cast<T>(*it);
+			}
+			return first;
+		}
+	}
+	
 	/**
 	 * Converts a sequence into a hexadecimal string.
 	 * 
+	 * Byte-sized values are encoded with SIMD instructions where available;
+	 * wider ones are written out with as many digits as they need, but at
+	 * least two.
+	 * 
 	 * @tparam T     Type to cast values through
 	 * @param  begin Begin iterator
 	 * @param  end   End iterator
@@ -46,12 +131,40 @@ namespace libdane
 	template<typename T = unsigned char, typename IterT>
 	inline std::string to_hex(IterT begin, IterT end)
 	{
-		std::stringstream ss;
-		ss << std::hex << std::setfill('0');
-		for (auto it = begin; it != end; ++it) {
-			ss << std::setw(2) << static_cast<unsigned int>(static_cast<T>(*it));
+		static const char digits[] = "0123456789abcdef";
+		
+		std::string str;
+		if (sizeof(T) != 1) {
+			for (auto it = begin; it != end; ++it) {
+				unsigned long long v = static_cast<typename std::make_unsigned<T>::type>(static_cast<T>(*it));
+				char buf[sizeof(v) * 2];
+				char *p = buf + sizeof(buf);
+				do {
+					*--p = digits[v & 0x0F];
+					v >>= 4;
+				} while (v || buf + sizeof(buf) - p < 2);
+				str.append(p, buf + sizeof(buf));
+			}
+			return str;
+		}
+		
+		// Copy the input through a buffer, since it may not be contiguous
+		const internal::HexKernel &kernel = internal::hex_kernel();
+		unsigned char buf[internal::HexChunkSize];
+		std::size_t remaining = std::distance(begin, end);
+		str.resize(remaining * 2);
+		char *out = &str[0];
+		auto it = begin;
+		while (remaining > 0) {
+			std::size_t size = std::min(remaining, sizeof(buf));
+			for (std::size_t i = 0; i < size; ++i, ++it) {
+				buf[i] = static_cast<unsigned char>(static_cast<T>(*it));
+			}
+			kernel.encode(buf, size, out);
+			out += size * 2;
+			remaining -= size;
 		}
-		return ss.str();
+		return str;
 	}
 	
 	/**
@@ -69,28 +182,86 @@ namespace libdane
 	/**
 	 * Decodes a hexadecimal string.
 	 * 
+	 * Both upper- and lowercase digits are accepted. Decoding is done with
+	 * SIMD instructions where available.
+	 * 
 	 * @tparam T     Type to cast values through
 	 * @param  first An insert iterator into a container
 	 * @param  begin Iterator to the start of the string
 	 * @param  end   Iterator to the end of the string
 	 * @return Iterator past the last element inserted, or first if no elements were inserted
+	 * @throws std::invalid_argument if the string is of odd length, or
+	 *         contains anything but hexadecimal digits
 	 */
 	template<typename T = unsigned char, typename OutputIt, typename StringIt>
 	inline OutputIt from_hex(OutputIt first, StringIt begin, StringIt end)
 	{
+		typedef typename std::iterator_traits<StringIt>::value_type CharT;
+		
+		std::size_t remaining = std::distance(begin, end);
+		if (remaining % 2 != 0) {
+			throw std::invalid_argument("Hex string has an odd length");
+		}
+		
+		const internal::HexKernel &kernel = internal::hex_kernel();
+		char buf[internal::HexChunkSize * 2];
+		unsigned char out[internal::HexChunkSize];
 		auto it = begin;
-		while (it != end) {
-			std::stringstream ss;
-			ss << std::hex << *it++;
-			if (it != end) {
-				ss << std::hex << *it++;
+		while (remaining > 0) {
+			std::size_t size = std::min(remaining, sizeof(buf));
+			if (sizeof(CharT) == 1) {
+				// Plain copy; the kernels already reject anything outside of ASCII
+				std::copy_n(it, size, buf);
+				std::advance(it, size);
 			} else {
-				ss << '0' << *it;
+				// Wider characters must not be truncated into a digit
+				for (std::size_t i = 0; i < size; ++i, ++it) {
+					auto c = static_cast<typename std::make_unsigned<CharT>::type>(*it);
+					buf[i] = c < 0x80 ? static_cast<char>(c) : '\xFF';
+				}
 			}
-			
-			unsigned int tmp;
-			ss >> tmp;
-			*first++ = static_cast<T>(tmp);
+			if (!kernel.decode(buf, size / 2, out)) {
+				throw std::invalid_argument("Hex string contains non-hex characters");
+			}
+			first = internal::hex_copy<T>(out, out + size / 2, first);
+			remaining -= size;
+		}
+		
+		return first;
+	}
+	
+	/**
+	 * Decodes a hexadecimal string.
+	 * 
+	 * This overload decodes contiguous strings straight out of memory,
+	 * rather than copying them through a buffer first.
+	 * 
+	 * @tparam T     Type to cast values through
+	 * @param  first An insert iterator into a container
+	 * @param  begin Pointer to the start of the string
+	 * @param  end   Pointer to the end of the string
+	 * @return Iterator past the last element inserted, or first if no elements were inserted
+	 * @throws std::invalid_argument if the string is of odd length, or
+	 *         contains anything but hexadecimal digits
+	 */
+	template<typename T = unsigned char, typename OutputIt>
+	inline OutputIt from_hex(OutputIt first, const char *begin, const char *end)
+	{
+		std::size_t remaining = end - begin;
+		if (remaining % 2 != 0) {
+			throw std::invalid_argument("Hex string has an odd length");
+		}
+		
+		const internal::HexKernel &kernel = internal::hex_kernel();
+		unsigned char out[internal::HexChunkSize];
+		while (remaining > 0) {
+			std::size_t size = std::min(remaining / 2, sizeof(out));
+			if (!kernel.decode(begin, size, out)) {
+				throw std::invalid_argument("Hex string contains non-hex characters");
+			}
+			first = internal::hex_copy<T>(out, out + size, first);
+			begin += size * 2;
+			remaining -= size * 2;
 		}
 		
 		return first;
@@ -111,8 +282,10 @@ namespace libdane
 	template<typename T = unsigned char, typename ContainerT = std::vector<T>, typename StringIt>
 	inline ContainerT from_hex(StringIt begin, StringIt end)
 	{
+		// Size it up front, rather than growing it one value at a time
 		ContainerT container;
-		from_hex<T>(std::back_inserter(container), begin, end);
+		container.resize(std::distance(begin, end) / 2);
+		from_hex<T>(container.begin(), begin, end);
 		return container;
 	}
 	
@@ -134,6 +307,23 @@ namespace libdane
 		return from_hex<T>(str.begin(), str.end());
 	}
 	
+	/**
+	 * Decodes a hexadecimal string.
+	 * 
+	 * This is a convenience function for decoding a string straight into a
+	 * newly constructed container.
+	 * 
+	 * @tparam T Type to cast values through
+	 * @tparam ContainerT Container type to fill up
+	 * @param str String to decode
+	 * @return A new ContainerT with the decoded data
+	 */
+	template<typename T = unsigned char, typename ContainerT = std::vector<T>>
+	inline ContainerT from_hex(const std::string &str)
+	{
+		return from_hex<T, ContainerT>(str.data(), str.data() + str.size());
+	}
+	
 	/**
 	 * Decodes a hexadecimal string.
 	 * 
@@ -153,14 +343,35 @@ namespace libdane
 			return ContainerT();
 		}
 		
-		return from_hex<T, ContainerT, CharT>(std::basic_string<CharT>(str));
+		return from_hex<T, ContainerT>(str, str + std::char_traits<CharT>::length(str));
 	}
 	
 	/**
 	 * Calculates a hash of the given data.
 	 * 
 	 * This is the most efficient, but possibly least convenient overload to
-	 * use.
+	 * use; it reuses the calling thread's digest context, and doesn't
+	 * allocate anything.
+	 * 
+	 * @param type Type of hash to calculate
+	 * @param first An insert iterator in a container
+	 * @param begin Pointer to the start of the data
+	 * @param end Pointer to the end of the data
+	 */
+	template<typename OutputIt>
+	inline OutputIt hash(const EVP_MD *type, OutputIt first, const unsigned char *begin, const unsigned char *end)
+	{
+		if (type == nullptr) {
+			return std::copy(begin, end, first);
+		}
+		
+		Hasher hasher(type, internal::digest_context());
+		hasher.update(begin, end - begin);
+		return hasher.final<OutputIt>(first);
+	}
+	
+	/**
+	 * Calculates a hash of the given data.
 	 * 
 	 * @param type Type of hash to calculate
 	 * @param first An insert iterator in a container
@@ -174,30 +385,16 @@ namespace libdane
 			return std::copy(begin, end, first);
 		}
 		
-		auto ctx = std::shared_ptr<EVP_MD_CTX>(EVP_MD_CTX_create(), EVP_MD_CTX_destroy);
-		
-		if (!EVP_DigestInit(&*ctx, type)) {
-			throw std::runtime_error("Failed to initialize a hash context");
-		}
-		
-		if (!EVP_DigestUpdate(&*ctx, &*begin, std::distance(begin, end))) {
-			throw std::runtime_error("Failed to feed data to the hash context; out of memory?");
-		}
-		
-		unsigned char buf[EVP_MAX_MD_SIZE];
-		unsigned int len;
-		if (!EVP_DigestFinal(&*ctx, buf, &len)) {
-			throw std::runtime_error("Failed to finalize the hash");
-		}
-		
-		return std::copy(buf, buf + len, first);
+		Hasher hasher(type, internal::digest_context());
+		hasher.update(begin, end);
+		return hasher.final<OutputIt>(first);
 	}
 	
 	/**
 	 * Calculates a hash of the given data.
 	 * 
-	 * This overload allows non-contigious iterators, by copying the data into
-	 * a contigious container before use.
+	 * Contiguous ranges are hashed in place, anything else (eg. a deque) is
+	 * streamed through a small buffer on the stack; see Hasher.
 	 * 
 	 * @param type Type of hash to calculate
 	 * @param first An insert iterator in a container
@@ -207,9 +404,13 @@ namespace libdane
 	template<typename IterT, typename OutputIt>
 	inline OutputIt hash(const EVP_MD *type, OutputIt first, IterT begin, IterT end)
 	{
-		typedef typename IterT::value_type T;
-		std::vector<T> vec(begin, end);
-		return hash<T>(type, first, vec.begin(), vec.end());
+		if (type == nullptr) {
+			return std::copy(begin, end, first);
+		}
+		
+		Hasher hasher(type, internal::digest_context());
+		hasher.update(begin, end);
+		return hasher.final<OutputIt>(first);
 	}
 	
 	/**
@@ -226,6 +427,7 @@ namespace libdane
 	inline std::vector<T> hash(const EVP_MD *type, IterT begin, IterT end)
 	{
 		std::vector<T> vec;
+		vec.reserve(type != nullptr ? EVP_MD_size(type) : std::distance(begin, end));
 		hash(type, std::back_inserter(vec), begin, end);
 		return vec;
 	}
@@ -275,12 +477,27 @@ namespace libdane
 	inline std::vector<T> hash(const EVP_MD *type, const CharT *str)
 	{
 		if (str == nullptr) {
-			str = "";
+			return hash<T>(type, str, str);
 		}
 		
-		return hash<T, CharT>(type, std::basic_string<CharT>(str));
+		return hash<T>(type, str, str + std::char_traits<CharT>::length(str));
 	}
 	
+	/**
+	 * Calculates the hashes of a number of buffers at once.
+	 * 
+	 * SHA-256 and SHA-512 hash several buffers side by side with AVX2, where
+	 * the CPU supports it and it's faster; anything else is hashed one
+	 * buffer at a time, like hash() would.
+	 * 
+	 * @param type  Type of hash to calculate
+	 * @param data  Buffers to hash
+	 * @param count Number of buffers
+	 * @param out   Receives EVP_MD_size(type) bytes per buffer, back to back
+	 * @throws std::invalid_argument if type is nullptr
+	 */
+	void hash_batch(const EVP_MD *type, const ByteView *data, std::size_t count, unsigned char *out);
+	
 	/**
 	 * Returns an EVP_MD from the given matching type.
 	 * 
@@ -332,9 +549,7 @@ namespace libdane
 	template<typename T = unsigned char, typename IterT>
 	inline std::vector<T> match(MatchingType type, IterT begin, IterT end)
 	{
-		std::vector<T> vec;
-		match(type, std::back_inserter(vec), begin, end);
-		return vec;
+		return hash<T>(md_from_matching_type(type), begin, end);
 	}
 	
 	/**
@@ -368,7 +583,11 @@ namespace libdane
 	template<typename T = unsigned char, typename CharT>
 	inline std::vector<T> match(MatchingType type, const CharT *str)
 	{
-		return match<T, CharT>(type, std::basic_string<CharT>(str));
+		if (str == nullptr) {
+			return match<T>(type, str, str);
+		}
+		
+		return match<T>(type, str, str + std::char_traits<CharT>::length(str));
 	}
 }
 
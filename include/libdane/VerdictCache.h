@@ -0,0 +1,188 @@
+/**
+ * VerdictCache.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_VERDICTCACHE_H
+#define LIBDANE_VERDICTCACHE_H
+
+#include "_internal/lru.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <mutex>
+
+namespace libdane
+{
+	class Certificate;
+	
+	/**
+	 * Cache of DANE verification verdicts.
+	 * 
+	 * Connecting to the same host over and over means evaluating the same
+	 * records against the same chain over and over. A DANERecordSet with a
+	 * cache attached looks its verdicts up here first, and records them here
+	 * afterwards, for as long as the records' TTL allows.
+	 * 
+	 * Entries are keyed by a digest of the record set, the fingerprints of
+	 * the certificate and its issuer, and everything else a verdict depends
+	 * on, so a verdict is only ever reused for the exact same inputs.
+	 * 
+	 * All methods are thread safe.
+	 */
+	class VerdictCache
+	{
+	public:
+		/// Identifies a verification; see makeKey()
+		struct Key
+		{
+			std::array<unsigned char, 32> rrset;		///< Digest of the record set
+			std::array<unsigned char, 32> cert;			///< Fingerprint of the certificate
+			std::array<unsigned char, 32> issuer;		///< Fingerprint of its issuer, or zeroes
+			unsigned char flags;						///< Preverified, leaf and root flags
+			
+			bool operator==(const Key &other) const {
+				return flags == other.flags && cert == other.cert && rrset == other.rrset && issuer == other.issuer;
+			}
+			bool operator!=(const Key &other) const { return !(*this == other); }
+		};
+		
+		/// Clock used for expiry
+		typedef std::chrono::steady_clock Clock;
+		
+		/**
+		 * Returns a process-wide instance, for convenience.
+		 */
+		static VerdictCache &shared();
+		
+		/**
+		 * Builds a key for a verification.
+		 * 
+		 * Only the parts of the chain that can affect the verdict are part of
+		 * the key: the certificate, its issuer, and whether it's the leaf or
+		 * the root. Fingerprints are cached on certificates, so this is cheap.
+		 * 
+		 * @param  rrset       Digest of the record set, see DANERecordSet::digest()
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  depth       Position of the certificate in the chain
+		 * @param  chain       Full certificate chain
+		 * @return             A key
+		 */
+		static Key makeKey(const std::array<unsigned char, 32> &rrset, bool preverified, int depth, const std::deque<Certificate> &chain);
+		
+		/**
+		 * Can a verification be cached at all?
+		 * 
+		 * Certificates that can't be encoded have no fingerprint, and would
+		 * all share the same key; verdicts for them must not be cached.
+		 * 
+		 * @param  depth Position of the certificate in the chain
+		 * @param  chain Full certificate chain
+		 * @return       Whether makeKey() gives a key unique to the inputs
+		 */
+		static bool cacheable(int depth, const std::deque<Certificate> &chain);
+		
+		
+		
+		/**
+		 * Constructs a cache.
+		 * 
+		 * @param capacity Maximum number of entries; 0 disables the cache
+		 * @param maxTTL   Maximum time to keep an entry, in seconds
+		 */
+		VerdictCache(std::size_t capacity = 4096, std::uint32_t maxTTL = 3600);
+		
+		/**
+		 * Destructor.
+		 */
+		virtual ~VerdictCache();
+		
+		
+		
+		/**
+		 * Looks up a verdict.
+		 * 
+		 * This counts as either a hit or a miss; expired entries are removed,
+		 * and count as misses.
+		 * 
+		 * @param  key     Key to look up
+		 * @param  verdict Receives the verdict, if found
+		 * @return         Whether a verdict was found
+		 */
+		bool lookup(const Key &key, bool &verdict);
+		
+		/**
+		 * Records a verdict.
+		 * 
+		 * @param key     Key to record it under
+		 * @param verdict The verdict
+		 * @param ttl     Seconds to keep it for, capped to maxTTL(); should be
+		 *                the TTL of the records it was reached with
+		 */
+		void insert(const Key &key, bool verdict, std::uint32_t ttl);
+		
+		/**
+		 * Removes all entries, and resets the counters.
+		 */
+		void clear();
+		
+		
+		
+		std::size_t size() const;				///< Number of entries
+		std::size_t capacity() const;			///< Maximum number of entries
+		void setCapacity(std::size_t v);		///< Sets capacity()
+		
+		std::uint32_t maxTTL() const;			///< Maximum TTL, in seconds
+		void setMaxTTL(std::uint32_t v);		///< Sets maxTTL()
+		
+		uint64_t hits() const;					///< Number of lookups that hit
+		uint64_t misses() const;				///< Number of lookups that missed
+		uint64_t expirations() const;			///< Number of entries found expired
+		uint64_t evictions() const;				///< Number of evicted entries
+		
+		/**
+		 * Returns the ratio of lookups that hit, from 0 to 1.
+		 */
+		double hitRatio() const;
+		
+	protected:
+		/**
+		 * Returns the current time; overridable for testing.
+		 */
+		virtual Clock::time_point now() const;
+		
+		/// A cached verdict
+		struct Entry
+		{
+			bool verdict;
+			Clock::time_point expires;
+		};
+		
+		/// Hash function for keys; they're made of digests, so any bytes will do
+		struct KeyHash {
+			std::size_t operator()(const Key &key) const {
+				std::size_t rrset, cert, issuer;
+				std::memcpy(&rrset, key.rrset.data(), sizeof(rrset));
+				std::memcpy(&cert, key.cert.data(), sizeof(cert));
+				std::memcpy(&issuer, key.issuer.data(), sizeof(issuer));
+				return rrset ^ cert ^ (issuer * 31) ^ key.flags;
+			}
+		};
+		
+	private:
+		mutable std::mutex m_mutex;
+		internal::LRUCache<Key, Entry, KeyHash> m_cache;
+		std::atomic<std::uint32_t> m_maxTTL;
+		
+		std::atomic<uint64_t> m_hits;
+		std::atomic<uint64_t> m_misses;
+		std::atomic<uint64_t> m_expirations;
+	};
+}
+
+#endif
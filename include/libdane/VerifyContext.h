@@ -10,6 +10,7 @@
 
 #include "_internal/openssl.h"
 #include "Certificate.h"
+#include "CertificatePool.h"
 #include <deque>
 
 namespace libdane
@@ -19,10 +20,8 @@ namespace libdane
 	 * 
 	 * Note that this class does not store any data itself - everything is
 	 * stored as additional data on the context itself, with the exception of
-	 * the certificate chain, which is retained and cached to prevent weirdness
-	 * with the reference count of the certificates.
-	 * 
-	 * \todo Make Certificate retain native representations instead.
+	 * the certificate chain, which is cached to avoid rebuilding it on every
+	 * call to chain().
 	 */
 	class VerifyContext
 	{
@@ -30,9 +29,10 @@ namespace libdane
 		/**
 		 * Constructor.
 		 * 
-		 * @param ctx Underlying context
+		 * @param ctx  Underlying context
+		 * @param pool A pool to intern the chain's certificates in, if any
 		 */
-		VerifyContext(X509_STORE_CTX *ctx = nullptr);
+		VerifyContext(X509_STORE_CTX *ctx = nullptr, CertificatePool *pool = nullptr);
 		
 		/**
 		 * Copy constructor.
@@ -52,13 +52,34 @@ namespace libdane
 		/**
 		 * Returns the chain of certificates in the store.
 		 */
-		std::deque<Certificate> chain() const;
+		const std::deque<Certificate>& chain() const;
 		
 		/**
 		 * Returns the currently operating certificate.
 		 */
 		Certificate currentCert() const;
 		
+		/**
+		 * Returns the currently operating certificate's position in chain().
+		 * 
+		 * @return An index into chain(), or -1 if it's not in it
+		 */
+		int depth() const;
+		
+		/**
+		 * Checks that a certificate in chain() was issued by the next one up.
+		 * 
+		 * OpenSSL checks every link itself before calling back about it, so
+		 * if it's the one being called back about, it's preverified, and no
+		 * error has been overridden along the way, there's no need to check
+		 * it again. Any other link is checked. The root has no link.
+		 * 
+		 * @param  preverified Is the certificate trusted by the system?
+		 * @param  depth       Position of the certificate in chain()
+		 * @return             Whether the link is valid
+		 */
+		bool verifyIssuer(bool preverified, int depth) const;
+		
 		/**
 		 * A context is truthy if it has a valid underlying context.
 		 */
@@ -67,7 +88,6 @@ namespace libdane
 	private:
 		X509_STORE_CTX *m_ctx = nullptr;
 		
-		STACK_OF(X509) *m_chain_stack = nullptr;
 		std::deque<Certificate> m_chain;
 	};
 }
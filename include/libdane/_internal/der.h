@@ -0,0 +1,69 @@
+/**
+ * internal/der.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_INTERNAL_DER_H
+#define LIBDANE_INTERNAL_DER_H
+
+#include <cstddef>
+
+namespace libdane
+{
+	namespace internal
+	{
+		/**
+		 * Parses the header of a DER element.
+		 * 
+		 * Only single-byte tags and definite lengths are supported, which is
+		 * all DER allows for anything found in a certificate.
+		 * 
+		 * @param  p      Pointer to the element
+		 * @param  size   Number of bytes available
+		 * @param  header Set to the size of the tag and length
+		 * @param  length Set to the size of the contents
+		 * @return        false if the header is malformed or truncated
+		 */
+		inline bool der_header(const unsigned char *p, std::size_t size, std::size_t &header, std::size_t &length)
+		{
+			if (size < 2 || (p[0] & 0x1F) == 0x1F) {
+				return false;
+			}
+			
+			header = 2;
+			length = p[1];
+			if (length & 0x80) {
+				std::size_t num = length & 0x7F;
+				if (num == 0 || num > sizeof(std::size_t) || size < 2 + num) {
+					return false;
+				}
+				
+				length = 0;
+				for (std::size_t i = 0; i < num; ++i) {
+					length = (length << 8) | p[2 + i];
+				}
+				header += num;
+			}
+			
+			return length <= size - header;
+		}
+		
+		/**
+		 * Returns the total size of the DER element at the start of a buffer.
+		 * 
+		 * @return The size of the header and contents, or 0 if malformed
+		 */
+		inline std::size_t der_element_size(const unsigned char *p, std::size_t size)
+		{
+			std::size_t header, length;
+			if (!der_header(p, size, header, length)) {
+				return 0;
+			}
+			return header + length;
+		}
+	}
+}
+
+#endif
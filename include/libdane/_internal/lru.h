@@ -0,0 +1,125 @@
+/**
+ * internal/lru.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_INTERNAL_LRU_H
+#define LIBDANE_INTERNAL_LRU_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <utility>
+
+namespace libdane
+{
+	namespace internal
+	{
+		/**
+		 * A map with a size cap, which evicts the least recently used entry.
+		 * 
+		 * This is not thread safe; users are expected to lock around it.
+		 */
+		template<typename K, typename V, typename Hash = std::hash<K>>
+		class LRUCache
+		{
+		public:
+			/**
+			 * Constructs a cache.
+			 * 
+			 * @param capacity Maximum number of entries; 0 disables the cache
+			 */
+			LRUCache(std::size_t capacity):
+				m_capacity(capacity), m_evictions(0) {}
+			
+			/**
+			 * Looks up an entry, and marks it as recently used.
+			 * 
+			 * @return A pointer to the value, or nullptr if there's none; it's
+			 *         valid until the next modification of the cache
+			 */
+			V *get(const K &key)
+			{
+				auto it = m_map.find(key);
+				if (it == m_map.end()) {
+					return nullptr;
+				}
+				
+				m_list.splice(m_list.begin(), m_list, it->second);
+				return &it->second->second;
+			}
+			
+			/**
+			 * Inserts or replaces an entry, evicting old ones if needed.
+			 */
+			void put(const K &key, V value)
+			{
+				if (m_capacity == 0) {
+					return;
+				}
+				
+				auto it = m_map.find(key);
+				if (it != m_map.end()) {
+					it->second->second = std::move(value);
+					m_list.splice(m_list.begin(), m_list, it->second);
+					return;
+				}
+				
+				m_list.emplace_front(key, std::move(value));
+				m_map.emplace(key, m_list.begin());
+				this->trim();
+			}
+			
+			/**
+			 * Removes an entry.
+			 */
+			void erase(const K &key)
+			{
+				auto it = m_map.find(key);
+				if (it != m_map.end()) {
+					m_list.erase(it->second);
+					m_map.erase(it);
+				}
+			}
+			
+			/**
+			 * Removes all entries.
+			 */
+			void clear()
+			{
+				m_map.clear();
+				m_list.clear();
+			}
+			
+			std::size_t size() const { return m_map.size(); }					///< Number of entries
+			std::size_t capacity() const { return m_capacity; }				///< Maximum number of entries
+			void setCapacity(std::size_t v) { m_capacity = v; this->trim(); }	///< Sets capacity()
+			uint64_t evictions() const { return m_evictions; }					///< Number of evicted entries
+			
+		protected:
+			/// Evicts entries until the size is within the capacity
+			void trim()
+			{
+				while (m_map.size() > m_capacity) {
+					m_map.erase(m_list.back().first);
+					m_list.pop_back();
+					++m_evictions;
+				}
+			}
+			
+		private:
+			typedef std::list<std::pair<K, V>> List;
+			
+			std::size_t m_capacity;
+			uint64_t m_evictions;
+			List m_list;
+			std::unordered_map<K, typename List::iterator, Hash> m_map;
+		};
+	}
+}
+
+#endif
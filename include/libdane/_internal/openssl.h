@@ -24,6 +24,28 @@
 #include <openssl/err.h>
 #include <openssl/x509v3.h>
 
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+/**
+ * Increments the reference count of an X509 object.
+ * 
+ * This is a shim for OpenSSL < 1.1.0, which lacks this function.
+ */
+inline int X509_up_ref(X509 *x509)
+{
+	return CRYPTO_add(&x509->references, 1, CRYPTO_LOCK_X509) > 1;
+}
+
+/**
+ * Returns the chain built by a verification context, without a reference.
+ * 
+ * This is a shim for OpenSSL < 1.1.0, which calls it something else.
+ */
+inline STACK_OF(X509) *X509_STORE_CTX_get0_chain(X509_STORE_CTX *ctx)
+{
+	return X509_STORE_CTX_get_chain(ctx);
+}
+#endif
+
 #ifndef LIBDANE_NO_INIT_OPENSSL
 namespace libdane
 {
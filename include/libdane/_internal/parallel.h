@@ -0,0 +1,266 @@
+/**
+ * internal/parallel.h
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_INTERNAL_PARALLEL_H
+#define LIBDANE_INTERNAL_PARALLEL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <algorithm>
+
+namespace libdane
+{
+	namespace internal
+	{
+		/**
+		 * Returns the number of threads to use for a requested thread count.
+		 * 
+		 * @param  threads Requested number of threads, or 0 for one per core
+		 * @return         A number of threads, at least 1
+		 */
+		inline unsigned int thread_count(unsigned int threads)
+		{
+			if (threads == 0) {
+				threads = std::thread::hardware_concurrency();
+			}
+			return std::max(threads, 1u);
+		}
+		
+		/**
+		 * A pool of long-lived worker threads.
+		 * 
+		 * Workers are started the first time they're needed, and then kept
+		 * around, blocked on a condition variable, for the next run(); a
+		 * nightly batch of a few hundred thousand jobs shouldn't pay for
+		 * thread creation on every call.
+		 * 
+		 * Any number of threads may call run() at once; their tasks are
+		 * queued, and each caller works through its own tasks as well, so a
+		 * run() always finishes even if every worker is busy elsewhere.
+		 */
+		class WorkerPool
+		{
+		public:
+			/**
+			 * Returns a process-wide instance.
+			 */
+			static WorkerPool &shared()
+			{
+				static WorkerPool pool;
+				return pool;
+			}
+			
+			WorkerPool(): m_stopping(false) { }
+			
+			WorkerPool(const WorkerPool&) = delete;
+			WorkerPool &operator=(const WorkerPool&) = delete;
+			
+			/**
+			 * Destructor; waits for the workers to exit.
+			 */
+			~WorkerPool()
+			{
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					m_stopping = true;
+				}
+				m_wake.notify_all();
+				for (auto &worker : m_workers) {
+					worker.join();
+				}
+			}
+			
+			/**
+			 * Runs task(0) to task(count - 1), and waits for them to finish.
+			 * 
+			 * Tasks run on up to count - 1 workers and the calling thread. If
+			 * any of them throw, the first exception is rethrown here, once
+			 * all of them are done.
+			 * 
+			 * @param count Number of tasks
+			 * @param task  Function to invoke with each task's index
+			 */
+			void run(unsigned int count, const std::function<void(unsigned int)> &task)
+			{
+				if (count == 0) {
+					return;
+				}
+				
+				Job job(task, count);
+				{
+					std::lock_guard<std::mutex> lock(m_mutex);
+					while (m_workers.size() < count - 1) {
+						m_workers.emplace_back(&WorkerPool::work, this);
+					}
+					m_jobs.push_back(&job);
+				}
+				m_wake.notify_all();
+				
+				std::unique_lock<std::mutex> lock(m_mutex);
+				while (job.next < job.count) {
+					this->runNext(job, lock);
+				}
+				job.finished.wait(lock, [&]() { return job.done == job.count; });
+				
+				if (job.error) {
+					std::rethrow_exception(job.error);
+				}
+			}
+			
+			/**
+			 * Returns the number of worker threads started so far.
+			 */
+			std::size_t size()
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				return m_workers.size();
+			}
+			
+		private:
+			/// A call to run(); lives on the caller's stack
+			struct Job
+			{
+				Job(const std::function<void(unsigned int)> &task, unsigned int count):
+					task(task), count(count), next(0), done(0) { }
+				
+				const std::function<void(unsigned int)> &task;
+				unsigned int count;
+				unsigned int next;				///< Next task to hand out
+				unsigned int done;				///< Tasks finished
+				std::exception_ptr error;		///< First exception thrown
+				std::condition_variable finished;
+			};
+			
+			/// Runs a job's next task; the lock is released while it runs
+			void runNext(Job &job, std::unique_lock<std::mutex> &lock)
+			{
+				unsigned int index = job.next++;
+				if (job.next == job.count) {
+					m_jobs.erase(std::find(m_jobs.begin(), m_jobs.end(), &job));
+				}
+				
+				lock.unlock();
+				std::exception_ptr error;
+				try {
+					job.task(index);
+				} catch (...) {
+					error = std::current_exception();
+				}
+				lock.lock();
+				
+				if (error && !job.error) {
+					job.error = error;
+				}
+				
+				// The caller can't return before this, since it needs the lock
+				if (++job.done == job.count) {
+					job.finished.notify_all();
+				}
+			}
+			
+			void work()
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				for (;;) {
+					m_wake.wait(lock, [&]() { return m_stopping || !m_jobs.empty(); });
+					if (m_stopping) {
+						return;
+					}
+					this->runNext(*m_jobs.front(), lock);
+				}
+			}
+			
+			std::mutex m_mutex;
+			std::condition_variable m_wake;
+			std::deque<Job*> m_jobs;
+			std::vector<std::thread> m_workers;
+			bool m_stopping;
+		};
+		
+		/**
+		 * Runs fn over [0, count), using up to the given number of threads.
+		 * 
+		 * Each thread is given a contiguous share of the range, and works
+		 * through it in small batches. Once its own share runs out, it steals
+		 * batches from the other threads' shares, so a few slow items don't
+		 * leave the other threads idle.
+		 * 
+		 * fn may be invoked any number of times, from any of the threads. The
+		 * calling thread does its share of the work itself; the others come
+		 * from WorkerPool::shared(). If fn throws, the remaining batches are
+		 * skipped, and the first exception is rethrown on the calling thread.
+		 * 
+		 * @param count   Number of items
+		 * @param threads Number of threads, or 0 for one per core
+		 * @param fn      Function to invoke with each [begin, end) batch
+		 * @param grain   Items per batch, or 0 to pick one automatically
+		 */
+		inline void parallel_for(std::size_t count, unsigned int threads, std::function<void(std::size_t begin, std::size_t end)> fn, std::size_t grain = 0)
+		{
+			threads = static_cast<unsigned int>(std::min<std::size_t>(thread_count(threads), count));
+			if (threads <= 1) {
+				if (count) {
+					fn(0, count);
+				}
+				return;
+			}
+			
+			// Aim for a few dozen batches per thread, to have something to steal
+			if (grain == 0) {
+				grain = std::max<std::size_t>(count / (threads * 32), 1);
+			}
+			
+			// Padded to keep each share's cursor on its own cache line
+			struct Share
+			{
+				std::atomic<std::size_t> next;
+				std::size_t end;
+				char padding[64 - sizeof(std::atomic<std::size_t>) - sizeof(std::size_t)];
+			};
+			std::unique_ptr<Share[]> shares(new Share[threads]);
+			
+			std::size_t per_thread = count / threads;
+			std::size_t remainder = count % threads;
+			std::size_t begin = 0;
+			for (unsigned int i = 0; i < threads; ++i) {
+				shares[i].next = begin;
+				shares[i].end = begin + per_thread + (i < remainder ? 1 : 0);
+				begin = shares[i].end;
+			}
+			
+			std::atomic<bool> failed(false);
+			WorkerPool::shared().run(threads, [&](unsigned int self) {
+				for (unsigned int k = 0; k < threads; ++k) {
+					Share &share = shares[(self + k) % threads];
+					while (!failed.load(std::memory_order_relaxed)) {
+						std::size_t b = share.next.fetch_add(grain);
+						if (b >= share.end) {
+							break;
+						}
+						
+						try {
+							fn(b, std::min(b + grain, share.end));
+						} catch (...) {
+							failed = true;
+							throw;
+						}
+					}
+				}
+			});
+		}
+	}
+}
+
+#endif
@@ -8,8 +8,19 @@
 #ifndef LIBDANE_H
 #define LIBDANE_H
 
+#include "BatchVerifier.h"
+#include "ByteView.h"
 #include "Certificate.h"
+#include "CertificateLoader.h"
+#include "CertificatePool.h"
+#include "PEM.h"
+#include "SignatureCache.h"
 #include "DANERecord.h"
+#include "DANERecordSet.h"
+#include "HandshakeVerifier.h"
+#include "Hasher.h"
+#include "Matcher.h"
+#include "VerdictCache.h"
 #include "VerifyContext.h"
 #include "Util.h"
 
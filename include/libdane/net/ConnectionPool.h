@@ -0,0 +1,148 @@
+/**
+ * ConnectionPool.h
+ * libdane_net
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_NET_CONNECTIONPOOL_H
+#define LIBDANE_NET_CONNECTIONPOOL_H
+
+#include <asio.hpp>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace libdane
+{
+	namespace net
+	{
+		/**
+		 * Keeps idle TCP connections to nameservers open for reuse.
+		 * 
+		 * Opening a connection costs a round trip before a query can even be
+		 * sent; a resolver doing a lot of lookups instead returns connections
+		 * here when it's done with them, and takes them back out for the
+		 * next batch (RFC 7766, section 6.2.1).
+		 * 
+		 * While a connection is idle, the pool waits for it to become
+		 * readable; a nameserver doesn't send anything unprompted, so that
+		 * means it was closed from the other end, and it's dropped. A server
+		 * can still close a connection just as it's taken out, so callers
+		 * should be ready to retry on a new one.
+		 * 
+		 * All methods are thread safe, and the pool's own handlers may run on
+		 * any thread running the service. A connection that's been taken out
+		 * belongs to the caller; the pool doesn't touch it until it's put back.
+		 */
+		class ConnectionPool
+		{
+		public:
+			typedef std::shared_ptr<asio::ip::tcp::socket> Socket;
+			
+			/**
+			 * Constructs an empty pool.
+			 */
+			ConnectionPool(asio::io_service &service);
+			
+			/**
+			 * Destructor; closes all idle connections.
+			 */
+			virtual ~ConnectionPool();
+			
+			ConnectionPool(const ConnectionPool&) = delete;
+			ConnectionPool &operator=(const ConnectionPool&) = delete;
+			
+			
+			
+			std::size_t maxIdle() const;					///< Max idle connections per nameserver
+			void setMaxIdle(std::size_t v);					///< Sets the max; 0 disables pooling
+			
+			std::chrono::milliseconds idleTimeout() const;	///< How long connections may stay idle
+			void setIdleTimeout(std::chrono::milliseconds v);	///< Sets the idle timeout
+			
+			bool keepAlive() const;							///< Enable TCP keepalive on pooled connections?
+			void setKeepAlive(bool v);						///< Sets whether to enable keepalive
+			
+			
+			
+			/**
+			 * Takes an idle connection out of the pool.
+			 * 
+			 * Nameservers are tried in order; the most recently used
+			 * connection to the first one with any is returned.
+			 * 
+			 * @param  endpoints Nameservers to accept a connection to
+			 * @return           A connected socket, or nullptr if none is idle
+			 */
+			Socket take(const std::vector<asio::ip::tcp::endpoint> &endpoints);
+			
+			/**
+			 * Returns a connection to the pool.
+			 * 
+			 * It must be connected, and have no queries in flight. If the
+			 * nameserver already has the maximum number of idle connections,
+			 * it's closed instead.
+			 * 
+			 * @param sock Socket to return
+			 * @return     Whether it was pooled
+			 */
+			bool put(Socket sock);
+			
+			/**
+			 * Closes all idle connections.
+			 */
+			void clear();
+			
+			/**
+			 * Returns the number of idle connections.
+			 */
+			std::size_t idle() const;
+			
+		protected:
+			/**
+			 * An idle connection.
+			 */
+			struct Entry
+			{
+				Entry(asio::io_service &service, Socket sock);
+				
+				/// The connection
+				Socket sock;
+				
+				/// Timer for the idle timeout
+				asio::steady_timer timer;
+				
+				/// Receives anything the server sends while idle
+				unsigned char probe;
+				
+				/// Is the entry still in the pool? Only cleared under m_mutex,
+				/// and once it is, the entry's handlers don't touch the pool
+				std::atomic<bool> pooled;
+			};
+			
+			/**
+			 * Drops an idle connection, and closes it.
+			 * 
+			 * The caller must hold m_mutex.
+			 */
+			void drop(std::shared_ptr<Entry> entry);
+			
+			asio::io_service &m_service;
+			
+			/// Guards everything below
+			mutable std::mutex m_mutex;
+			std::map<asio::ip::tcp::endpoint, std::deque<std::shared_ptr<Entry>>> m_entries;
+			
+			std::size_t m_maxIdle;
+			std::chrono::milliseconds m_idleTimeout;
+			bool m_keepAlive;
+		};
+	}
+}
+
+#endif
@@ -11,10 +11,13 @@
 #include "_internal/ldns.h"
 #include "../_internal/openssl.h"
 #include "common.h"
+#include "ConnectionPool.h"
 #include "ResolverConfig.h"
 #include <asio.hpp>
 #include <deque>
+#include <map>
 #include <memory>
+#include <mutex>
 
 namespace libdane
 {
@@ -83,15 +86,23 @@ namespace libdane
 			 */
 			void setConfig(const ResolverConfig& v);
 			
+			/**
+			 * Returns the pool of idle TCP connections.
+			 */
+			ConnectionPool& pool();
+			
 			
 			
 			/**
 			 * Decodes a packet into a list of records.
+			 * 
+			 * Records that can never match anything, and malformed records,
+			 * are left out; see DANERecord::usable().
 			 */
 			std::vector<DANERecord> decodeTLSA(std::shared_ptr<ldns_pkt> pkt);
 			
 			/**
-			 * Constructs a query packet.
+			 * Constructs a query packet, with a random ID.
 			 * 
 			 * @param  domain Domain to query
 			 * @param  rr_type  Record type to query for (eg. LDNS_RR_TYPE_A)
@@ -135,6 +146,11 @@ namespace libdane
 			/**
 			 * Sends a batch of DNS query packets.
 			 * 
+			 * Queries go out over UDP, all at once, unless the config forces
+			 * TCP; any that come back truncated, malformed or too large for
+			 * the configured EDNS0 buffer size, or that no nameserver answers
+			 * in time, are retried over a single TCP connection.
+			 * 
 			 * @param pkts     Packets to send
 			 * @param callback Callback for the results
 			 */
@@ -208,22 +224,59 @@ namespace libdane
 				std::vector<std::shared_ptr<ldns_pkt>> pkts;
 				/// Iterator to the current packet
 				std::vector<std::shared_ptr<ldns_pkt>>::iterator it;
+				
+				/// Positions of packets to retry over TCP
+				std::vector<std::size_t> retries;
+				/// UDP queries still waiting for a response
+				std::size_t pending = 0;
+				/// Why a UDP query got no response from any nameserver, if one didn't
+				asio::error_code error;
+				/// Guards retries, pending, error and chain; responses arrive concurrently
+				std::mutex mutex;
+				
+				/// Has each packet been answered?
+				std::vector<bool> answered;
+				/// Positions of the packets in flight, by query ID
+				std::map<uint16_t, std::size_t> inflight;
+				/// Header and question of each packet, to match responses against
+				std::vector<std::vector<unsigned char>> questions;
+				/// Queries being written
+				std::vector<unsigned char> queries;
+				/// Number of the sendQueryChain() call in progress
+				unsigned int chain = 0;
+				/// Deadline for the sendQueryChain() call in progress
+				std::shared_ptr<asio::steady_timer> deadline;
 			};
 			
 			/**
 			 * Creates a connection to a configured DNS server.
 			 * 
+			 * If no connection is up within the configured timeout, the
+			 * callback gets asio::error::timed_out.
+			 * 
 			 * @param conf Resolver configuration to use
 			 * @param cb   Callback that receives a socket
 			 */
 			virtual void connect(const ResolverConfig &conf, std::function<void(const asio::error_code &err, std::shared_ptr<asio::ip::tcp::socket>)> cb) const;
 			
 			/**
-			 * Recursively sends the queries described by a context.
+			 * Sends the queries described by a context through an open socket.
+			 * 
+			 * Every packet not yet answered is given a random ID that's unique
+			 * within the batch, and written back to back, without waiting for
+			 * responses (RFC 7766, section 6.2.1.1). Responses are matched
+			 * up by ID and question as they arrive, in whatever order; once
+			 * every packet has been answered, they replace the queries in
+			 * ctx->pkts.
 			 * 
-			 * This will wire-encode the packet described by ctx->it, replace
-			 * it with the result, advance ctx->it and call itself again until
-			 * ctx->it == ctx->pkts.end().
+			 * If the connection fails partway, ctx->answered tells which
+			 * responses came through, and calling this again on a new
+			 * connection sends the rest.
+			 * 
+			 * If the responses don't all arrive within the configured timeout,
+			 * or one of them can't be decoded, the socket is closed, and the
+			 * callback gets asio::error::timed_out or
+			 * asio::error::invalid_argument respectively.
 			 * 
 			 * @param sock Socket
 			 * @param ctx  Context descriptor
@@ -232,9 +285,111 @@ namespace libdane
 			virtual void sendQueryChain(std::shared_ptr<asio::ip::tcp::socket> sock, std::shared_ptr<ConnectionContext> ctx, MultiQueryCallback cb);
 			
 			/**
-			 * Sends a query buffer through an open socket.
+			 * Writes a buffer of length-prefixed queries to an open socket.
+			 */
+			virtual void sendQueries(std::shared_ptr<asio::ip::tcp::socket> sock, const std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb);
+			
+			/**
+			 * Reads a single length-prefixed response from an open socket.
+			 * 
+			 * @param sock   Socket
+			 * @param buffer Receives the response, without its length prefix
+			 * @param cb     Callback when finished
 			 */
-			virtual void sendQuery(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb);
+			virtual void receiveResponse(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb);
+			
+			/**
+			 * Receives responses for a context until none are in flight.
+			 * 
+			 * @param sock  Socket
+			 * @param ctx   Context descriptor
+			 * @param chain Number of the sendQueryChain() call receiving
+			 * @param cb    Callback when finished
+			 */
+			void receiveResponses(std::shared_ptr<asio::ip::tcp::socket> sock, std::shared_ptr<ConnectionContext> ctx, unsigned int chain, MultiQueryCallback cb);
+			
+			/**
+			 * Ends a sendQueryChain() call, unless something else already has.
+			 * 
+			 * Its remaining handlers see that it's over, and leave the context
+			 * alone. The caller must hold ctx->mutex.
+			 * 
+			 * @param sock   Socket
+			 * @param ctx    Context descriptor
+			 * @param chain  Number of the call to end
+			 * @param failed Close the socket, so it isn't pooled
+			 * @return Whether the call was still in progress
+			 */
+			bool endQueryChain(std::shared_ptr<asio::ip::tcp::socket> sock, std::shared_ptr<ConnectionContext> ctx, unsigned int chain, bool failed);
+			
+			/**
+			 * Sends the queries described by a context over TCP.
+			 * 
+			 * An idle connection from the pool is used if there is one, and
+			 * returned to it afterwards; if the server closed it in the
+			 * meantime, the remaining queries are sent over a new one.
+			 * 
+			 * @param ctx Context descriptor
+			 * @param cb  Callback when finished
+			 */
+			virtual void queryTCP(std::shared_ptr<ConnectionContext> ctx, MultiQueryCallback cb);
+			
+			/**
+			 * Opens a UDP socket to a DNS server.
+			 * 
+			 * There's no handshake; this only fails if there's no route to
+			 * the server (eg. an IPv6 one on an IPv4-only host).
+			 * 
+			 * @param endpoint Nameserver to connect to
+			 * @param cb       Callback that receives a socket
+			 */
+			virtual void connectUDP(const asio::ip::udp::endpoint &endpoint, std::function<void(const asio::error_code &err, std::shared_ptr<asio::ip::udp::socket>)> cb) const;
+			
+			/**
+			 * Sends one of the queries described by a context over UDP.
+			 * 
+			 * Every query gets a socket of its own, so a whole batch can be in
+			 * flight at once. If a nameserver doesn't answer in time, the next
+			 * one is tried; if none do, the batch fails. Queries that get a
+			 * truncated, malformed or oversized response are retried over TCP
+			 * once every query in the batch is done.
+			 * 
+			 * @param ctx   Context descriptor
+			 * @param index Position of the packet in ctx->pkts
+			 * @param ns    Position of the nameserver to try in the config
+			 * @param cb    Callback when every query is done
+			 */
+			virtual void queryUDP(std::shared_ptr<ConnectionContext> ctx, std::size_t index, std::size_t ns, MultiQueryCallback cb);
+			
+			/**
+			 * Marks one of a context's UDP queries as done.
+			 * 
+			 * Once they all are, any that need it are retried over TCP, and
+			 * the callback is called with the results; if any query got no
+			 * response at all, it gets the first such error instead.
+			 * 
+			 * @param ctx   Context descriptor
+			 * @param index Position of the packet in ctx->pkts
+			 * @param err   Why no nameserver responded, if none did
+			 * @param retry Does it need to be retried over TCP?
+			 * @param cb    Callback when every query is done
+			 */
+			void finishUDPQuery(std::shared_ptr<ConnectionContext> ctx, std::size_t index, const asio::error_code &err, bool retry, MultiQueryCallback cb);
+			
+			/**
+			 * Sends a query datagram, and receives the response in its place.
+			 * 
+			 * Datagrams that don't carry the query's ID and question are
+			 * ignored. Fails with asio::error::message_size if the response
+			 * is larger than the configured EDNS0 buffer size, and
+			 * asio::error::timed_out if none arrives in time.
+			 */
+			virtual void sendUDPQuery(std::shared_ptr<asio::ip::udp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb);
+			
+			/**
+			 * Calls a multi-query callback with a context's responses.
+			 */
+			void finishQueries(std::shared_ptr<ConnectionContext> ctx, MultiQueryCallback cb);
 			
 		protected:
 			/**
@@ -246,6 +401,11 @@ namespace libdane
 			 * Current configuration.
 			 */
 			ResolverConfig m_config;
+			
+			/**
+			 * Idle TCP connections.
+			 */
+			ConnectionPool m_pool;
 		};
 	}
 }
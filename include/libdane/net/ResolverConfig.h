@@ -9,6 +9,8 @@
 #define LIBDANE_NET_RESOLVERCONFIG_H
 
 #include <asio.hpp>
+#include <chrono>
+#include <cstdint>
 #include <vector>
 
 namespace libdane
@@ -71,6 +73,53 @@ namespace libdane
 			  */
 			 std::vector<asio::ip::tcp::endpoint> endpoints() const;
 			
+			 /**
+			  * Returns a list of UDP endpoints for the nameservers.
+			  */
+			 std::vector<asio::ip::udp::endpoint> udpEndpoints() const;
+			
+			
+			
+			unsigned short port() const;					///< Port nameservers listen on
+			void setPort(unsigned short v);					///< Sets the port
+			
+			/**
+			 * Returns the EDNS0 UDP payload size advertised in queries.
+			 * 
+			 * The default of 1232 bytes fits in a single packet on any IPv6
+			 * path, so responses aren't fragmented; anything larger comes back
+			 * truncated, and is retried over TCP.
+			 */
+			uint16_t ednsBufferSize() const;
+			
+			/**
+			 * Sets the EDNS0 UDP payload size.
+			 */
+			void setEdnsBufferSize(uint16_t v);
+			
+			/**
+			 * Returns how long to wait for a UDP response before retrying a
+			 * query over TCP.
+			 */
+			std::chrono::milliseconds timeout() const;
+			
+			/**
+			 * Sets the UDP response timeout.
+			 */
+			void setTimeout(std::chrono::milliseconds v);
+			
+			/**
+			 * Should queries skip UDP, and always be sent over TCP?
+			 * 
+			 * Off by default; turned on by "options use-vc" in resolv.conf.
+			 */
+			bool forceTCP() const;
+			
+			/**
+			 * Sets whether queries should always be sent over TCP.
+			 */
+			void setForceTCP(bool v);
+			
 			
 			
 			/**
@@ -104,6 +153,11 @@ namespace libdane
 			 * A list of possible addresses to connect to.
 			 */
 			std::vector<asio::ip::address> m_nameServers;
+			
+			unsigned short m_port;
+			uint16_t m_ednsBufferSize;
+			std::chrono::milliseconds m_timeout;
+			bool m_forceTCP;
 		};
 	}
 }
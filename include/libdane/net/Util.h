@@ -26,7 +26,14 @@ namespace libdane
 		 * @param  data Binary data
 		 * @return A new TLSA resource record
 		 */
-		std::shared_ptr<ldns_rr> make_tlsa(Usage u, Selector sel, MatchingType mt, const std::vector<unsigned char> &data);
+		std::shared_ptr<ldns_rr> make_tlsa(Usage u, Selector sel, MatchingType mt, ByteView data);
+		
+		/**
+		 * Overload that takes a vector.
+		 */
+		inline std::shared_ptr<ldns_rr> make_tlsa(Usage u, Selector sel, MatchingType mt, const std::vector<unsigned char> &data) {
+			return make_tlsa(u, sel, mt, ByteView(data));
+		}
 		
 		/**
 		 * Builds a TLSA record from a libdane::DANERecord.
@@ -40,6 +47,11 @@ namespace libdane
 		
 		/**
 		 * Parses a DANERecord from a resource record.
+		 * 
+		 * The record is returned as-is, even if it's not usable; check with
+		 * DANERecord::usable() before verifying against it.
+		 * 
+		 * @throws std::runtime_error if the record is malformed
 		 */
 		DANERecord record_from_tlsa(ldns_rr *rr);
 		
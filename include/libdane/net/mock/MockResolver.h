@@ -10,6 +10,7 @@
 
 #include "../Resolver.h"
 #include "../_internal/ldns.h"
+#include <deque>
 #include <functional>
 #include <memory>
 #include <queue>
@@ -85,15 +86,58 @@ namespace libdane
 				virtual void connect(const ResolverConfig &conf, std::function<void(const asio::error_code &err, std::shared_ptr<asio::ip::tcp::socket>)> cb) const;
 				
 				/**
-				 * Pretends to send a query, actually just invokes a mock.
+				 * Pretends to send a batch of queries, actually just invokes a
+				 * mock for each of them.
+				 * 
+				 * The answers are queued in reverse order, the way a server
+				 * that answers some queries faster than others might send
+				 * them, so they have to be matched to their queries by ID.
+				 */
+				virtual void sendQueries(std::shared_ptr<asio::ip::tcp::socket> sock, const std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb);
+				
+				/**
+				 * Pops the next queued answer.
+				 * 
+				 * Fails with asio::error::eof once there are none left, as if
+				 * the server had closed the connection.
+				 */
+				virtual void receiveResponse(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb);
+				
+				/**
+				 * Doesn't actually open anything.
+				 * 
+				 * It will immediately yield a pointer to a newly constructed,
+				 * unopened socket.
+				 * 
+				 * @param endpoint Nameserver to pretend to connect to
+				 * @param cb       Callback that receives a socket
+				 */
+				virtual void connectUDP(const asio::ip::udp::endpoint &endpoint, std::function<void(const asio::error_code &err, std::shared_ptr<asio::ip::udp::socket>)> cb) const;
+				
+				/**
+				 * Pretends to send a query datagram, actually just invokes a mock.
+				 * 
+				 * Like a real UDP query, it fails with asio::error::message_size
+				 * if the answer doesn't fit in the configured EDNS0 buffer size.
 				 */
-				virtual void sendQuery(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)>);
+				virtual void sendUDPQuery(std::shared_ptr<asio::ip::udp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)>);
+				
+				unsigned int tcpQueries() const;			///< Queries sent over TCP
+				unsigned int udpQueries() const;			///< Queries sent over UDP
 				
 			protected:
 				/**
 				 * Queued mock functions.
 				 */
 				std::queue<MockFn> m_mocks;
+				
+				/**
+				 * Answers waiting to be received over TCP.
+				 */
+				std::deque<std::vector<unsigned char>> m_answers;
+				
+				unsigned int m_tcpQueries;
+				unsigned int m_udpQueries;
 			};
 		}
 	}
@@ -8,6 +8,7 @@
 #ifndef LIBDANE_NET_NET_H
 #define LIBDANE_NET_NET_H
 
+#include "ConnectionPool.h"
 #include "Resolver.h"
 #include "ResolverConfig.h"
 
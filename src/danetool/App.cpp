@@ -134,8 +134,9 @@ void App::handshake(std::shared_ptr<asio::ip::tcp::socket> plain_sock, std::vect
 {
 	auto ctx = std::make_shared<ssl::context>(asio::ssl::context::sslv23);
 	ctx->set_verify_mode(asio::ssl::verify_peer);
+	libdane::DANERecordSet set(records.begin(), records.end());
 	ctx->set_verify_callback([=](bool preverified, asio::ssl::verify_context &ctx) {
-		return verify(preverified, ctx.native_handle(), records.begin(), records.end());
+		return libdane::HandshakeVerifier::verify(set, preverified, ctx.native_handle());
 	});
 	
 	auto sock = std::make_shared<ssl::stream<ip::tcp::socket&>>(*plain_sock, *ctx);
@@ -0,0 +1,54 @@
+/**
+ * BatchVerifier.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/BatchVerifier.h>
+#include <libdane/_internal/parallel.h>
+#include <stdexcept>
+
+using namespace libdane;
+
+BatchVerifier::BatchVerifier(unsigned int threads):
+	m_threads(threads)
+{
+	
+}
+
+BatchVerifier::~BatchVerifier()
+{
+	
+}
+
+
+
+std::vector<bool> BatchVerifier::run(const Job *jobs, std::size_t count) const
+{
+	// std::vector<bool> packs bits, so threads can't write to it directly
+	std::vector<unsigned char> passed(count, 0);
+	
+	internal::parallel_for(count, m_threads, [&](std::size_t begin, std::size_t end) {
+		for (std::size_t i = begin; i < end; ++i) {
+			const Job &job = jobs[i];
+			try {
+				passed[i] = job.records->verifyChain(job.preverified, *job.chain);
+			} catch (std::exception &e) {
+				passed[i] = false;
+			}
+		}
+	});
+	
+	return std::vector<bool>(passed.begin(), passed.end());
+}
+
+std::vector<bool> BatchVerifier::run(const std::vector<Job> &jobs) const
+{
+	return this->run(jobs.data(), jobs.size());
+}
+
+
+
+unsigned int BatchVerifier::threads() const { return m_threads; }
+void BatchVerifier::setThreads(unsigned int v) { m_threads = v; }
@@ -6,44 +6,211 @@
  */
 
 #include <libdane/Certificate.h>
-#include <regex>
+#include <libdane/Util.h>
+#include <libdane/CertificatePool.h>
+#include <libdane/PEM.h>
+#include <libdane/SignatureCache.h>
+#include <libdane/_internal/der.h>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <unordered_set>
 #include <stdexcept>
 
 using namespace libdane;
 
-std::deque<Certificate> Certificate::parsePEM(const std::string &pem)
+/**
+ * Lazily computed encodings of a certificate.
+ */
+struct libdane::internal::CertificateCache
 {
-	static std::regex pemex("([-]+BEGIN CERTIFICATE[-]+\\n[A-Za-z0-9\\+\\/\n\\=]+\\n[-]+END CERTIFICATE[-]+)");
+	std::once_flag derOnce;
+	std::vector<unsigned char> der;
+	
+	std::once_flag spkiOnce;
+	ByteView spki;
+	
+	/// Only used if the SPKI can't be found in the DER
+	std::vector<unsigned char> spkiBuffer;
+	
+	/// Copy of the SPKI, for digest(SubjectPublicKeyInfo, ExactMatch)
+	std::once_flag spkiVectorOnce;
+	std::vector<unsigned char> spkiVector;
+	
+	/// Indexed by [Selector][MatchingType - 1]
+	std::once_flag digestOnce[2][2];
+	std::vector<unsigned char> digests[2][2];
+	
+	/// Set once a digest is computed, so prefetchDigests() can skip it
+	std::atomic<bool> digestReady[2][2] {};
+	
+	std::once_flag fingerprintOnce;
+	Certificate::Fingerprint fingerprint;
+	bool hasFingerprint = false;
+};
+
+namespace
+{
+	void free_cache(void*, void *ptr, CRYPTO_EX_DATA*, int, long, void*)
+	{
+		delete static_cast<internal::CertificateCache*>(ptr);
+	}
+	
+	int cache_index()
+	{
+		static int idx = X509_get_ex_new_index(0, nullptr, nullptr, nullptr, free_cache);
+		return idx;
+	}
+	
+	/**
+	 * Returns the cache attached to an X509 object, attaching one if needed.
+	 * 
+	 * Only objects that libdane wraps get one. X509_set_ex_data() may
+	 * reallocate the object's ex_data underneath a concurrent reader, so
+	 * both happen under a lock; which one depends on the object, so
+	 * handshakes on different certificates don't wait on each other.
+	 */
+	internal::CertificateCache* cache_for(X509 *x509)
+	{
+		static const std::size_t stripes = 64;
+		static std::mutex mutexes[stripes];
+		
+		if (!x509) {
+			return nullptr;
+		}
+		
+		// Allocations are aligned, so the low bits of the address say nothing
+		std::uintptr_t stripe = reinterpret_cast<std::uintptr_t>(x509) >> 4;
+		std::lock_guard<std::mutex> lock(mutexes[stripe % stripes]);
+		auto cache = static_cast<internal::CertificateCache*>(X509_get_ex_data(x509, cache_index()));
+		if (!cache) {
+			cache = new internal::CertificateCache();
+			X509_set_ex_data(x509, cache_index(), cache);
+		}
+		return cache;
+	}
 	
+	/**
+	 * Finds the SubjectPublicKeyInfo in a DER-encoded certificate.
+	 * 
+	 * @see https://tools.ietf.org/html/rfc5280#section-4.1
+	 * 
+	 * @return A view of the SPKI, or an empty view if it couldn't be found
+	 */
+	ByteView find_spki(const std::vector<unsigned char> &der)
+	{
+		const unsigned char *p = der.data();
+		std::size_t left = der.size();
+		std::size_t header, length;
+		
+		// Certificate ::= SEQUENCE { tbsCertificate TBSCertificate, ... }
+		// TBSCertificate ::= SEQUENCE { ... }
+		for (int i = 0; i < 2; ++i) {
+			if (!internal::der_header(p, left, header, length) || p[0] != 0x30) {
+				return ByteView();
+			}
+			p += header;
+			left = length;
+		}
+		
+		// Skip version (optional, [0]), serialNumber, signature, issuer,
+		// validity and subject
+		int skip = (left > 0 && p[0] == 0xA0) ? 6 : 5;
+		for (int i = 0; i < skip; ++i) {
+			if (!internal::der_header(p, left, header, length)) {
+				return ByteView();
+			}
+			p += header + length;
+			left -= header + length;
+		}
+		
+		if (!internal::der_header(p, left, header, length) || p[0] != 0x30) {
+			return ByteView();
+		}
+		return ByteView(p, header + length);
+	}
+	
+	const std::vector<unsigned char> empty;
+	const Certificate::Fingerprint emptyFingerprint = {};
+}
+
+std::deque<Certificate> Certificate::parsePEM(const std::string &pem, CertificatePool *pool)
+{
+	return parsePEM(pem.data(), pem.size(), pool);
+}
+
+std::deque<Certificate> Certificate::parsePEM(const char *data, std::size_t size, CertificatePool *pool)
+{
 	std::deque<Certificate> certs;
 	
-	auto begin = std::sregex_iterator(pem.begin(), pem.end(), pemex);
-	auto end = std::sregex_iterator();
-	for (auto it = begin; it != end; ++it) {
-		std::smatch match = *it;
-		std::string str = match.str();
-		certs.emplace_back(str);
+	// Reuse one buffer for every certificate's DER
+	std::vector<unsigned char> der;
+	const char *it = data;
+	const char *end = data + size;
+	const char *body_begin, *body_end;
+	while ((it = pem_find(it, end, "CERTIFICATE", body_begin, body_end))) {
+		der.clear();
+		if (!base64_decode(body_begin, body_end, der)) {
+			continue;
+		}
+		
+		Certificate cert = pool ? pool->intern(der.data(), der.size()) : fromDER(der.data(), der.size());
+		if (cert) {
+			certs.push_back(std::move(cert));
+		}
 	}
 	
 	return certs;
 }
 
+Certificate Certificate::fromDER(const unsigned char *data, std::size_t size)
+{
+	Certificate cert;
+	cert.m_x509 = d2i_X509(NULL, &data, size);
+	cert.m_cache = cache_for(cert.m_x509);
+	return cert;
+}
+
 
 
 Certificate::Certificate(X509 *x509):
-	m_x509(x509 ? X509_dup(x509) : NULL)
+	m_x509(x509), m_cache(nullptr)
 {
-	
+	if (m_x509) {
+		X509_up_ref(m_x509);
+		m_cache = cache_for(m_x509);
+	}
 }
 
 Certificate::Certificate(const Certificate &other):
-	Certificate(other.x509()) {}
+	m_x509(other.m_x509), m_cache(other.m_cache)
+{
+	if (m_x509) {
+		X509_up_ref(m_x509);
+	}
+}
 
-Certificate::Certificate(const std::string &pem)
+Certificate::Certificate(Certificate &&other):
+	m_x509(other.m_x509), m_cache(other.m_cache)
 {
-	std::vector<char> tmp(pem.data(), pem.data() + pem.size());
-	auto bio = std::shared_ptr<BIO>(BIO_new_mem_buf(static_cast<void*>(tmp.data()), tmp.size()), BIO_free);
-	m_x509 = PEM_read_bio_X509(&*bio, NULL, NULL, NULL);
+	other.m_x509 = nullptr;
+	other.m_cache = nullptr;
+}
+
+Certificate::Certificate(const std::string &pem):
+	m_x509(nullptr), m_cache(nullptr)
+{
+	const char *body_begin, *body_end;
+	if (!pem_find(pem.data(), pem.data() + pem.size(), "CERTIFICATE", body_begin, body_end)) {
+		return;
+	}
+	
+	std::vector<unsigned char> der;
+	if (!base64_decode(body_begin, body_end, der)) {
+		return;
+	}
+	
+	*this = fromDER(der.data(), der.size());
 }
 
 Certificate::~Certificate()
@@ -53,6 +220,35 @@ Certificate::~Certificate()
 	}
 }
 
+Certificate& Certificate::operator=(const Certificate &other)
+{
+	if (other.m_x509) {
+		X509_up_ref(other.m_x509);
+	}
+	if (m_x509) {
+		X509_free(m_x509);
+	}
+	m_x509 = other.m_x509;
+	m_cache = other.m_cache;
+	
+	return *this;
+}
+
+Certificate& Certificate::operator=(Certificate &&other)
+{
+	if (this != &other) {
+		if (m_x509) {
+			X509_free(m_x509);
+		}
+		m_x509 = other.m_x509;
+		m_cache = other.m_cache;
+		other.m_x509 = nullptr;
+		other.m_cache = nullptr;
+	}
+	
+	return *this;
+}
+
 
 
 X509* Certificate::x509() const { return m_x509; }
@@ -77,50 +273,211 @@ std::string Certificate::issuerDN() const
 
 std::vector<unsigned char> Certificate::publicKey() const
 {
-	if (!m_x509) {
-		return std::vector<unsigned char>();
-	}
-	
-	unsigned char *buf = NULL;
-	EVP_PKEY *pkey = X509_get_pubkey(m_x509);
-	int size = i2d_PUBKEY(pkey, &buf);
-	std::vector<unsigned char> data(buf, buf + size);
-	free(buf);
-	
-	return data;
+	return this->view(SubjectPublicKeyInfo).toVector();
 }
 
 std::vector<unsigned char> Certificate::encoded() const
 {
-	if (!m_x509) {
-		return std::vector<unsigned char>();
-	}
-	
-	unsigned char *buf = NULL;
-	int size = i2d_X509(m_x509, &buf);
-	std::vector<unsigned char> data(buf, buf + size);
-	free(buf);
-	
-	return data;
+	return this->view(FullCertificate).toVector();
 }
 
 std::vector<unsigned char> Certificate::select(Selector sel) const
+{
+	return this->view(sel).toVector();
+}
+
+ByteView Certificate::view(Selector sel) const
 {
 	switch (sel) {
 		case FullCertificate:
-			return this->encoded();
+			return this->der();
 		case SubjectPublicKeyInfo:
-			return this->publicKey();
+			if (!m_cache) {
+				return ByteView();
+			}
+			
+			std::call_once(m_cache->spkiOnce, [&]() {
+				m_cache->spki = find_spki(this->der());
+				if (!m_cache->spki.empty()) {
+					return;
+				}
+				
+				// Fall back to having OpenSSL re-encode it
+				unsigned char *buf = NULL;
+				int size = i2d_X509_PUBKEY(X509_get_X509_PUBKEY(m_x509), &buf);
+				if (size > 0) {
+					m_cache->spkiBuffer.assign(buf, buf + size);
+				}
+				OPENSSL_free(buf);
+				m_cache->spki = m_cache->spkiBuffer;
+			});
+			return m_cache->spki;
 		default:
 			throw std::runtime_error("Unknown selector");
 	}
 }
 
+const std::vector<unsigned char>& Certificate::digest(Selector sel, MatchingType type) const
+{
+	typedef const std::vector<unsigned char>& (Certificate::*DigestFn)() const;
+	static const DigestFn table[2][3] = {
+		{
+			&Certificate::digest<FullCertificate, ExactMatch>,
+			&Certificate::digest<FullCertificate, SHA256Hash>,
+			&Certificate::digest<FullCertificate, SHA512Hash>,
+		},
+		{
+			&Certificate::digest<SubjectPublicKeyInfo, ExactMatch>,
+			&Certificate::digest<SubjectPublicKeyInfo, SHA256Hash>,
+			&Certificate::digest<SubjectPublicKeyInfo, SHA512Hash>,
+		},
+	};
+	
+	if (sel != FullCertificate && sel != SubjectPublicKeyInfo) {
+		throw std::runtime_error("Unknown selector");
+	}
+	md_from_matching_type(type);
+	
+	return (this->*table[sel][type])();
+}
+
+void Certificate::prefetchDigests(const std::vector<Certificate> &certs, Selector sel, MatchingType type)
+{
+	if (sel != FullCertificate && sel != SubjectPublicKeyInfo) {
+		throw std::runtime_error("Unknown selector");
+	}
+	const EVP_MD *md = md_from_matching_type(type);
+	if (!md) {
+		return;
+	}
+	
+	// Duplicates share a cache, and must only be hashed once
+	const int i = (type == SHA512Hash) ? 1 : 0;
+	std::vector<internal::CertificateCache*> pending;
+	std::vector<ByteView> views;
+	std::unordered_set<internal::CertificateCache*> seen;
+	for (const Certificate &cert : certs) {
+		internal::CertificateCache *cache = cert.m_cache;
+		if (!cache || cache->digestReady[sel][i].load(std::memory_order_acquire) || !seen.insert(cache).second) {
+			continue;
+		}
+		pending.push_back(cache);
+		views.push_back(cert.view(sel));
+	}
+	
+	std::size_t size = EVP_MD_size(md);
+	std::vector<unsigned char> digests(views.size() * size);
+	hash_batch(md, views.data(), views.size(), digests.data());
+	for (std::size_t j = 0; j < pending.size(); ++j) {
+		internal::CertificateCache *cache = pending[j];
+		std::call_once(cache->digestOnce[sel][i], [&]() {
+			if (!views[j].empty()) {
+				cache->digests[sel][i].assign(digests.begin() + j * size, digests.begin() + (j + 1) * size);
+			}
+			cache->digestReady[sel][i].store(true, std::memory_order_release);
+		});
+	}
+}
+
+template<Selector S, MatchingType M>
+const std::vector<unsigned char>& Certificate::digest() const
+{
+	if (!m_cache) {
+		return empty;
+	}
+	
+	if (M == ExactMatch) {
+		// Only the DER is stored as a vector; the SPKI is a slice of it
+		if (S == FullCertificate) {
+			return this->der();
+		}
+		
+		std::call_once(m_cache->spkiVectorOnce, [&]() {
+			m_cache->spkiVector = this->view(S).toVector();
+		});
+		return m_cache->spkiVector;
+	}
+	
+	const int i = (M == SHA512Hash) ? 1 : 0;
+	std::vector<unsigned char> &digest = m_cache->digests[S][i];
+	std::call_once(m_cache->digestOnce[S][i], [&]() {
+		// A certificate that can't be encoded gets no digest; the hash of
+		// nothing would be shared with every other one
+		ByteView data = this->view(S);
+		if (!data.empty()) {
+			hash(M == SHA512Hash ? EVP_sha512() : EVP_sha256(), std::back_inserter(digest), data.begin(), data.end());
+		}
+		m_cache->digestReady[S][i].store(true, std::memory_order_release);
+	});
+	
+	return digest;
+}
+
+template const std::vector<unsigned char>& Certificate::digest<FullCertificate, ExactMatch>() const;
+template const std::vector<unsigned char>& Certificate::digest<FullCertificate, SHA256Hash>() const;
+template const std::vector<unsigned char>& Certificate::digest<FullCertificate, SHA512Hash>() const;
+template const std::vector<unsigned char>& Certificate::digest<SubjectPublicKeyInfo, ExactMatch>() const;
+template const std::vector<unsigned char>& Certificate::digest<SubjectPublicKeyInfo, SHA256Hash>() const;
+template const std::vector<unsigned char>& Certificate::digest<SubjectPublicKeyInfo, SHA512Hash>() const;
+
+const Certificate::Fingerprint& Certificate::fingerprint() const
+{
+	if (!m_cache) {
+		return emptyFingerprint;
+	}
+	
+	std::call_once(m_cache->fingerprintOnce, [&]() {
+		const std::vector<unsigned char> &digest = this->digest<FullCertificate, SHA256Hash>();
+		if (digest.size() == m_cache->fingerprint.size()) {
+			std::copy(digest.begin(), digest.end(), m_cache->fingerprint.begin());
+			m_cache->hasFingerprint = true;
+		}
+	});
+	return m_cache->fingerprint;
+}
+
+bool Certificate::hasFingerprint() const
+{
+	this->fingerprint();
+	return m_cache && m_cache->hasFingerprint;
+}
+
 bool Certificate::verify(const Certificate &other) const
 {
+	if (!m_x509 || !other.m_x509) {
+		return false;
+	}
+	
+	SignatureCache &cache = SignatureCache::shared();
+	if (cache.contains(*this, other)) {
+		return true;
+	}
+	
 	auto pkey = std::shared_ptr<EVP_PKEY>(X509_get_pubkey(other.x509()), EVP_PKEY_free);
-	int result = X509_verify(m_x509, &*pkey);
-	return result > 0;
+	if (!pkey || X509_verify(m_x509, &*pkey) <= 0) {
+		return false;
+	}
+	
+	cache.insert(*this, other);
+	return true;
+}
+
+bool Certificate::operator==(const Certificate &other) const
+{
+	if (m_x509 == other.m_x509) {
+		return true;
+	}
+	if (!m_x509 || !other.m_x509) {
+		return false;
+	}
+	
+	// Certificates that can't be encoded have no fingerprint to compare;
+	// they're only equal to themselves
+	if (!this->hasFingerprint() || !other.hasFingerprint()) {
+		return false;
+	}
+	
+	return this->fingerprint() == other.fingerprint();
 }
 
 
@@ -133,3 +490,20 @@ std::string Certificate::nameStr(X509_NAME *name) const
 	
 	return str;
 }
+
+const std::vector<unsigned char>& Certificate::der() const
+{
+	if (!m_cache) {
+		return empty;
+	}
+	
+	std::call_once(m_cache->derOnce, [&]() {
+		unsigned char *buf = NULL;
+		int size = i2d_X509(m_x509, &buf);
+		if (size > 0) {
+			m_cache->der.assign(buf, buf + size);
+		}
+		OPENSSL_free(buf);
+	});
+	return m_cache->der;
+}
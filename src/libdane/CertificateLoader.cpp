@@ -0,0 +1,224 @@
+/**
+ * CertificateLoader.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/CertificateLoader.h>
+#include <libdane/PEM.h>
+#include <libdane/_internal/der.h>
+#include <libdane/_internal/parallel.h>
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <stdexcept>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define LIBDANE_HAVE_MMAP 1
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace libdane;
+
+namespace
+{
+	/**
+	 * A read-only view of a file's contents.
+	 * 
+	 * The file is memory mapped where possible, and read into memory where
+	 * it's not.
+	 */
+	class MappedFile
+	{
+	public:
+		MappedFile(const std::string &path):
+			m_data(nullptr), m_size(0)
+		{
+#ifdef LIBDANE_HAVE_MMAP
+			int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0) {
+				throw std::runtime_error("Couldn't open " + path);
+			}
+			
+			struct stat st;
+			if (::fstat(fd, &st) != 0) {
+				::close(fd);
+				throw std::runtime_error("Couldn't stat " + path);
+			}
+			
+			m_size = st.st_size;
+			if (m_size > 0) {
+				void *ptr = ::mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, fd, 0);
+				if (ptr == MAP_FAILED) {
+					::close(fd);
+					throw std::runtime_error("Couldn't map " + path);
+				}
+				m_data = static_cast<const char*>(ptr);
+			}
+			::close(fd);
+#else
+			std::ifstream fs(path, std::ios::binary);
+			if (!fs.is_open()) {
+				throw std::runtime_error("Couldn't open " + path);
+			}
+			
+			std::stringstream ss;
+			ss << fs.rdbuf();
+			m_buffer = ss.str();
+			m_data = m_buffer.data();
+			m_size = m_buffer.size();
+#endif
+		}
+		
+		~MappedFile()
+		{
+#ifdef LIBDANE_HAVE_MMAP
+			if (m_data) {
+				::munmap(const_cast<char*>(m_data), m_size);
+			}
+#endif
+		}
+		
+		MappedFile(const MappedFile&) = delete;
+		MappedFile &operator=(const MappedFile&) = delete;
+		
+		const char *data() const { return m_data; }
+		std::size_t size() const { return m_size; }
+		
+	private:
+		const char *m_data;
+		std::size_t m_size;
+#ifndef LIBDANE_HAVE_MMAP
+		std::string m_buffer;
+#endif
+	};
+}
+
+CertificateLoader::CertificateLoader(unsigned int threads):
+	m_threads(threads)
+{
+	
+}
+
+CertificateLoader::~CertificateLoader()
+{
+	
+}
+
+
+
+std::vector<Certificate> CertificateLoader::load(const char *data, std::size_t size) const
+{
+	std::vector<Chunk> chunks;
+	this->split(data, size, chunks);
+	return this->parse(chunks);
+}
+
+std::vector<Certificate> CertificateLoader::loadFile(const std::string &path) const
+{
+	return this->loadFiles({ path });
+}
+
+std::vector<Certificate> CertificateLoader::loadFiles(const std::vector<std::string> &paths) const
+{
+	// Files must stay mapped until everything is parsed
+	std::vector<std::unique_ptr<MappedFile>> files;
+	std::vector<Chunk> chunks;
+	for (const std::string &path : paths) {
+		files.emplace_back(new MappedFile(path));
+		this->split(files.back()->data(), files.back()->size(), chunks);
+	}
+	
+	return this->parse(chunks);
+}
+
+std::vector<Certificate> CertificateLoader::loadDirectory(const std::string &path) const
+{
+	std::vector<std::string> paths;
+	
+#ifdef LIBDANE_HAVE_MMAP
+	DIR *dir = ::opendir(path.c_str());
+	if (!dir) {
+		throw std::runtime_error("Couldn't open directory " + path);
+	}
+	
+	while (struct dirent *ent = ::readdir(dir)) {
+		std::string filepath = path + "/" + ent->d_name;
+		struct stat st;
+		if (::stat(filepath.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+			paths.push_back(filepath);
+		}
+	}
+	::closedir(dir);
+#else
+	throw std::runtime_error("Loading directories is not supported on this platform");
+#endif
+	
+	std::sort(paths.begin(), paths.end());
+	return this->loadFiles(paths);
+}
+
+
+
+unsigned int CertificateLoader::threads() const { return m_threads; }
+void CertificateLoader::setThreads(unsigned int v) { m_threads = v; }
+
+
+
+void CertificateLoader::split(const char *data, std::size_t size, std::vector<Chunk> &chunks) const
+{
+	const char *end = data + size;
+	
+	// PEM files; anything between the blocks is ignored
+	const char *it = data;
+	const char *body_begin, *body_end;
+	bool pem = false;
+	while ((it = pem_find(it, end, "CERTIFICATE", body_begin, body_end))) {
+		chunks.push_back({ body_begin, body_end, true });
+		pem = true;
+	}
+	if (pem) {
+		return;
+	}
+	
+	// Concatenated DER; stop at the first thing that isn't a SEQUENCE
+	it = data;
+	while (it < end && static_cast<unsigned char>(*it) == 0x30) {
+		std::size_t len = internal::der_element_size(reinterpret_cast<const unsigned char*>(it), end - it);
+		if (len == 0) {
+			break;
+		}
+		
+		chunks.push_back({ it, it + len, false });
+		it += len;
+	}
+}
+
+std::vector<Certificate> CertificateLoader::parse(const std::vector<Chunk> &chunks) const
+{
+	std::vector<Certificate> certs(chunks.size());
+	
+	internal::parallel_for(chunks.size(), m_threads, [&](std::size_t begin, std::size_t end) {
+		std::vector<unsigned char> der;
+		for (std::size_t i = begin; i < end; ++i) {
+			const Chunk &chunk = chunks[i];
+			if (chunk.pem) {
+				der.clear();
+				if (base64_decode(chunk.begin, chunk.end, der)) {
+					certs[i] = Certificate::fromDER(der.data(), der.size());
+				}
+			} else {
+				certs[i] = Certificate::fromDER(reinterpret_cast<const unsigned char*>(chunk.begin), chunk.end - chunk.begin);
+			}
+		}
+	});
+	
+	certs.erase(std::remove_if(certs.begin(), certs.end(), [](const Certificate &cert) { return !cert; }), certs.end());
+	return certs;
+}
@@ -0,0 +1,117 @@
+/**
+ * CertificatePool.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/CertificatePool.h>
+#include <libdane/Util.h>
+#include <algorithm>
+
+using namespace libdane;
+
+CertificatePool& CertificatePool::shared()
+{
+	static CertificatePool pool;
+	return pool;
+}
+
+
+
+CertificatePool::CertificatePool(std::size_t capacity):
+	m_certs(capacity), m_hits(0), m_misses(0)
+{
+	
+}
+
+CertificatePool::~CertificatePool()
+{
+	
+}
+
+
+
+Certificate CertificatePool::intern(const Certificate &cert)
+{
+	const std::vector<unsigned char> &digest = cert.digest(FullCertificate, SHA256Hash);
+	Key key;
+	if (!cert || digest.size() != key.size()) {
+		return cert;
+	}
+	
+	std::copy(digest.begin(), digest.end(), key.begin());
+	return this->lookup(key, [&]() { return cert; });
+}
+
+Certificate CertificatePool::intern(const unsigned char *data, std::size_t size)
+{
+	Key key;
+	try {
+		hash(EVP_sha256(), key.data(), data, data + size);
+	} catch (std::runtime_error &e) {
+		return Certificate::fromDER(data, size);
+	}
+	
+	return this->lookup(key, [&]() { return Certificate::fromDER(data, size); });
+}
+
+void CertificatePool::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_certs.clear();
+	m_hits = 0;
+	m_misses = 0;
+}
+
+
+
+std::size_t CertificatePool::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_certs.size();
+}
+
+std::size_t CertificatePool::capacity() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_certs.capacity();
+}
+
+void CertificatePool::setCapacity(std::size_t v)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_certs.setCapacity(v);
+}
+
+uint64_t CertificatePool::hits() const { return m_hits; }
+uint64_t CertificatePool::misses() const { return m_misses; }
+
+uint64_t CertificatePool::evictions() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_certs.evictions();
+}
+
+
+
+Certificate CertificatePool::lookup(const Key &key, std::function<Certificate()> make)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (Certificate *cert = m_certs.get(key)) {
+			++m_hits;
+			return *cert;
+		}
+	}
+	
+	// Don't hold the lock while parsing; if another thread beats us to it,
+	// the last one to finish wins, which is harmless
+	++m_misses;
+	Certificate cert = make();
+	if (cert) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_certs.put(key, cert);
+	}
+	return cert;
+}
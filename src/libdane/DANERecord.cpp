@@ -6,6 +6,7 @@
  */
 
 #include <libdane/DANERecord.h>
+#include <libdane/Matcher.h>
 #include <libdane/Util.h>
 #include <iostream>
 #include <sstream>
@@ -14,59 +15,122 @@
 #include <functional>
 #include <algorithm>
 #include <stdexcept>
+#include <cstring>
 
 using namespace libdane;
 using namespace std::placeholders;
 
-DANERecord::DANERecord()
+DANERecord::DANERecord():
+	m_size(0), m_usage(0), m_selector(0), m_matching(0)
 {
 	
 }
 
-DANERecord::DANERecord(Usage usage, Selector selector, MatchingType matching, std::vector<unsigned char> data):
-	m_usage(usage), m_selector(selector), m_matching(matching), m_data(data)
+DANERecord::DANERecord(Usage usage, Selector selector, MatchingType matching, ByteView data):
+	m_size(0), m_usage(usage), m_selector(selector), m_matching(matching)
 {
-	
+	this->setData(data);
 }
 
 DANERecord::DANERecord(Usage usage, Selector selector, MatchingType matching, const Certificate &cert):
-	DANERecord(usage, selector, matching, std::vector<unsigned char>())
+	DANERecord(usage, selector, matching, cert.digest(selector, matching))
+{
+	
+}
+
+std::vector<DANERecord> DANERecord::fromCertificates(Usage usage, Selector selector, MatchingType matching, const std::vector<Certificate> &certs)
 {
-	std::vector<unsigned char> selection = cert.select(m_selector);
-	match(m_matching, std::back_inserter(m_data), selection.begin(), selection.end());
+	Certificate::prefetchDigests(certs, selector, matching);
+	
+	std::vector<DANERecord> records;
+	records.reserve(certs.size());
+	for (const Certificate &cert : certs) {
+		records.emplace_back(usage, selector, matching, cert);
+	}
+	return records;
+}
+
+DANERecord::DANERecord(const DANERecord &other):
+	m_size(0), m_usage(other.m_usage), m_selector(other.m_selector), m_matching(other.m_matching)
+{
+	this->setData(other.data());
+}
+
+DANERecord::DANERecord(DANERecord &&other):
+	m_size(other.m_size), m_usage(other.m_usage), m_selector(other.m_selector), m_matching(other.m_matching)
+{
+	if (other.isHeap()) {
+		m_heap = other.m_heap;
+		other.m_size = 0;
+	} else {
+		std::memcpy(m_inline, other.m_inline, m_size);
+	}
 }
 
 DANERecord::~DANERecord()
 {
+	this->release();
+}
+
+DANERecord& DANERecord::operator=(const DANERecord &other)
+{
+	if (&other != this) {
+		m_usage = other.m_usage;
+		m_selector = other.m_selector;
+		m_matching = other.m_matching;
+		this->setData(other.data());
+	}
 	
+	return *this;
+}
+
+DANERecord& DANERecord::operator=(DANERecord &&other)
+{
+	if (&other != this) {
+		this->release();
+		
+		m_usage = other.m_usage;
+		m_selector = other.m_selector;
+		m_matching = other.m_matching;
+		m_size = other.m_size;
+		if (other.isHeap()) {
+			m_heap = other.m_heap;
+			other.m_size = 0;
+		} else {
+			std::memcpy(m_inline, other.m_inline, m_size);
+		}
+	}
+	
+	return *this;
 }
 
 bool DANERecord::verify(bool preverified, const VerifyContext &ctx) const
 {
-	if (!ctx.currentCert()) {
+	int depth = ctx.depth();
+	if (depth < 0) {
+		// The certificate isn't even in the chain, wtf
 		return false;
 	}
 	
-	Certificate cert = ctx.currentCert();
-	std::deque<Certificate> chain = ctx.chain();
-	
-	auto it = std::find(chain.begin(), chain.end(), cert);
-	if (it == chain.end()) {
-		// The certificate isn't even in the chain, wtf
+	// Signatures are the expensive part, so only check the link if the
+	// record passes, and never for DomainIssuedCertificate, which only ever
+	// depends on the leaf itself (RFC 7671, section 5.1)
+	const std::deque<Certificate> &chain = ctx.chain();
+	if (!verify(preverified, chain[depth], chain)) {
 		return false;
-	} else if (it != chain.end() - 1) {
-		// Verify that the current cert was in fact issued by the previous cert
-		const Certificate &prev = *(it + 1);
-		if (!cert.verify(prev)) {
-			return false;
-		}
 	}
 	
-	return verify(preverified, cert, chain);
+	return m_usage == DomainIssuedCertificate || ctx.verifyIssuer(preverified, depth);
 }
 
 bool DANERecord::verify(bool preverified, const Certificate &cert, const std::deque<Certificate> &chain) const
 {
+	const MatcherFunctions *matcher = matcher_for(this->usage(), this->selector(), this->matching());
+	if (matcher) {
+		return matcher->verify(this->data(), preverified, cert, chain);
+	}
+	
+	// Invalid records go the long way around, and throw appropriately
 	switch (m_usage) {
 		case CAConstraints:
 			return verifyCAConstraints(preverified, cert, chain);
@@ -83,8 +147,40 @@ bool DANERecord::verify(bool preverified, const Certificate &cert, const std::de
 
 bool DANERecord::verify(const Certificate &cert) const
 {
-	std::vector<unsigned char> selection = cert.select(m_selector);
-	return match(m_matching, selection.begin(), selection.end()) == m_data;
+	const MatcherFunctions *matcher = matcher_for(this->usage(), this->selector(), this->matching());
+	if (matcher) {
+		return matcher->match(this->data(), cert);
+	}
+	
+	return cert.digest(this->selector(), this->matching()) == this->data();
+}
+
+bool DANERecord::usable() const
+{
+	if (!matcher_for(this->usage(), this->selector(), this->matching())) {
+		return false;
+	}
+	
+	switch (m_matching) {
+		case SHA256Hash:
+			return m_size == 32;
+		case SHA512Hash:
+			return m_size == 64;
+		default:
+			return m_size > 0;
+	}
+}
+
+DANERecord DANERecord::normalized() const
+{
+	if (m_matching != ExactMatch) {
+		return *this;
+	}
+	
+	ByteView data = this->data();
+	unsigned char digest[32];
+	hash(EVP_sha256(), digest, data.begin(), data.end());
+	return DANERecord(this->usage(), this->selector(), SHA256Hash, ByteView(digest, sizeof(digest)));
 }
 
 std::string DANERecord::toString() const
@@ -134,24 +230,52 @@ std::string DANERecord::toString() const
 			break;
 	}
 	
-	ss << ", \"" << to_hex(m_data.begin(), m_data.end()) << "\")";
+	ss << ", \"" << to_hex(this->data()) << "\")";
 	
 	return ss.str();
 }
 
 
 
-Usage DANERecord::usage() const { return m_usage; }
+Usage DANERecord::usage() const { return static_cast<Usage>(m_usage); }
 void DANERecord::setUsage(Usage v) { m_usage = v; }
 
-Selector DANERecord::selector() const { return m_selector; }
+Selector DANERecord::selector() const { return static_cast<Selector>(m_selector); }
 void DANERecord::setSelector(Selector v) { m_selector = v; }
 
-MatchingType DANERecord::matching() const { return m_matching; }
+MatchingType DANERecord::matching() const { return static_cast<MatchingType>(m_matching); }
 void DANERecord::setMatching(MatchingType v) { m_matching = v; }
 
-std::vector<unsigned char> DANERecord::data() const { return m_data; }
-void DANERecord::setData(std::vector<unsigned char> v) { m_data = v; }
+ByteView DANERecord::data() const { return ByteView(this->isHeap() ? m_heap : m_inline, m_size); }
+void DANERecord::setData(ByteView v)
+{
+	if (v.size() > UINT32_MAX) {
+		throw std::length_error("DANE record data is too long");
+	}
+	
+	// The source may be our own data, so don't free anything until it's copied
+	unsigned char *old = this->isHeap() ? m_heap : nullptr;
+	if (v.size() > InlineSize) {
+		unsigned char *heap = new unsigned char[v.size()];
+		std::memcpy(heap, v.data(), v.size());
+		m_heap = heap;
+	} else if (!v.empty()) {
+		std::memmove(m_inline, v.data(), v.size());
+	}
+	m_size = static_cast<std::uint32_t>(v.size());
+	
+	delete[] old;
+}
+
+
+
+void DANERecord::release()
+{
+	if (this->isHeap()) {
+		delete[] m_heap;
+	}
+	m_size = 0;
+}
 
 
 
@@ -175,7 +299,7 @@ bool DANERecord::verifyServiceCertificateConstraint(bool preverified, const Cert
 	return this->verifyDomainIssuedCertificate(preverified, cert, chain);
 }
 
-bool DANERecord::verifyTrustAnchorAssertion(bool preverified, const Certificate &cert, const std::deque<Certificate> &chain) const
+bool DANERecord::verifyTrustAnchorAssertion(bool /*preverified*/, const Certificate &cert, const std::deque<Certificate> &chain) const
 {
 	// Pass non-root certificates; it's already been verified to be issued by
 	// the previous one, which means we only need to care about the root cert
@@ -187,7 +311,7 @@ bool DANERecord::verifyTrustAnchorAssertion(bool preverified, const Certificate
 	return this->verify(cert);
 }
 
-bool DANERecord::verifyDomainIssuedCertificate(bool preverified, const Certificate &cert, const std::deque<Certificate> &chain) const
+bool DANERecord::verifyDomainIssuedCertificate(bool /*preverified*/, const Certificate &cert, const std::deque<Certificate> &chain) const
 {
 	// Fast-forward to the final (front) certificate in the chain
 	if (cert != chain.front()) {
@@ -0,0 +1,339 @@
+/**
+ * DANERecordSet.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/DANERecordSet.h>
+#include <libdane/Hasher.h>
+#include <libdane/VerdictCache.h>
+#include <libdane/Util.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+
+using namespace libdane;
+
+namespace
+{
+	/**
+	 * Returns the relative cost of checking a group; lower goes first.
+	 * 
+	 * Usages that don't depend on the system's trust store come first, and
+	 * leaf pins come before trust anchors, as most deployments pin the leaf.
+	 * Within a usage, short digests are cheaper to compare than exact matches.
+	 */
+	int cost(Usage usage, Selector selector, MatchingType matching)
+	{
+		static const int usages[] = { 3, 2, 1, 0 };
+		static const int matchings[] = { 2, 0, 1 };
+		return usages[usage] * 6 + matchings[matching] * 2 + (selector == FullCertificate ? 1 : 0);
+	}
+	
+	/// Returns the SHA-256 of a buffer
+	DANERecordSet::Digest sha256(const unsigned char *data, std::size_t size)
+	{
+		DANERecordSet::Digest digest;
+		hash(EVP_sha256(), digest.data(), data, data + size);
+		return digest;
+	}
+	
+	/// Returns the SHA-256 of a sorted list of record digests
+	DANERecordSet::Digest sha256(const std::vector<DANERecordSet::Digest> &digests)
+	{
+		const unsigned char *data = digests.empty() ? nullptr : digests.front().data();
+		return sha256(data, digests.size() * sizeof(DANERecordSet::Digest));
+	}
+}
+
+DANERecordSet::DANERecordSet():
+	m_digest(sha256(m_recordDigests)), m_ttl(0), m_verdictCache(nullptr),
+	m_verifications(0), m_lookups(0)
+{
+	m_preferred[0] = 0;
+	m_preferred[1] = 0;
+}
+
+DANERecordSet::DANERecordSet(const DANERecordSet &other):
+	m_records(other.m_records), m_groups(other.m_groups),
+	m_recordDigests(other.m_recordDigests), m_digest(other.m_digest),
+	m_ttl(other.m_ttl), m_verdictCache(other.m_verdictCache),
+	m_verifications(other.m_verifications.load()), m_lookups(other.m_lookups.load())
+{
+	m_preferred[0] = other.m_preferred[0].load();
+	m_preferred[1] = other.m_preferred[1].load();
+}
+
+DANERecordSet::~DANERecordSet()
+{
+	
+}
+
+DANERecordSet &DANERecordSet::operator=(const DANERecordSet &other)
+{
+	m_records = other.m_records;
+	m_groups = other.m_groups;
+	m_recordDigests = other.m_recordDigests;
+	m_digest = other.m_digest;
+	m_ttl = other.m_ttl;
+	m_verdictCache = other.m_verdictCache;
+	m_preferred[0] = other.m_preferred[0].load();
+	m_preferred[1] = other.m_preferred[1].load();
+	m_verifications = other.m_verifications.load();
+	m_lookups = other.m_lookups.load();
+	return *this;
+}
+
+
+
+void DANERecordSet::add(const DANERecord &rec)
+{
+	Usage usage = rec.usage();
+	Selector selector = rec.selector();
+	MatchingType matching = rec.matching();
+	
+	const MatcherFunctions *matcher = matcher_for(usage, selector, matching);
+	if (!matcher) {
+		if (static_cast<unsigned>(usage) > DomainIssuedCertificate) {
+			throw std::runtime_error("Invalid certificate usage");
+		}
+		if (static_cast<unsigned>(selector) > SubjectPublicKeyInfo) {
+			throw std::runtime_error("Invalid selector");
+		}
+		throw std::runtime_error("Invalid matching type");
+	}
+	
+	// An empty digest would match any certificate whose digest couldn't be
+	// computed, and an empty exact match one that couldn't be encoded
+	if (!rec.usable()) {
+		throw std::runtime_error("Invalid certificate association data");
+	}
+	
+	// Records are hashed with their fields, and kept sorted, so the set's
+	// digest doesn't depend on the order they're added in
+	Digest recordDigest;
+	{
+		// The hasher borrows the thread's context, which sha256() and
+		// normalized() need too, so it has to be gone before they run
+		const unsigned char fields[] = { static_cast<unsigned char>(usage), static_cast<unsigned char>(selector), static_cast<unsigned char>(matching) };
+		Hasher hasher(EVP_sha256(), internal::digest_context());
+		hasher.update(fields, sizeof(fields));
+		hasher.update(rec.data());
+		hasher.final(recordDigest.data());
+	}
+	m_recordDigests.insert(std::upper_bound(m_recordDigests.begin(), m_recordDigests.end(), recordDigest), recordDigest);
+	m_digest = sha256(m_recordDigests);
+	
+	m_records.push_back(rec);
+	
+	// Exact matches are stored as digests, so they can be compared against
+	// a certificate's cached digest, rather than a fresh copy of its data
+	DANERecord canonical = rec.normalized();
+	if (canonical.matching() != matching) {
+		matching = canonical.matching();
+		matcher = matcher_for(usage, selector, matching);
+	}
+	
+	auto it = std::find_if(m_groups.begin(), m_groups.end(), [&](const Group &g) {
+		return g.matcher == matcher;
+	});
+	if (it == m_groups.end()) {
+		// Keep the groups sorted by cost as they're added
+		Group group = { matcher, std::unordered_set<std::vector<unsigned char>, DataHash>() };
+		int c = cost(usage, selector, matching);
+		it = std::find_if(m_groups.begin(), m_groups.end(), [&](const Group &g) {
+			return cost(g.matcher->usage, g.matcher->selector, g.matcher->matching) > c;
+		});
+		it = m_groups.insert(it, group);
+		
+		// Indices have shifted, so start over
+		m_preferred[0] = 0;
+		m_preferred[1] = 0;
+	}
+	
+	it->data.insert(canonical.data().toVector());
+}
+
+void DANERecordSet::clear()
+{
+	m_records.clear();
+	m_groups.clear();
+	m_recordDigests.clear();
+	m_digest = sha256(m_recordDigests);
+	m_preferred[0] = 0;
+	m_preferred[1] = 0;
+}
+
+const std::vector<DANERecord>& DANERecordSet::records() const { return m_records; }
+std::size_t DANERecordSet::size() const { return m_records.size(); }
+bool DANERecordSet::empty() const { return m_records.empty(); }
+const DANERecordSet::Digest& DANERecordSet::digest() const { return m_digest; }
+
+std::uint32_t DANERecordSet::ttl() const { return m_ttl; }
+void DANERecordSet::setTTL(std::uint32_t v) { m_ttl = v; }
+
+VerdictCache *DANERecordSet::verdictCache() const { return m_verdictCache; }
+void DANERecordSet::setVerdictCache(VerdictCache *v) { m_verdictCache = v; }
+
+uint64_t DANERecordSet::verifications() const { return m_verifications; }
+uint64_t DANERecordSet::lookups() const { return m_lookups; }
+
+double DANERecordSet::averageLookups() const
+{
+	uint64_t verifications = m_verifications, lookups = m_lookups;
+	return verifications ? static_cast<double>(lookups) / verifications : 0.0;
+}
+
+void DANERecordSet::resetStats()
+{
+	m_verifications = 0;
+	m_lookups = 0;
+}
+
+
+
+bool DANERecordSet::verify(bool preverified, const VerifyContext &ctx) const
+{
+	if (m_groups.empty()) {
+		return false;
+	}
+	
+	return this->verify(preverified, ctx, ctx.depth());
+}
+
+bool DANERecordSet::verify(bool preverified, const VerifyContext &ctx, int depth) const
+{
+	if (m_groups.empty() || depth < 0 || depth >= static_cast<int>(ctx.chain().size())) {
+		return false;
+	}
+	
+	if (!m_verdictCache || m_ttl == 0 || !VerdictCache::cacheable(depth, ctx.chain())) {
+		return this->verifyUncached(preverified, ctx, depth);
+	}
+	
+	bool verdict;
+	VerdictCache::Key key = VerdictCache::makeKey(m_digest, preverified, depth, ctx.chain());
+	if (m_verdictCache->lookup(key, verdict)) {
+		return verdict;
+	}
+	
+	verdict = this->verifyUncached(preverified, ctx, depth);
+	m_verdictCache->insert(key, verdict, m_ttl);
+	return verdict;
+}
+
+bool DANERecordSet::verify(bool preverified, const Certificate &cert, const std::deque<Certificate> &chain) const
+{
+	if (chain.empty()) {
+		return false;
+	}
+	
+	bool isLeaf = cert == chain.front();
+	bool isRoot = cert == chain.back();
+	m_verifications.fetch_add(1, std::memory_order_relaxed);
+	for (std::size_t i = 0; i < m_groups.size(); ++i) {
+		if (this->verify(this->groupAt(i, isLeaf), preverified, cert, isLeaf, isRoot)) {
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+bool DANERecordSet::verifyChain(bool preverified, const std::deque<Certificate> &chain) const
+{
+	if (chain.empty() || m_groups.empty()) {
+		return false;
+	}
+	
+	// OpenSSL goes from the root down, so do the same
+	for (std::size_t i = chain.size(); i-- > 0;) {
+		const Certificate &cert = chain[i];
+		if (i + 1 < chain.size() && !cert.verify(chain[i + 1])) {
+			return false;
+		}
+		if (!this->verify(preverified, cert, chain)) {
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+
+
+bool DANERecordSet::verifyUncached(bool preverified, const VerifyContext &ctx, int depth) const
+{
+	const std::deque<Certificate> &chain = ctx.chain();
+	const Certificate &cert = chain[depth];
+	bool isLeaf = cert == chain.front();
+	bool isRoot = cert == chain.back();
+	
+	// Only the link below a passing group matters, and DomainIssuedCertificate
+	// records only depend on the leaf itself (RFC 7671, section 5.1); they're
+	// sorted first, so if the last group is one, they all are
+	bool eeOnly = m_groups.back().matcher->usage == DomainIssuedCertificate;
+	bool passed = false;
+	m_verifications.fetch_add(1, std::memory_order_relaxed);
+	for (std::size_t i = 0; i < m_groups.size(); ++i) {
+		std::size_t index = this->groupAt(i, isLeaf);
+		if (!this->verify(index, preverified, cert, isLeaf, isRoot)) {
+			continue;
+		}
+		if (m_groups[index].matcher->usage == DomainIssuedCertificate && (isLeaf || eeOnly)) {
+			return true;
+		}
+		passed = true;
+	}
+	
+	return passed && ctx.verifyIssuer(preverified, depth);
+}
+
+std::size_t DANERecordSet::groupAt(std::size_t i, bool isLeaf) const
+{
+	std::size_t preferred = m_preferred[isLeaf].load(std::memory_order_relaxed);
+	if (i == 0) {
+		return preferred;
+	}
+	return i <= preferred ? i - 1 : i;
+}
+
+bool DANERecordSet::verify(std::size_t index, bool preverified, const Certificate &cert, bool isLeaf, bool isRoot) const
+{
+	const Group &group = m_groups[index];
+	bool result;
+	if (group.matcher->decide(preverified, isLeaf, isRoot, result)) {
+		return result;
+	}
+	
+	m_lookups.fetch_add(1, std::memory_order_relaxed);
+	if (!group.data.count(group.matcher->digest(cert))) {
+		return false;
+	}
+	
+	// Don't write unless it changes, or threads sharing a set will fight
+	// over the cache line
+	std::atomic<std::size_t> &preferred = m_preferred[isLeaf];
+	if (preferred.load(std::memory_order_relaxed) != index) {
+		preferred.store(index, std::memory_order_relaxed);
+	}
+	return true;
+}
+
+std::size_t DANERecordSet::DataHash::operator()(const std::vector<unsigned char> &data) const
+{
+	std::size_t h;
+	if (data.size() >= sizeof(h)) {
+		std::memcpy(&h, data.data(), sizeof(h));
+		return h;
+	}
+	
+	// FNV-1a
+	std::uint64_t fnv = 14695981039346656037ULL;
+	for (unsigned char c : data) {
+		fnv = (fnv ^ c) * 1099511628211ULL;
+	}
+	return static_cast<std::size_t>(fnv);
+}
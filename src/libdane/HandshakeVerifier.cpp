@@ -0,0 +1,120 @@
+/**
+ * HandshakeVerifier.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/HandshakeVerifier.h>
+
+using namespace libdane;
+
+namespace
+{
+	void free_verifier(void*, void *ptr, CRYPTO_EX_DATA*, int, long, void*)
+	{
+		delete static_cast<HandshakeVerifier*>(ptr);
+	}
+	
+	int verifier_index()
+	{
+		static int idx = X509_STORE_CTX_get_ex_new_index(0, nullptr, nullptr, nullptr, free_verifier);
+		return idx;
+	}
+	
+	/**
+	 * Is a chain still the one in a context? OpenSSL may rebuild it partway,
+	 * eg. to try an alternate chain, with other certificates in the same
+	 * number of places.
+	 */
+	bool same_chain(const std::deque<Certificate> &chain, STACK_OF(X509) *live)
+	{
+		if (chain.size() != static_cast<std::size_t>(live ? sk_X509_num(live) : 0)) {
+			return false;
+		}
+		
+		// Interned certificates are different objects for the same thing
+		for (std::size_t i = 0; i < chain.size(); ++i) {
+			X509 *x509 = sk_X509_value(live, i);
+			if (chain[i].x509() != x509 && chain[i] != Certificate(x509)) {
+				return false;
+			}
+		}
+		return true;
+	}
+}
+
+bool HandshakeVerifier::verify(const DANERecordSet &set, bool preverified, X509_STORE_CTX *ctx, CertificatePool *pool)
+{
+	if (!ctx) {
+		return false;
+	}
+	
+	// Start over if the chain has changed since the last callback, which can
+	// happen if the first callback came while it was still being built
+	HandshakeVerifier *verifier = attached(ctx);
+	if (!verifier || verifier->m_set != &set || !same_chain(verifier->m_ctx.chain(), X509_STORE_CTX_get0_chain(ctx))) {
+		verifier = new HandshakeVerifier(set, VerifyContext(ctx, pool));
+		delete attached(ctx);
+		X509_STORE_CTX_set_ex_data(ctx, verifier_index(), verifier);
+	}
+	
+	return verifier->verdict(preverified);
+}
+
+HandshakeVerifier *HandshakeVerifier::attached(X509_STORE_CTX *ctx)
+{
+	return ctx ? static_cast<HandshakeVerifier*>(X509_STORE_CTX_get_ex_data(ctx, verifier_index())) : nullptr;
+}
+
+
+
+HandshakeVerifier::HandshakeVerifier(const DANERecordSet &set, const VerifyContext &ctx):
+	m_set(&set), m_ctx(ctx), m_verdicts(ctx.chain().size(), 0)
+{
+	// Preverification can only ever turn a failure into a pass, so passes
+	// are final; failures get a trusted verdict once OpenSSL vouches for them
+	for (std::size_t depth = 0; depth < m_verdicts.size(); ++depth) {
+		if (set.verify(false, m_ctx, depth)) {
+			m_verdicts[depth] = Untrusted | Trusted | Evaluated;
+		}
+	}
+}
+
+HandshakeVerifier::~HandshakeVerifier()
+{
+
+}
+
+
+
+bool HandshakeVerifier::verdict(int depth, bool preverified) const
+{
+	if (depth < 0 || depth >= static_cast<int>(m_verdicts.size())) {
+		return false;
+	}
+	
+	unsigned char &verdict = m_verdicts[depth];
+	if (preverified && !(verdict & Evaluated)) {
+		// OpenSSL calls back from the root down, so until it gets to the leaf,
+		// there are links it hasn't checked; keep those verdicts to ourselves
+		if (m_ctx.depth() == 0) {
+			verdict |= m_set->verify(true, m_ctx, depth) ? Trusted : 0;
+		} else {
+			verdict |= m_set->verifyUncached(true, m_ctx, depth) ? Trusted : 0;
+		}
+		verdict |= Evaluated;
+	}
+	
+	return verdict & (preverified ? Trusted : Untrusted);
+}
+
+bool HandshakeVerifier::verdict(bool preverified) const
+{
+	return this->verdict(m_ctx.depth(), preverified);
+}
+
+
+
+const DANERecordSet &HandshakeVerifier::set() const { return *m_set; }
+const VerifyContext &HandshakeVerifier::context() const { return m_ctx; }
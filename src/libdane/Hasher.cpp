@@ -0,0 +1,107 @@
+/**
+ * Hasher.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/Hasher.h>
+#include <stdexcept>
+
+using namespace libdane;
+
+const EVP_MD *libdane::internal::fetched_md(const EVP_MD *md)
+{
+#if OPENSSL_VERSION_NUMBER >= 0x30000000L
+	struct Fetched
+	{
+		EVP_MD *sha256 = EVP_MD_fetch(nullptr, "SHA256", nullptr);
+		EVP_MD *sha512 = EVP_MD_fetch(nullptr, "SHA512", nullptr);
+		
+		~Fetched()
+		{
+			EVP_MD_free(sha256);
+			EVP_MD_free(sha512);
+		}
+	};
+	static const Fetched fetched;
+	
+	// Fall back to implicit fetching if the explicit one failed
+	if (md == EVP_sha256() && fetched.sha256) {
+		return fetched.sha256;
+	}
+	if (md == EVP_sha512() && fetched.sha512) {
+		return fetched.sha512;
+	}
+#endif
+	return md;
+}
+
+EVP_MD_CTX *libdane::internal::digest_context()
+{
+	struct Context
+	{
+		EVP_MD_CTX *ctx = EVP_MD_CTX_create();
+		
+		~Context()
+		{
+			EVP_MD_CTX_destroy(ctx);
+		}
+	};
+	static thread_local Context context;
+	
+	if (!context.ctx) {
+		throw std::runtime_error("Failed to create a hash context; out of memory?");
+	}
+	return context.ctx;
+}
+
+
+
+Hasher::Hasher(const EVP_MD *type):
+	m_ctx(EVP_MD_CTX_create()), m_owned(true)
+{
+	// The non-_ex version resets the context, throwing away what's reused
+	if (!m_ctx || !EVP_DigestInit_ex(m_ctx, internal::fetched_md(type), nullptr)) {
+		EVP_MD_CTX_destroy(m_ctx);
+		throw std::runtime_error("Failed to initialize a hash context");
+	}
+}
+
+Hasher::Hasher(const EVP_MD *type, EVP_MD_CTX *ctx):
+	m_ctx(ctx), m_owned(false)
+{
+	if (!EVP_DigestInit_ex(m_ctx, internal::fetched_md(type), nullptr)) {
+		throw std::runtime_error("Failed to initialize a hash context");
+	}
+}
+
+Hasher::~Hasher()
+{
+	if (m_owned) {
+		EVP_MD_CTX_destroy(m_ctx);
+	}
+}
+
+
+
+void Hasher::update(const void *data, std::size_t size)
+{
+	if (size > 0 && !EVP_DigestUpdate(m_ctx, data, size)) {
+		throw std::runtime_error("Failed to feed data to the hash context; out of memory?");
+	}
+}
+
+std::size_t Hasher::final(unsigned char *out)
+{
+	unsigned int len;
+	if (!EVP_DigestFinal_ex(m_ctx, out, &len)) {
+		throw std::runtime_error("Failed to finalize the hash");
+	}
+	return len;
+}
+
+std::size_t Hasher::size() const
+{
+	return EVP_MD_CTX_size(m_ctx);
+}
@@ -0,0 +1,45 @@
+/**
+ * Matcher.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/Matcher.h>
+
+using namespace libdane;
+
+#define LIBDANE_MATCHER(U, S, M) { U, S, M, \
+	&Matcher<U, S, M>::digest, &Matcher<U, S, M>::decide, \
+	&Matcher<U, S, M>::match, &Matcher<U, S, M>::verify }
+
+#define LIBDANE_MATCHERS_FOR_SELECTOR(U, S) { \
+	LIBDANE_MATCHER(U, S, ExactMatch), \
+	LIBDANE_MATCHER(U, S, SHA256Hash), \
+	LIBDANE_MATCHER(U, S, SHA512Hash) }
+
+#define LIBDANE_MATCHERS_FOR_USAGE(U) { \
+	LIBDANE_MATCHERS_FOR_SELECTOR(U, FullCertificate), \
+	LIBDANE_MATCHERS_FOR_SELECTOR(U, SubjectPublicKeyInfo) }
+
+namespace
+{
+	/// Indexed by [Usage][Selector][MatchingType]
+	const MatcherFunctions matchers[4][2][3] = {
+		LIBDANE_MATCHERS_FOR_USAGE(CAConstraints),
+		LIBDANE_MATCHERS_FOR_USAGE(ServiceCertificateConstraint),
+		LIBDANE_MATCHERS_FOR_USAGE(TrustAnchorAssertion),
+		LIBDANE_MATCHERS_FOR_USAGE(DomainIssuedCertificate),
+	};
+}
+
+const MatcherFunctions *libdane::matcher_for(Usage usage, Selector selector, MatchingType matching)
+{
+	if (static_cast<unsigned>(usage) > DomainIssuedCertificate ||
+			static_cast<unsigned>(selector) > SubjectPublicKeyInfo ||
+			static_cast<unsigned>(matching) > SHA512Hash) {
+		return nullptr;
+	}
+	
+	return &matchers[usage][selector][matching];
+}
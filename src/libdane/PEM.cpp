@@ -0,0 +1,140 @@
+/**
+ * PEM.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/PEM.h>
+#include <cstring>
+
+using namespace libdane;
+
+namespace
+{
+	const char pem_dashes[] = "-----";
+	const std::size_t pem_dashes_len = sizeof(pem_dashes) - 1;
+	
+	enum : signed char {
+		B64_INVALID = -1,
+		B64_SPACE = -2,
+		B64_PAD = -3,
+	};
+	
+	/**
+	 * Lookup table for base64 characters.
+	 */
+	struct Base64Table
+	{
+		signed char values[256];
+		
+		Base64Table()
+		{
+			std::memset(values, B64_INVALID, sizeof(values));
+			
+			const char *alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+			for (int i = 0; i < 64; ++i) {
+				values[static_cast<unsigned char>(alphabet[i])] = i;
+			}
+			
+			values[static_cast<unsigned char>(' ')] = B64_SPACE;
+			values[static_cast<unsigned char>('\t')] = B64_SPACE;
+			values[static_cast<unsigned char>('\r')] = B64_SPACE;
+			values[static_cast<unsigned char>('\n')] = B64_SPACE;
+			values[static_cast<unsigned char>('=')] = B64_PAD;
+		}
+	};
+	
+	const Base64Table base64_table;
+	
+	/**
+	 * Finds a "-----BEGIN label-----" or "-----END label-----" line.
+	 * 
+	 * @return Pointer to the start of the line, or nullptr
+	 */
+	const char *find_boundary(const char *begin, const char *end, const char *kind, const char *label, const char *&after)
+	{
+		std::size_t kind_len = std::strlen(kind);
+		std::size_t label_len = std::strlen(label);
+		std::size_t len = pem_dashes_len + kind_len + label_len + pem_dashes_len;
+		
+		const char *it = begin;
+		while (static_cast<std::size_t>(end - it) >= len) {
+			it = static_cast<const char*>(std::memchr(it, '-', (end - it) - len + 1));
+			if (!it) {
+				return nullptr;
+			}
+			
+			const char *p = it;
+			if (std::memcmp(p, pem_dashes, pem_dashes_len) == 0 &&
+					std::memcmp(p += pem_dashes_len, kind, kind_len) == 0 &&
+					std::memcmp(p += kind_len, label, label_len) == 0 &&
+					std::memcmp(p += label_len, pem_dashes, pem_dashes_len) == 0) {
+				after = p + pem_dashes_len;
+				return it;
+			}
+			
+			++it;
+		}
+		
+		return nullptr;
+	}
+}
+
+const char* libdane::pem_find(const char *begin, const char *end, const char *label, const char *&bodyBegin, const char *&bodyEnd)
+{
+	const char *after;
+	if (!find_boundary(begin, end, "BEGIN ", label, after)) {
+		return nullptr;
+	}
+	bodyBegin = after;
+	
+	const char *endLine = find_boundary(bodyBegin, end, "END ", label, after);
+	if (!endLine) {
+		return nullptr;
+	}
+	bodyEnd = endLine;
+	
+	return after;
+}
+
+bool libdane::base64_decode(const char *begin, const char *end, std::vector<unsigned char> &out)
+{
+	out.reserve(out.size() + (end - begin) / 4 * 3);
+	
+	unsigned int acc = 0;
+	int bits = 0;
+	int padding = 0;
+	for (const char *it = begin; it != end; ++it) {
+		signed char v = base64_table.values[static_cast<unsigned char>(*it)];
+		if (v >= 0) {
+			// Nothing may follow padding
+			if (padding) {
+				return false;
+			}
+			
+			acc = (acc << 6) | v;
+			bits += 6;
+			if (bits >= 8) {
+				bits -= 8;
+				out.push_back(static_cast<unsigned char>(acc >> bits));
+			}
+		} else if (v == B64_PAD) {
+			if (++padding > 2) {
+				return false;
+			}
+		} else if (v != B64_SPACE) {
+			return false;
+		}
+	}
+	
+	// Leftover bits must be zero, and padding must fill out the last quantum
+	if (bits >= 6 || (acc & ((1u << bits) - 1)) != 0) {
+		return false;
+	}
+	if (padding && padding != bits / 2) {
+		return false;
+	}
+	
+	return true;
+}
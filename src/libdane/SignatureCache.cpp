@@ -0,0 +1,111 @@
+/**
+ * SignatureCache.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/SignatureCache.h>
+#include <libdane/Certificate.h>
+#include <algorithm>
+
+using namespace libdane;
+
+SignatureCache& SignatureCache::shared()
+{
+	static SignatureCache cache;
+	return cache;
+}
+
+
+
+SignatureCache::SignatureCache(std::size_t capacity):
+	m_cache(capacity), m_hits(0), m_misses(0)
+{
+	
+}
+
+SignatureCache::~SignatureCache()
+{
+	
+}
+
+
+
+bool SignatureCache::contains(const Certificate &subject, const Certificate &issuer)
+{
+	Key key;
+	bool found = false;
+	if (makeKey(subject, issuer, key)) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		found = m_cache.get(key) != nullptr;
+	}
+	
+	++(found ? m_hits : m_misses);
+	return found;
+}
+
+void SignatureCache::insert(const Certificate &subject, const Certificate &issuer)
+{
+	Key key;
+	if (makeKey(subject, issuer, key)) {
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_cache.put(key, true);
+	}
+}
+
+void SignatureCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache.clear();
+	m_hits = 0;
+	m_misses = 0;
+}
+
+
+
+std::size_t SignatureCache::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cache.size();
+}
+
+std::size_t SignatureCache::capacity() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cache.capacity();
+}
+
+void SignatureCache::setCapacity(std::size_t v)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache.setCapacity(v);
+}
+
+uint64_t SignatureCache::hits() const { return m_hits; }
+uint64_t SignatureCache::misses() const { return m_misses; }
+
+uint64_t SignatureCache::evictions() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cache.evictions();
+}
+
+
+
+bool SignatureCache::makeKey(const Certificate &subject, const Certificate &issuer, Key &key)
+{
+	if (!subject || !issuer) {
+		return false;
+	}
+	
+	const std::vector<unsigned char> &issuer_digest = issuer.digest(SubjectPublicKeyInfo, SHA256Hash);
+	const std::vector<unsigned char> &subject_digest = subject.digest(FullCertificate, SHA256Hash);
+	if (issuer_digest.size() + subject_digest.size() != key.size()) {
+		return false;
+	}
+	
+	auto it = std::copy(issuer_digest.begin(), issuer_digest.end(), key.begin());
+	std::copy(subject_digest.begin(), subject_digest.end(), it);
+	return true;
+}
@@ -0,0 +1,627 @@
+/**
+ * Util.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/Util.h>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__) && (defined(__GNUC__) || defined(__clang__))
+#define LIBDANE_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+#include <cstdint>
+#include <cstring>
+
+using namespace libdane;
+
+namespace
+{
+	const char digits[] = "0123456789abcdef";
+	
+	/// Maps characters to their values, or 0xFF for non-hex characters
+	struct DecodeTable
+	{
+		unsigned char values[256];
+		
+		DecodeTable()
+		{
+			std::fill(values, values + sizeof(values), 0xFF);
+			for (int i = 0; i < 10; ++i) {
+				values['0' + i] = i;
+			}
+			for (int i = 0; i < 6; ++i) {
+				values['a' + i] = 10 + i;
+				values['A' + i] = 10 + i;
+			}
+		}
+	};
+	
+	const DecodeTable decodeTable;
+	
+	
+	
+	void encode_scalar(const unsigned char *in, std::size_t size, char *out)
+	{
+		for (std::size_t i = 0; i < size; ++i) {
+			out[i * 2] = digits[in[i] >> 4];
+			out[i * 2 + 1] = digits[in[i] & 0x0F];
+		}
+	}
+	
+	bool decode_scalar(const char *in, std::size_t size, unsigned char *out)
+	{
+		// Accumulate invalid characters, rather than branching on every one
+		unsigned char invalid = 0;
+		for (std::size_t i = 0; i < size; ++i) {
+			unsigned char hi = decodeTable.values[static_cast<unsigned char>(in[i * 2])];
+			unsigned char lo = decodeTable.values[static_cast<unsigned char>(in[i * 2 + 1])];
+			invalid |= (hi | lo) & 0xF0;
+			out[i] = static_cast<unsigned char>((hi << 4) | (lo & 0x0F));
+		}
+		return invalid == 0;
+	}
+
+
+
+#ifdef LIBDANE_X86
+	/// Converts nibbles to lowercase hex digits
+	inline __m128i nibbles_to_ascii(__m128i n)
+	{
+		__m128i letters = _mm_cmpgt_epi8(n, _mm_set1_epi8(9));
+		return _mm_add_epi8(_mm_add_epi8(n, _mm_set1_epi8('0')), _mm_and_si128(letters, _mm_set1_epi8('a' - '0' - 10)));
+	}
+	
+	/// Converts hex digits to nibbles; clears valid if any of them aren't
+	inline __m128i ascii_to_nibbles(__m128i c, __m128i &valid)
+	{
+		// Saturating unsigned subtraction makes for an unsigned <= compare
+		__m128i zero = _mm_setzero_si128();
+		__m128i d = _mm_sub_epi8(c, _mm_set1_epi8('0'));
+		__m128i l = _mm_sub_epi8(_mm_or_si128(c, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+		__m128i isDigit = _mm_cmpeq_epi8(_mm_subs_epu8(d, _mm_set1_epi8(9)), zero);
+		__m128i isLetter = _mm_cmpeq_epi8(_mm_subs_epu8(l, _mm_set1_epi8(5)), zero);
+		valid = _mm_and_si128(valid, _mm_or_si128(isDigit, isLetter));
+		return _mm_or_si128(_mm_and_si128(isDigit, d), _mm_and_si128(isLetter, _mm_add_epi8(l, _mm_set1_epi8(10))));
+	}
+	
+	/// Packs pairs of nibbles into bytes, high nibble first
+	inline __m128i pack_nibbles(__m128i n)
+	{
+		__m128i hi = _mm_and_si128(_mm_slli_epi16(n, 4), _mm_set1_epi16(0x00F0));
+		__m128i lo = _mm_srli_epi16(n, 8);
+		return _mm_or_si128(hi, lo);
+	}
+	
+	void encode_sse2(const unsigned char *in, std::size_t size, char *out)
+	{
+		std::size_t i = 0;
+		for (; i + 16 <= size; i += 16) {
+			__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i));
+			__m128i hi = nibbles_to_ascii(_mm_and_si128(_mm_srli_epi16(bytes, 4), _mm_set1_epi8(0x0F)));
+			__m128i lo = nibbles_to_ascii(_mm_and_si128(bytes, _mm_set1_epi8(0x0F)));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2), _mm_unpacklo_epi8(hi, lo));
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i * 2 + 16), _mm_unpackhi_epi8(hi, lo));
+		}
+		encode_scalar(in + i, size - i, out + i * 2);
+	}
+	
+	bool decode_sse2(const char *in, std::size_t size, unsigned char *out)
+	{
+		__m128i valid = _mm_set1_epi8(-1);
+		std::size_t i = 0;
+		for (; i + 16 <= size; i += 16) {
+			__m128i a = ascii_to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2)), valid);
+			__m128i b = ascii_to_nibbles(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + i * 2 + 16)), valid);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_packus_epi16(pack_nibbles(a), pack_nibbles(b)));
+		}
+		return _mm_movemask_epi8(valid) == 0xFFFF && decode_scalar(in + i * 2, size - i, out + i);
+	}
+	
+	
+	
+	__attribute__((target("avx2")))
+	inline __m256i nibbles_to_ascii_avx2(__m256i n)
+	{
+		__m256i letters = _mm256_cmpgt_epi8(n, _mm256_set1_epi8(9));
+		return _mm256_add_epi8(_mm256_add_epi8(n, _mm256_set1_epi8('0')), _mm256_and_si256(letters, _mm256_set1_epi8('a' - '0' - 10)));
+	}
+	
+	__attribute__((target("avx2")))
+	inline __m256i ascii_to_nibbles_avx2(__m256i c, __m256i &valid)
+	{
+		__m256i zero = _mm256_setzero_si256();
+		__m256i d = _mm256_sub_epi8(c, _mm256_set1_epi8('0'));
+		__m256i l = _mm256_sub_epi8(_mm256_or_si256(c, _mm256_set1_epi8(0x20)), _mm256_set1_epi8('a'));
+		__m256i isDigit = _mm256_cmpeq_epi8(_mm256_subs_epu8(d, _mm256_set1_epi8(9)), zero);
+		__m256i isLetter = _mm256_cmpeq_epi8(_mm256_subs_epu8(l, _mm256_set1_epi8(5)), zero);
+		valid = _mm256_and_si256(valid, _mm256_or_si256(isDigit, isLetter));
+		return _mm256_or_si256(_mm256_and_si256(isDigit, d), _mm256_and_si256(isLetter, _mm256_add_epi8(l, _mm256_set1_epi8(10))));
+	}
+	
+	__attribute__((target("avx2")))
+	inline __m256i pack_nibbles_avx2(__m256i n)
+	{
+		__m256i hi = _mm256_and_si256(_mm256_slli_epi16(n, 4), _mm256_set1_epi16(0x00F0));
+		__m256i lo = _mm256_srli_epi16(n, 8);
+		return _mm256_or_si256(hi, lo);
+	}
+	
+	__attribute__((target("avx2")))
+	void encode_avx2(const unsigned char *in, std::size_t size, char *out)
+	{
+		std::size_t i = 0;
+		for (; i + 32 <= size; i += 32) {
+			__m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+			__m256i hi = nibbles_to_ascii_avx2(_mm256_and_si256(_mm256_srli_epi16(bytes, 4), _mm256_set1_epi8(0x0F)));
+			__m256i lo = nibbles_to_ascii_avx2(_mm256_and_si256(bytes, _mm256_set1_epi8(0x0F)));
+			
+			// Unpacking works within 128-bit lanes, so put the lanes back in order
+			__m256i a = _mm256_unpacklo_epi8(hi, lo);
+			__m256i b = _mm256_unpackhi_epi8(hi, lo);
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 2), _mm256_permute2x128_si256(a, b, 0x20));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i * 2 + 32), _mm256_permute2x128_si256(a, b, 0x31));
+		}
+		encode_sse2(in + i, size - i, out + i * 2);
+	}
+	
+	__attribute__((target("avx2")))
+	bool decode_avx2(const char *in, std::size_t size, unsigned char *out)
+	{
+		__m256i valid = _mm256_set1_epi8(-1);
+		std::size_t i = 0;
+		for (; i + 32 <= size; i += 32) {
+			__m256i a = ascii_to_nibbles_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 2)), valid);
+			__m256i b = ascii_to_nibbles_avx2(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i * 2 + 32)), valid);
+			
+			// Packing works within 128-bit lanes too
+			__m256i packed = _mm256_packus_epi16(pack_nibbles_avx2(a), pack_nibbles_avx2(b));
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), _mm256_permute4x64_epi64(packed, 0xD8));
+		}
+		return _mm256_movemask_epi8(valid) == -1 && decode_sse2(in + i * 2, size - i, out + i);
+	}
+#endif
+	
+	
+	
+	const internal::HexKernel scalarKernel = { "scalar", encode_scalar, decode_scalar };
+#ifdef LIBDANE_X86
+	const internal::HexKernel sse2Kernel = { "sse2", encode_sse2, decode_sse2 };
+	const internal::HexKernel avx2Kernel = { "avx2", encode_avx2, decode_avx2 };
+#endif
+	
+	
+	
+	/// SHA-512 round constants; SHA-256's are the top halves of the first 64
+	const std::uint64_t sha512K[80] = {
+		0x428a2f98d728ae22, 0x7137449123ef65cd, 0xb5c0fbcfec4d3b2f, 0xe9b5dba58189dbbc,
+		0x3956c25bf348b538, 0x59f111f1b605d019, 0x923f82a4af194f9b, 0xab1c5ed5da6d8118,
+		0xd807aa98a3030242, 0x12835b0145706fbe, 0x243185be4ee4b28c, 0x550c7dc3d5ffb4e2,
+		0x72be5d74f27b896f, 0x80deb1fe3b1696b1, 0x9bdc06a725c71235, 0xc19bf174cf692694,
+		0xe49b69c19ef14ad2, 0xefbe4786384f25e3, 0x0fc19dc68b8cd5b5, 0x240ca1cc77ac9c65,
+		0x2de92c6f592b0275, 0x4a7484aa6ea6e483, 0x5cb0a9dcbd41fbd4, 0x76f988da831153b5,
+		0x983e5152ee66dfab, 0xa831c66d2db43210, 0xb00327c898fb213f, 0xbf597fc7beef0ee4,
+		0xc6e00bf33da88fc2, 0xd5a79147930aa725, 0x06ca6351e003826f, 0x142929670a0e6e70,
+		0x27b70a8546d22ffc, 0x2e1b21385c26c926, 0x4d2c6dfc5ac42aed, 0x53380d139d95b3df,
+		0x650a73548baf63de, 0x766a0abb3c77b2a8, 0x81c2c92e47edaee6, 0x92722c851482353b,
+		0xa2bfe8a14cf10364, 0xa81a664bbc423001, 0xc24b8b70d0f89791, 0xc76c51a30654be30,
+		0xd192e819d6ef5218, 0xd69906245565a910, 0xf40e35855771202a, 0x106aa07032bbd1b8,
+		0x19a4c116b8d2d0c8, 0x1e376c085141ab53, 0x2748774cdf8eeb99, 0x34b0bcb5e19b48a8,
+		0x391c0cb3c5c95a63, 0x4ed8aa4ae3418acb, 0x5b9cca4f7763e373, 0x682e6ff3d6b2b8a3,
+		0x748f82ee5defb2fc, 0x78a5636f43172f60, 0x84c87814a1f0ab72, 0x8cc702081a6439ec,
+		0x90befffa23631e28, 0xa4506cebde82bde9, 0xbef9a3f7b2c67915, 0xc67178f2e372532b,
+		0xca273eceea26619c, 0xd186b8c721c0c207, 0xeada7dd6cde0eb1e, 0xf57d4f7fee6ed178,
+		0x06f067aa72176fba, 0x0a637dc5a2c898a6, 0x113f9804bef90dae, 0x1b710b35131c471b,
+		0x28db77f523047d84, 0x32caab7b40c72493, 0x3c9ebe0a15c9bebc, 0x431d67c49c100d4c,
+		0x4cc5d4becb3e42b6, 0x597f299cfc657e2a, 0x5fcb6fab3ad6faec, 0x6c44198c4a475817,
+	};
+	
+	/// SHA-512 initial state; SHA-256's is the top halves
+	const std::uint64_t sha512IV[8] = {
+		0x6a09e667f3bcc908, 0xbb67ae8584caa73b, 0x3c6ef372fe94f82b, 0xa54ff53a5f1d36f1,
+		0x510e527fade682d1, 0x9b05688c2b3e6c1f, 0x1f83d9abfb41bd6b, 0x5be0cd19137e2179,
+	};
+	
+	/// SHA-256 constants, derived from SHA-512's
+	struct Sha256Constants
+	{
+		std::uint32_t k[64];
+		std::uint32_t iv[8];
+		
+		Sha256Constants()
+		{
+			for (int i = 0; i < 64; ++i) {
+				k[i] = static_cast<std::uint32_t>(sha512K[i] >> 32);
+			}
+			for (int i = 0; i < 8; ++i) {
+				iv[i] = static_cast<std::uint32_t>(sha512IV[i] >> 32);
+			}
+		}
+	};
+	
+	const Sha256Constants sha256;
+	
+	/// Lanes past the end of a batch hash this instead of reading past it
+	const unsigned char zeroBlock[128] = {};
+	
+	inline std::uint32_t load_be32(const unsigned char *p)
+	{
+		return (std::uint32_t(p[0]) << 24) | (std::uint32_t(p[1]) << 16) | (std::uint32_t(p[2]) << 8) | std::uint32_t(p[3]);
+	}
+	
+	inline std::uint64_t load_be64(const unsigned char *p)
+	{
+		return (std::uint64_t(load_be32(p)) << 32) | load_be32(p + 4);
+	}
+	
+	inline void store_be32(unsigned char *p, std::uint32_t v)
+	{
+		p[0] = v >> 24;
+		p[1] = v >> 16;
+		p[2] = v >> 8;
+		p[3] = v;
+	}
+	
+	inline void store_be64(unsigned char *p, std::uint64_t v)
+	{
+		store_be32(p, v >> 32);
+		store_be32(p + 4, static_cast<std::uint32_t>(v));
+	}
+	
+	/**
+	 * Walks a buffer as padded SHA-2 blocks.
+	 * 
+	 * Full blocks are read straight out of the buffer; the last one or two,
+	 * with the padding and the length, are built in a tail buffer.
+	 */
+	template<std::size_t BlockSize>
+	struct PaddedBlocks
+	{
+		const unsigned char *data;
+		std::size_t full;
+		std::size_t count;
+		unsigned char tail[BlockSize * 2];
+		
+		void reset(ByteView view)
+		{
+			// SHA-256 ends with a 64-bit length, SHA-512 with a 128-bit one
+			const std::size_t lengthSize = BlockSize / 8;
+			std::size_t rest = view.size() % BlockSize;
+			data = view.data();
+			full = view.size() / BlockSize;
+			count = full + (rest + 1 + lengthSize > BlockSize ? 2 : 1);
+			
+			std::memset(tail, 0, sizeof(tail));
+			if (rest > 0) {
+				std::memcpy(tail, data + full * BlockSize, rest);
+			}
+			tail[rest] = 0x80;
+			store_be64(tail + (count - full) * BlockSize - 8, static_cast<std::uint64_t>(view.size()) * 8);
+		}
+		
+		const unsigned char *block(std::size_t i) const
+		{
+			return i < full ? data + i * BlockSize : tail + (i - full) * BlockSize;
+		}
+	};
+	
+	/// Orders buffers by length, so buffers hashed side by side finish together
+	std::vector<std::size_t> by_length(const ByteView *data, std::size_t count)
+	{
+		std::vector<std::size_t> order(count);
+		for (std::size_t i = 0; i < count; ++i) {
+			order[i] = i;
+		}
+		std::stable_sort(order.begin(), order.end(), [&](std::size_t a, std::size_t b) {
+			return data[a].size() < data[b].size();
+		});
+		return order;
+	}
+	
+	void hash_openssl(const EVP_MD *md, const ByteView *data, std::size_t count, unsigned char *out)
+	{
+		std::size_t size = EVP_MD_size(md);
+		for (std::size_t i = 0; i < count; ++i) {
+			hash(md, out + i * size, data[i].begin(), data[i].end());
+		}
+	}
+	
+	
+	
+#ifdef LIBDANE_X86
+	/// OpenSSL already uses the SHA extensions for single buffers if present
+	bool cpu_supports_sha()
+	{
+		// __get_cpuid_count() only exists since GCC 7 and Clang 5
+		if (__get_cpuid_max(0, nullptr) < 7) {
+			return false;
+		}
+		
+		unsigned int eax, ebx, ecx, edx;
+		__cpuid_count(7, 0, eax, ebx, ecx, edx);
+		return ebx & (1u << 29);
+	}
+	
+	__attribute__((target("avx2")))
+	inline __m256i rotr32(__m256i x, int n)
+	{
+		return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+	}
+	
+	/**
+	 * Runs SHA-256 over a block for each of 8 buffers, one per 32-bit lane.
+	 * 
+	 * Lanes that aren't active keep their state.
+	 */
+	__attribute__((target("avx2")))
+	void sha256_avx2(__m256i *state, const unsigned char *const *blocks, __m256i active)
+	{
+		// Transpose the blocks, so each word of the schedule is one vector
+		alignas(32) std::uint32_t words[16][8];
+		for (int l = 0; l < 8; ++l) {
+			for (int t = 0; t < 16; ++t) {
+				words[t][l] = load_be32(blocks[l] + t * 4);
+			}
+		}
+		__m256i w[16];
+		for (int t = 0; t < 16; ++t) {
+			w[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words[t]));
+		}
+		
+		__m256i a = state[0], b = state[1], c = state[2], d = state[3];
+		__m256i e = state[4], f = state[5], g = state[6], h = state[7];
+#pragma GCC unroll 64
+		for (int t = 0; t < 64; ++t) {
+			if (t >= 16) {
+				__m256i w2 = w[(t - 2) % 16], w15 = w[(t - 15) % 16];
+				__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr32(w15, 7), rotr32(w15, 18)), _mm256_srli_epi32(w15, 3));
+				__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr32(w2, 17), rotr32(w2, 19)), _mm256_srli_epi32(w2, 10));
+				w[t % 16] = _mm256_add_epi32(_mm256_add_epi32(w[t % 16], s0), _mm256_add_epi32(w[(t - 7) % 16], s1));
+			}
+			
+			__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr32(e, 6), rotr32(e, 11)), rotr32(e, 25));
+			__m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+			__m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, s1), _mm256_add_epi32(ch, _mm256_add_epi32(w[t % 16], _mm256_set1_epi32(sha256.k[t]))));
+			__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr32(a, 2), rotr32(a, 13)), rotr32(a, 22));
+			__m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+			h = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi32(d, t1);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm256_add_epi32(t1, _mm256_add_epi32(s0, maj));
+		}
+		
+		__m256i result[8] = { a, b, c, d, e, f, g, h };
+		for (int i = 0; i < 8; ++i) {
+			state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi32(state[i], result[i]), active);
+		}
+	}
+	
+	__attribute__((target("avx2")))
+	void hash_sha256_avx2(const EVP_MD *md, const ByteView *data, std::size_t count, unsigned char *out)
+	{
+		std::vector<std::size_t> order = by_length(data, count);
+		PaddedBlocks<64> blocks[8];
+		for (std::size_t i = 0; i < count; i += 8) {
+			// Below half of the lanes, one buffer at a time is faster
+			std::size_t lanes = std::min<std::size_t>(count - i, 8);
+			if (lanes < 4) {
+				for (std::size_t l = 0; l < lanes; ++l) {
+					hash_openssl(md, &data[order[i + l]], 1, out + order[i + l] * 32);
+				}
+				break;
+			}
+			std::size_t longest = 0;
+			for (std::size_t l = 0; l < lanes; ++l) {
+				blocks[l].reset(data[order[i + l]]);
+				longest = std::max(longest, blocks[l].count);
+			}
+			
+			__m256i state[8];
+			for (int j = 0; j < 8; ++j) {
+				state[j] = _mm256_set1_epi32(sha256.iv[j]);
+			}
+			
+			const unsigned char *ptrs[8];
+			alignas(32) std::int32_t mask[8];
+			for (std::size_t b = 0; b < longest; ++b) {
+				for (std::size_t l = 0; l < 8; ++l) {
+					bool active = l < lanes && b < blocks[l].count;
+					ptrs[l] = active ? blocks[l].block(b) : zeroBlock;
+					mask[l] = active ? -1 : 0;
+				}
+				sha256_avx2(state, ptrs, _mm256_load_si256(reinterpret_cast<const __m256i*>(mask)));
+			}
+			
+			alignas(32) std::uint32_t words[8][8];
+			for (int j = 0; j < 8; ++j) {
+				_mm256_store_si256(reinterpret_cast<__m256i*>(words[j]), state[j]);
+			}
+			for (std::size_t l = 0; l < lanes; ++l) {
+				for (int j = 0; j < 8; ++j) {
+					store_be32(out + order[i + l] * 32 + j * 4, words[j][l]);
+				}
+			}
+		}
+	}
+	
+	
+	
+	__attribute__((target("avx2")))
+	inline __m256i rotr64(__m256i x, int n)
+	{
+		return _mm256_or_si256(_mm256_srli_epi64(x, n), _mm256_slli_epi64(x, 64 - n));
+	}
+	
+	/**
+	 * Runs SHA-512 over a block for each of 4 buffers, one per 64-bit lane.
+	 * 
+	 * Lanes that aren't active keep their state.
+	 */
+	__attribute__((target("avx2")))
+	void sha512_avx2(__m256i *state, const unsigned char *const *blocks, __m256i active)
+	{
+		alignas(32) std::uint64_t words[16][4];
+		for (int l = 0; l < 4; ++l) {
+			for (int t = 0; t < 16; ++t) {
+				words[t][l] = load_be64(blocks[l] + t * 8);
+			}
+		}
+		__m256i w[16];
+		for (int t = 0; t < 16; ++t) {
+			w[t] = _mm256_load_si256(reinterpret_cast<const __m256i*>(words[t]));
+		}
+		
+		__m256i a = state[0], b = state[1], c = state[2], d = state[3];
+		__m256i e = state[4], f = state[5], g = state[6], h = state[7];
+#pragma GCC unroll 80
+		for (int t = 0; t < 80; ++t) {
+			if (t >= 16) {
+				__m256i w2 = w[(t - 2) % 16], w15 = w[(t - 15) % 16];
+				__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr64(w15, 1), rotr64(w15, 8)), _mm256_srli_epi64(w15, 7));
+				__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr64(w2, 19), rotr64(w2, 61)), _mm256_srli_epi64(w2, 6));
+				w[t % 16] = _mm256_add_epi64(_mm256_add_epi64(w[t % 16], s0), _mm256_add_epi64(w[(t - 7) % 16], s1));
+			}
+			
+			__m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr64(e, 14), rotr64(e, 18)), rotr64(e, 41));
+			__m256i ch = _mm256_xor_si256(g, _mm256_and_si256(e, _mm256_xor_si256(f, g)));
+			__m256i t1 = _mm256_add_epi64(_mm256_add_epi64(h, s1), _mm256_add_epi64(ch, _mm256_add_epi64(w[t % 16], _mm256_set1_epi64x(sha512K[t]))));
+			__m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr64(a, 28), rotr64(a, 34)), rotr64(a, 39));
+			__m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+			h = g;
+			g = f;
+			f = e;
+			e = _mm256_add_epi64(d, t1);
+			d = c;
+			c = b;
+			b = a;
+			a = _mm256_add_epi64(t1, _mm256_add_epi64(s0, maj));
+		}
+		
+		__m256i result[8] = { a, b, c, d, e, f, g, h };
+		for (int i = 0; i < 8; ++i) {
+			state[i] = _mm256_blendv_epi8(state[i], _mm256_add_epi64(state[i], result[i]), active);
+		}
+	}
+	
+	__attribute__((target("avx2")))
+	void hash_sha512_avx2(const EVP_MD *md, const ByteView *data, std::size_t count, unsigned char *out)
+	{
+		std::vector<std::size_t> order = by_length(data, count);
+		PaddedBlocks<128> blocks[4];
+		for (std::size_t i = 0; i < count; i += 4) {
+			std::size_t lanes = std::min<std::size_t>(count - i, 4);
+			if (lanes < 2) {
+				hash_openssl(md, &data[order[i]], 1, out + order[i] * 64);
+				break;
+			}
+			std::size_t longest = 0;
+			for (std::size_t l = 0; l < lanes; ++l) {
+				blocks[l].reset(data[order[i + l]]);
+				longest = std::max(longest, blocks[l].count);
+			}
+			
+			__m256i state[8];
+			for (int j = 0; j < 8; ++j) {
+				state[j] = _mm256_set1_epi64x(sha512IV[j]);
+			}
+			
+			const unsigned char *ptrs[4];
+			alignas(32) std::int64_t mask[4];
+			for (std::size_t b = 0; b < longest; ++b) {
+				for (std::size_t l = 0; l < 4; ++l) {
+					bool active = l < lanes && b < blocks[l].count;
+					ptrs[l] = active ? blocks[l].block(b) : zeroBlock;
+					mask[l] = active ? -1 : 0;
+				}
+				sha512_avx2(state, ptrs, _mm256_load_si256(reinterpret_cast<const __m256i*>(mask)));
+			}
+			
+			alignas(32) std::uint64_t words[8][4];
+			for (int j = 0; j < 8; ++j) {
+				_mm256_store_si256(reinterpret_cast<__m256i*>(words[j]), state[j]);
+			}
+			for (std::size_t l = 0; l < lanes; ++l) {
+				for (int j = 0; j < 8; ++j) {
+					store_be64(out + order[i + l] * 64 + j * 8, words[j][l]);
+				}
+			}
+		}
+	}
+#endif
+	
+	
+	
+	const internal::HashKernel opensslHashKernel = { "openssl", NID_undef, hash_openssl };
+#ifdef LIBDANE_X86
+	const internal::HashKernel sha256Avx2Kernel = { "avx2", NID_sha256, hash_sha256_avx2 };
+	const internal::HashKernel sha512Avx2Kernel = { "avx2", NID_sha512, hash_sha512_avx2 };
+#endif
+}
+
+const internal::HexKernel &libdane::internal::hex_kernel()
+{
+	static const HexKernel &kernel = *hex_kernels().back();
+	return kernel;
+}
+
+std::vector<const internal::HexKernel*> libdane::internal::hex_kernels()
+{
+	std::vector<const HexKernel*> kernels = { &scalarKernel };
+#ifdef LIBDANE_X86
+	kernels.push_back(&sse2Kernel);
+	if (__builtin_cpu_supports("avx2")) {
+		kernels.push_back(&avx2Kernel);
+	}
+#endif
+	return kernels;
+}
+
+
+
+void libdane::hash_batch(const EVP_MD *type, const ByteView *data, std::size_t count, unsigned char *out)
+{
+	if (type == nullptr) {
+		throw std::invalid_argument("Exact matches can't be batched");
+	}
+	
+	internal::hash_kernel(type).hash(type, data, count, out);
+}
+
+const internal::HashKernel &libdane::internal::hash_kernel(const EVP_MD *md)
+{
+#ifdef LIBDANE_X86
+	static const bool avx2 = __builtin_cpu_supports("avx2");
+	static const bool sha = cpu_supports_sha();
+	
+	switch (md ? EVP_MD_type(md) : NID_undef) {
+		case NID_sha256:
+			return avx2 && !sha ? sha256Avx2Kernel : opensslHashKernel;
+		case NID_sha512:
+			return avx2 ? sha512Avx2Kernel : opensslHashKernel;
+	}
+#endif
+	return opensslHashKernel;
+}
+
+std::vector<const internal::HashKernel*> libdane::internal::hash_kernels(const EVP_MD *md)
+{
+	std::vector<const HashKernel*> kernels = { &opensslHashKernel };
+#ifdef LIBDANE_X86
+	int nid = md ? EVP_MD_type(md) : NID_undef;
+	if (__builtin_cpu_supports("avx2")) {
+		if (nid == NID_sha256) {
+			kernels.push_back(&sha256Avx2Kernel);
+		} else if (nid == NID_sha512) {
+			kernels.push_back(&sha512Avx2Kernel);
+		}
+	}
+#endif
+	return kernels;
+}
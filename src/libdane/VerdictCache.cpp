@@ -0,0 +1,155 @@
+/**
+ * VerdictCache.cpp
+ * libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/VerdictCache.h>
+#include <libdane/Certificate.h>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace libdane;
+
+VerdictCache& VerdictCache::shared()
+{
+	static VerdictCache cache;
+	return cache;
+}
+
+VerdictCache::Key VerdictCache::makeKey(const std::array<unsigned char, 32> &rrset, bool preverified, int depth, const std::deque<Certificate> &chain)
+{
+	if (depth < 0 || depth >= static_cast<int>(chain.size())) {
+		throw std::out_of_range("Depth out of range");
+	}
+	
+	const Certificate &cert = chain[depth];
+	bool isLeaf = cert == chain.front();
+	bool isRoot = cert == chain.back();
+	
+	Key key;
+	key.rrset = rrset;
+	key.cert = cert.fingerprint();
+	if (depth + 1 < static_cast<int>(chain.size())) {
+		key.issuer = chain[depth + 1].fingerprint();
+	} else {
+		key.issuer.fill(0);
+	}
+	key.flags = (preverified ? 1 : 0) | (isLeaf ? 2 : 0) | (isRoot ? 4 : 0);
+	return key;
+}
+
+bool VerdictCache::cacheable(int depth, const std::deque<Certificate> &chain)
+{
+	if (depth < 0 || depth >= static_cast<int>(chain.size())) {
+		return false;
+	}
+	
+	// The leaf and root flags compare against the ends of the chain too
+	if (!chain[depth].hasFingerprint() || !chain.front().hasFingerprint() || !chain.back().hasFingerprint()) {
+		return false;
+	}
+	return depth + 1 >= static_cast<int>(chain.size()) || chain[depth + 1].hasFingerprint();
+}
+
+
+
+VerdictCache::VerdictCache(std::size_t capacity, std::uint32_t maxTTL):
+	m_cache(capacity), m_maxTTL(maxTTL), m_hits(0), m_misses(0), m_expirations(0)
+{
+	
+}
+
+VerdictCache::~VerdictCache()
+{
+	
+}
+
+
+
+bool VerdictCache::lookup(const Key &key, bool &verdict)
+{
+	bool found = false;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		Entry *entry = m_cache.get(key);
+		if (entry && entry->expires <= this->now()) {
+			m_cache.erase(key);
+			++m_expirations;
+		} else if (entry) {
+			verdict = entry->verdict;
+			found = true;
+		}
+	}
+	
+	++(found ? m_hits : m_misses);
+	return found;
+}
+
+void VerdictCache::insert(const Key &key, bool verdict, std::uint32_t ttl)
+{
+	ttl = std::min<std::uint32_t>(ttl, m_maxTTL);
+	if (ttl == 0) {
+		return;
+	}
+	
+	Entry entry = { verdict, this->now() + std::chrono::seconds(ttl) };
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache.put(key, entry);
+}
+
+void VerdictCache::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache.clear();
+	m_hits = 0;
+	m_misses = 0;
+	m_expirations = 0;
+}
+
+
+
+std::size_t VerdictCache::size() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cache.size();
+}
+
+std::size_t VerdictCache::capacity() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cache.capacity();
+}
+
+void VerdictCache::setCapacity(std::size_t v)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_cache.setCapacity(v);
+}
+
+std::uint32_t VerdictCache::maxTTL() const { return m_maxTTL; }
+void VerdictCache::setMaxTTL(std::uint32_t v) { m_maxTTL = v; }
+
+uint64_t VerdictCache::hits() const { return m_hits; }
+uint64_t VerdictCache::misses() const { return m_misses; }
+uint64_t VerdictCache::expirations() const { return m_expirations; }
+
+uint64_t VerdictCache::evictions() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_cache.evictions();
+}
+
+double VerdictCache::hitRatio() const
+{
+	uint64_t hits = m_hits, misses = m_misses;
+	return (hits + misses) ? static_cast<double>(hits) / (hits + misses) : 0.0;
+}
+
+
+
+VerdictCache::Clock::time_point VerdictCache::now() const
+{
+	return Clock::now();
+}
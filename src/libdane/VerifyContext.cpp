@@ -9,30 +9,105 @@
 
 using namespace libdane;
 
-VerifyContext::VerifyContext(X509_STORE_CTX *ctx):
+VerifyContext::VerifyContext(X509_STORE_CTX *ctx, CertificatePool *pool):
 	m_ctx(ctx)
 {
-	m_chain_stack = X509_STORE_CTX_get1_chain(m_ctx);
-	for (int i = 0; i < sk_X509_num(m_chain_stack); ++i) {
-		X509 *cert = sk_X509_value(m_chain_stack, i);
-		m_chain.emplace_back(cert);
+	if (!m_ctx) {
+		return;
 	}
+	
+	// Certificates retain their own references, so the stack can go
+	STACK_OF(X509) *stack = X509_STORE_CTX_get1_chain(m_ctx);
+	for (int i = 0; i < sk_X509_num(stack); ++i) {
+		X509 *cert = sk_X509_value(stack, i);
+		if (pool) {
+			m_chain.push_back(pool->intern(Certificate(cert)));
+		} else {
+			m_chain.emplace_back(cert);
+		}
+	}
+	sk_X509_pop_free(stack, X509_free);
 }
 
 VerifyContext::VerifyContext(const VerifyContext &store):
-	VerifyContext(store.ctx()) {}
+	m_ctx(store.m_ctx), m_chain(store.m_chain) {}
 
 VerifyContext::~VerifyContext()
 {
-	sk_X509_pop_free(m_chain_stack, X509_free);
+	
 }
 
 
 
 X509_STORE_CTX* VerifyContext::ctx() const { return m_ctx; }
-std::deque<Certificate> VerifyContext::chain() const { return m_chain; }
+const std::deque<Certificate>& VerifyContext::chain() const { return m_chain; }
 
 Certificate VerifyContext::currentCert() const
 {
-	return X509_STORE_CTX_get_current_cert(m_ctx);
+	// Hand out the chain's own copy, which may have come from a pool
+	int depth = this->depth();
+	if (depth >= 0) {
+		return m_chain[depth];
+	}
+	
+	return m_ctx ? X509_STORE_CTX_get_current_cert(m_ctx) : nullptr;
+}
+
+int VerifyContext::depth() const
+{
+	if (!m_ctx) {
+		return -1;
+	}
+	
+	X509 *x509 = X509_STORE_CTX_get_current_cert(m_ctx);
+	if (!x509) {
+		return -1;
+	}
+	
+	Certificate current;
+	auto matches = [&](int i) {
+		if (m_chain[i].x509() == x509) {
+			return true;
+		}
+		if (!current) {
+			current = Certificate(x509);
+		}
+		return m_chain[i] == current;
+	};
+	
+	// OpenSSL knows where in the chain it is, so that's usually a direct hit
+	int count = static_cast<int>(m_chain.size());
+	int depth = X509_STORE_CTX_get_error_depth(m_ctx);
+	if (depth >= 0 && depth < count && matches(depth)) {
+		return depth;
+	}
+	
+	for (int i = 0; i < count; ++i) {
+		if (matches(i)) {
+			return i;
+		}
+	}
+	
+	return -1;
+}
+
+bool VerifyContext::verifyIssuer(bool preverified, int depth) const
+{
+	int count = static_cast<int>(m_chain.size());
+	if (depth < 0 || depth >= count) {
+		return false;
+	}
+	if (depth == count - 1) {
+		return true;
+	}
+	
+	// OpenSSL has only checked the link it's calling back about; the error
+	// sticks around after being overridden, so this is only clear if every
+	// check so far has passed on its own
+	if (preverified && m_ctx && depth == X509_STORE_CTX_get_error_depth(m_ctx) &&
+			X509_STORE_CTX_get_error(m_ctx) == X509_V_OK) {
+		return true;
+	}
+	
+	return m_chain[depth].verify(m_chain[depth + 1]);
 }
@@ -0,0 +1,190 @@
+/**
+ * ConnectionPool.cpp
+ * libdane_net
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <libdane/net/ConnectionPool.h>
+#include <algorithm>
+
+using namespace libdane;
+using namespace libdane::net;
+
+ConnectionPool::Entry::Entry(asio::io_service &service, Socket sock):
+	sock(sock), timer(service), probe(0), pooled(true)
+{
+	
+}
+
+ConnectionPool::ConnectionPool(asio::io_service &service):
+	m_service(service), m_maxIdle(4), m_idleTimeout(10000), m_keepAlive(true)
+{
+	
+}
+
+ConnectionPool::~ConnectionPool()
+{
+	this->clear();
+}
+
+
+
+std::size_t ConnectionPool::maxIdle() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_maxIdle;
+}
+
+void ConnectionPool::setMaxIdle(std::size_t v)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_maxIdle = v;
+}
+
+std::chrono::milliseconds ConnectionPool::idleTimeout() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_idleTimeout;
+}
+
+void ConnectionPool::setIdleTimeout(std::chrono::milliseconds v)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_idleTimeout = v;
+}
+
+bool ConnectionPool::keepAlive() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_keepAlive;
+}
+
+void ConnectionPool::setKeepAlive(bool v)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_keepAlive = v;
+}
+
+
+
+ConnectionPool::Socket ConnectionPool::take(const std::vector<asio::ip::tcp::endpoint> &endpoints)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (const asio::ip::tcp::endpoint &endpoint : endpoints) {
+		auto it = m_entries.find(endpoint);
+		if (it == m_entries.end() || it->second.empty()) {
+			continue;
+		}
+		
+		// The most recently used connection is the least likely to have
+		// been closed by the server
+		std::shared_ptr<Entry> entry = it->second.back();
+		it->second.pop_back();
+		entry->pooled = false;
+		
+		// Stop waiting; the handlers see that it's not pooled anymore
+		asio::error_code ignored;
+		entry->timer.cancel(ignored);
+		entry->sock->cancel(ignored);
+		return entry->sock;
+	}
+	
+	return nullptr;
+}
+
+bool ConnectionPool::put(Socket sock)
+{
+	if (!sock || !sock->is_open()) {
+		return false;
+	}
+	
+	asio::error_code err;
+	asio::ip::tcp::endpoint endpoint = sock->remote_endpoint(err);
+	if (err) {
+		return false;
+	}
+	
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::deque<std::shared_ptr<Entry>> &entries = m_entries[endpoint];
+	if (entries.size() >= m_maxIdle) {
+		sock->close(err);
+		return false;
+	}
+	
+	if (m_keepAlive) {
+		sock->set_option(asio::socket_base::keep_alive(true), err);
+	}
+	
+	auto entry = std::make_shared<Entry>(m_service, sock);
+	entries.push_back(entry);
+	
+	// The pool may be gone by the time a handler runs, but then the entry
+	// isn't pooled anymore; check that before touching it
+	entry->timer.expires_from_now(m_idleTimeout);
+	entry->timer.async_wait([this, entry](const asio::error_code &err) {
+		if (!entry->pooled || err) {
+			return;
+		}
+		
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (entry->pooled) {
+			this->drop(entry);
+		}
+	});
+	
+	// Anything arriving on an idle connection means it's been closed, or
+	// the server is confused; either way, it can't be used anymore
+	sock->async_receive(asio::buffer(&entry->probe, sizeof(entry->probe)), [this, entry](const asio::error_code &err, std::size_t size) {
+		if (!entry->pooled) {
+			return;
+		}
+		
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (entry->pooled) {
+			this->drop(entry);
+		}
+	});
+	
+	return true;
+}
+
+void ConnectionPool::clear()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::vector<std::shared_ptr<Entry>> entries;
+	for (auto &pair : m_entries) {
+		entries.insert(entries.end(), pair.second.begin(), pair.second.end());
+	}
+	for (std::shared_ptr<Entry> &entry : entries) {
+		this->drop(entry);
+	}
+	m_entries.clear();
+}
+
+std::size_t ConnectionPool::idle() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	std::size_t count = 0;
+	for (auto &pair : m_entries) {
+		count += pair.second.size();
+	}
+	return count;
+}
+
+void ConnectionPool::drop(std::shared_ptr<Entry> entry)
+{
+	entry->pooled = false;
+	
+	asio::error_code ignored;
+	entry->timer.cancel(ignored);
+	entry->sock->close(ignored);
+	
+	for (auto &pair : m_entries) {
+		auto it = std::find(pair.second.begin(), pair.second.end(), entry);
+		if (it != pair.second.end()) {
+			pair.second.erase(it);
+			break;
+		}
+	}
+}
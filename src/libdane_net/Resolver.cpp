@@ -10,6 +10,7 @@
 #include <libdane/Util.h>
 #include <libdane/net/Util.h>
 #include <algorithm>
+#include <atomic>
 #include <memory>
 #include <vector>
 #include <stdexcept>
@@ -18,8 +19,133 @@
 using namespace libdane;
 using namespace libdane::net;
 
+namespace
+{
+	/**
+	 * Does an error mean the other end closed the connection?
+	 */
+	bool is_closed(const asio::error_code &err)
+	{
+		return err == asio::error::eof ||
+			err == asio::error::connection_reset ||
+			err == asio::error::connection_aborted ||
+			err == asio::error::broken_pipe;
+	}
+	
+	/**
+	 * Returns the size of the header and question of a wire-format query.
+	 * 
+	 * Queries never use name compression, so this just skips labels; a
+	 * malformed query gives just the header.
+	 */
+	std::size_t question_size(const std::vector<unsigned char> &wire)
+	{
+		std::size_t pos = 12;
+		while (pos < wire.size() && wire[pos] != 0) {
+			pos += wire[pos] + 1;
+		}
+		pos += 1 + 4;	// Root label, type and class
+		return pos <= wire.size() ? pos : std::min<std::size_t>(wire.size(), 12);
+	}
+	
+	/**
+	 * Returns a random query ID that isn't already taken.
+	 */
+	uint16_t unique_id(const std::map<uint16_t, std::size_t> &taken)
+	{
+		uint16_t id;
+		do {
+			id = ldns_get_random();
+		} while (taken.count(id));
+		return id;
+	}
+	
+	/**
+	 * A single UDP query and response, with a timeout.
+	 * 
+	 * Whichever of the response, an error or the timer comes first finishes
+	 * the exchange; anything after that is ignored.
+	 */
+	struct UDPExchange: std::enable_shared_from_this<UDPExchange>
+	{
+		std::shared_ptr<asio::ip::udp::socket> sock;
+		std::vector<unsigned char> &buffer;
+		std::size_t maxSize;
+		std::function<void(const asio::error_code &err)> cb;
+		
+		asio::steady_timer timer;
+		std::vector<unsigned char> query;
+		bool done;
+		
+		UDPExchange(asio::io_service &service, std::shared_ptr<asio::ip::udp::socket> sock, std::vector<unsigned char> &buffer, std::size_t maxSize, std::function<void(const asio::error_code &err)> cb):
+			sock(sock), buffer(buffer), maxSize(maxSize), cb(cb),
+			timer(service), query(buffer.begin(), buffer.begin() + question_size(buffer)), done(false)
+		{
+			
+		}
+		
+		/// Does a received datagram answer the query?
+		bool matches(std::size_t size) const
+		{
+			if (size < query.size() || query.size() < 2) {
+				return false;
+			}
+			
+			// Responses echo the query's ID and question
+			return std::equal(query.begin(), query.begin() + 2, buffer.begin()) &&
+				(query.size() <= 12 || std::equal(query.begin() + 12, query.end(), buffer.begin() + 12));
+		}
+		
+		void receive()
+		{
+			// One byte of slack tells a response that fills the buffer
+			// exactly from one that was cut off
+			buffer.resize(maxSize + 1);
+			
+			auto self = this->shared_from_this();
+			sock->async_receive(asio::buffer(buffer), [self](const asio::error_code &err, std::size_t size) {
+				if (self->done) {
+					return;
+				}
+				if (err) {
+					self->finish(err);
+					return;
+				}
+				
+				// Stray datagrams, eg. late responses to an earlier query
+				if (!self->matches(size)) {
+					self->receive();
+					return;
+				}
+				if (size > self->maxSize) {
+					self->finish(asio::error::message_size);
+					return;
+				}
+				
+				self->buffer.resize(size);
+				self->finish({});
+			});
+		}
+		
+		void finish(const asio::error_code &err)
+		{
+			if (done) {
+				return;
+			}
+			done = true;
+			
+			asio::error_code ignored;
+			timer.cancel(ignored);
+			if (err) {
+				sock->cancel(ignored);
+			}
+			cb(err);
+		}
+	};
+}
+
 Resolver::Resolver(asio::io_service &service):
-	m_service(service)
+	m_service(service), m_pool(service)
 {
 	
 }
@@ -37,6 +163,8 @@ const ResolverConfig& Resolver::config() const { return m_config; }
 ResolverConfig& Resolver::config() { return m_config; }
 void Resolver::setConfig(const ResolverConfig& v) { m_config = v; }
 
+ConnectionPool& Resolver::pool() { return m_pool; }
+
 
 
 std::vector<DANERecord> Resolver::decodeTLSA(std::shared_ptr<ldns_pkt> pkt)
@@ -48,7 +176,14 @@ std::vector<DANERecord> Resolver::decodeTLSA(std::shared_ptr<ldns_pkt> pkt)
 	
 	for (size_t i = 0; i < ldns_rr_list_rr_count(&*tlsas); ++i) {
 		ldns_rr *tlsa = ldns_rr_list_rr(&*tlsas, i);
-		records.push_back(record_from_tlsa(tlsa));
+		if (ldns_rr_rd_count(tlsa) != 4) {
+			continue;
+		}
+		
+		DANERecord rec = record_from_tlsa(tlsa);
+		if (rec.usable()) {
+			records.push_back(std::move(rec));
+		}
 	}
 	
 	return records;
@@ -58,11 +193,12 @@ std::shared_ptr<ldns_pkt> Resolver::makeQuery(const std::string &domain, ldns_rr
 {
 	ldns_rdf *dname = ldns_dname_new_frm_str(domain.c_str());
 	std::shared_ptr<ldns_pkt> pkt(ldns_pkt_query_new(dname, rr_type, rr_class, flags), ldns_pkt_free);
-	ldns_pkt_set_edns_do(&*pkt, 1);
 	if (!pkt) {
 		throw std::runtime_error("Couldn't create a query packet");
 	}
-	ldns_pkt_set_id(&*pkt, 1337);
+	ldns_pkt_set_edns_do(&*pkt, 1);
+	ldns_pkt_set_edns_udp_size(&*pkt, m_config.ednsBufferSize());
+	ldns_pkt_set_random_id(&*pkt);
 	
 	return pkt;
 }
@@ -106,14 +242,21 @@ void Resolver::query(std::vector<std::shared_ptr<ldns_pkt>> pkts, MultiQueryCall
 {
 	if (!pkts.size()) {
 		cb({}, {}, {});
+		return;
 	}
 	
 	auto ctx = std::make_shared<ConnectionContext>();
 	ctx->pkts = pkts;
 	ctx->it = ctx->pkts.begin();
-	this->connect(m_config, [=](const asio::error_code &err, std::shared_ptr<asio::ip::tcp::socket> sock) {
-		this->sendQueryChain(sock, ctx, cb);
-	});
+	if (m_config.forceTCP()) {
+		this->queryTCP(ctx, cb);
+		return;
+	}
+	
+	ctx->pending = ctx->pkts.size();
+	for (std::size_t i = 0; i < ctx->pkts.size(); ++i) {
+		this->queryUDP(ctx, i, 0, cb);
+	}
 }
 
 void Resolver::query(std::shared_ptr<ldns_pkt> pkt, QueryCallback cb)
@@ -160,7 +303,26 @@ void Resolver::connect(const ResolverConfig &conf, std::function<void(const asio
 {
 	auto sock = std::make_shared<asio::ip::tcp::socket>(m_service);
 	auto endpoints = conf.endpoints();
+	
+	// The OS can take minutes to give up on a nameserver that drops packets
+	auto timer = std::make_shared<asio::steady_timer>(m_service);
+	auto expired = std::make_shared<std::atomic<bool>>(false);
+	timer->expires_from_now(conf.timeout());
+	timer->async_wait([sock, expired](const asio::error_code &err) {
+		if (!err) {
+			*expired = true;
+			asio::error_code ignored;
+			sock->close(ignored);
+		}
+	});
+	
 	async_connect(*sock, endpoints.begin(), endpoints.end(), [=](const asio::error_code &err, std::vector<asio::ip::tcp::endpoint>::const_iterator it) {
+		asio::error_code ignored;
+		timer->cancel(ignored);
+		if (*expired) {
+			cb(asio::error::timed_out, nullptr);
+			return;
+		}
 		if (err) {
 			cb(err, nullptr);
 			return;
@@ -172,66 +334,340 @@ void Resolver::connect(const ResolverConfig &conf, std::function<void(const asio
 
 void Resolver::sendQueryChain(std::shared_ptr<asio::ip::tcp::socket> sock, std::shared_ptr<ConnectionContext> ctx, MultiQueryCallback cb)
 {
-	ctx->buffer = this->wire(*ctx->it, true);
-	this->sendQuery(sock, ctx->buffer, [=](const asio::error_code &err) mutable {
+	std::unique_lock<std::mutex> lock(ctx->mutex);
+	ctx->answered.resize(ctx->pkts.size(), false);
+	ctx->questions.resize(ctx->pkts.size());
+	ctx->inflight.clear();
+	ctx->queries.clear();
+	
+	for (std::size_t i = 0; i < ctx->pkts.size(); ++i) {
+		if (ctx->answered[i]) {
+			continue;
+		}
+		
+		// IDs are assigned on the wire, so the caller's packets aren't
+		// touched, and two queries in a batch can never share one
+		std::vector<unsigned char> wire = this->wire(ctx->pkts[i], true);
+		uint16_t id = unique_id(ctx->inflight);
+		wire[2] = id >> 8;
+		wire[3] = id & 0xFF;
+		ctx->inflight[id] = i;
+		
+		ctx->questions[i].assign(wire.begin() + 2, wire.end());
+		ctx->questions[i].resize(question_size(ctx->questions[i]));
+		ctx->queries.insert(ctx->queries.end(), wire.begin(), wire.end());
+	}
+	
+	if (ctx->inflight.empty()) {
+		lock.unlock();
+		this->finishQueries(ctx, cb);
+		return;
+	}
+	
+	unsigned int chain = ctx->chain;
+	ctx->deadline = std::make_shared<asio::steady_timer>(m_service);
+	ctx->deadline->expires_from_now(m_config.timeout());
+	ctx->deadline->async_wait([=](const asio::error_code &err) {
 		if (err) {
-			cb(err, {}, {});
 			return;
 		}
 		
-		*(ctx->it) = this->unwire(ctx->buffer.begin(), ctx->buffer.end());
-		++(ctx->it);
-		if (ctx->it == ctx->pkts.end()) {
-			std::vector<bool> dnssec;
-			dnssec.reserve(ctx->pkts.size());
-			for (auto pkt : ctx->pkts) {
-				dnssec.push_back(this->verifyDNSSEC(pkt));
+		{
+			std::lock_guard<std::mutex> lock(ctx->mutex);
+			if (!this->endQueryChain(sock, ctx, chain, true)) {
+				return;
 			}
-			cb({}, ctx->pkts, dnssec);
+		}
+		cb(asio::error::timed_out, {}, {});
+	});
+	lock.unlock();
+	
+	// Start reading right away; a server may answer the first queries
+	// before it's read the last ones, and waiting for the write to finish
+	// could leave both ends stuck with full buffers. Whichever side fails
+	// first ends the chain, so the other can't touch ctx after a retry
+	this->sendQueries(sock, ctx->queries, [=](const asio::error_code &err) {
+		if (!err) {
 			return;
 		}
 		
-		this->sendQueryChain(sock, ctx, cb);
+		{
+			std::lock_guard<std::mutex> lock(ctx->mutex);
+			if (!this->endQueryChain(sock, ctx, chain, true)) {
+				return;
+			}
+		}
+		cb(err, {}, {});
+	});
+	this->receiveResponses(sock, ctx, chain, cb);
+}
+
+void Resolver::sendQueries(std::shared_ptr<asio::ip::tcp::socket> sock, const std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
+{
+	asio::async_write(*sock, asio::buffer(buffer), [sock, cb](const asio::error_code &err, std::size_t size) {
+		cb(err);
 	});
 }
 
-void Resolver::sendQuery(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
+void Resolver::receiveResponse(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
 {
-	sock->async_send(asio::buffer(buffer), [sock, &buffer, cb](const asio::error_code &err, std::size_t size) mutable {
+	// A connection carries several responses back to back, so this has to
+	// read exactly one message's worth, and nothing more
+	buffer.resize(sizeof(uint16_t));
+	asio::async_read(*sock, asio::buffer(buffer), [sock, &buffer, cb](const asio::error_code &err, std::size_t size) {
 		if (err) {
 			cb(err);
 			return;
 		}
 		
-		buffer.resize(sizeof(uint16_t));
-		sock->async_receive(asio::buffer(buffer), [sock, &buffer, cb](const asio::error_code &err, std::size_t size) mutable {
-			if (err) {
-				cb(err);
+		uint16_t len;
+		std::copy(buffer.begin(), buffer.end(), reinterpret_cast<unsigned char*>(&len));
+		
+		len = ntohs(len);
+		buffer.resize(len);
+		
+		asio::async_read(*sock, asio::buffer(buffer), [sock, &buffer, cb](const asio::error_code &err, std::size_t size) {
+			cb(err);
+		});
+	});
+}
+
+void Resolver::receiveResponses(std::shared_ptr<asio::ip::tcp::socket> sock, std::shared_ptr<ConnectionContext> ctx, unsigned int chain, MultiQueryCallback cb)
+{
+	this->receiveResponse(sock, ctx->buffer, [=](const asio::error_code &err) {
+		// Callbacks and the next read happen without the lock held; either
+		// may complete right away, and come straight back here
+		std::unique_lock<std::mutex> lock(ctx->mutex);
+		if (chain != ctx->chain) {
+			return;
+		}
+		if (err) {
+			this->endQueryChain(sock, ctx, chain, true);
+			lock.unlock();
+			cb(err, {}, {});
+			return;
+		}
+		
+		// Responses to queries that aren't in flight, or that don't echo
+		// the question asked, aren't ours; skip them
+		auto it = ctx->buffer.size() >= 12 ? ctx->inflight.find((ctx->buffer[0] << 8) | ctx->buffer[1]) : ctx->inflight.end();
+		if (it != ctx->inflight.end()) {
+			const std::vector<unsigned char> &question = ctx->questions[it->second];
+			if (ctx->buffer.size() >= question.size() &&
+					(question.size() <= 12 || std::equal(question.begin() + 12, question.end(), ctx->buffer.begin() + 12))) {
+				try {
+					ctx->pkts[it->second] = this->unwire(ctx->buffer.begin(), ctx->buffer.end());
+				} catch (std::runtime_error &e) {
+					// It's ours, but there's no telling what it says
+					this->endQueryChain(sock, ctx, chain, true);
+					lock.unlock();
+					cb(asio::error::invalid_argument, {}, {});
+					return;
+				}
+				ctx->answered[it->second] = true;
+				ctx->inflight.erase(it);
+			}
+		}
+		
+		if (ctx->inflight.empty()) {
+			this->endQueryChain(sock, ctx, chain, false);
+			lock.unlock();
+			this->finishQueries(ctx, cb);
+			return;
+		}
+		
+		lock.unlock();
+		this->receiveResponses(sock, ctx, chain, cb);
+	});
+}
+
+bool Resolver::endQueryChain(std::shared_ptr<asio::ip::tcp::socket> sock, std::shared_ptr<ConnectionContext> ctx, unsigned int chain, bool failed)
+{
+	if (chain != ctx->chain) {
+		return false;
+	}
+	++ctx->chain;
+	
+	asio::error_code ignored;
+	ctx->deadline->cancel(ignored);
+	if (failed) {
+		sock->close(ignored);
+	}
+	return true;
+}
+
+void Resolver::queryTCP(std::shared_ptr<ConnectionContext> ctx, MultiQueryCallback cb)
+{
+	auto sock = m_pool.take(m_config.endpoints());
+	if (sock) {
+		this->sendQueryChain(sock, ctx, [=](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			// Servers close idle connections whenever they like; anything
+			// that was answered before that is kept, the rest are resent
+			if (is_closed(err)) {
+				this->queryTCP(ctx, cb);
 				return;
 			}
 			
-			if (size != sizeof(uint16_t)) {
-				throw std::runtime_error("Invalid number of bytes read (response size)");
+			if (!err) {
+				m_pool.put(sock);
+			}
+			cb(err, pkts, dnssec);
+		});
+		return;
+	}
+	
+	this->connect(m_config, [=](const asio::error_code &err, std::shared_ptr<asio::ip::tcp::socket> sock) {
+		if (err) {
+			cb(err, {}, {});
+			return;
+		}
+		
+		this->sendQueryChain(sock, ctx, [=](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			if (!err) {
+				m_pool.put(sock);
+			}
+			cb(err, pkts, dnssec);
+		});
+	});
+}
+
+void Resolver::connectUDP(const asio::ip::udp::endpoint &endpoint, std::function<void(const asio::error_code &err, std::shared_ptr<asio::ip::udp::socket>)> cb) const
+{
+	// Connecting a UDP socket just picks a route and filters what it
+	// receives, so this can't block
+	auto sock = std::make_shared<asio::ip::udp::socket>(m_service);
+	asio::error_code err;
+	sock->connect(endpoint, err);
+	
+	m_service.post([=]() {
+		cb(err, err ? nullptr : sock);
+	});
+}
+
+void Resolver::queryUDP(std::shared_ptr<ConnectionContext> ctx, std::size_t index, std::size_t ns, MultiQueryCallback cb)
+{
+	std::vector<asio::ip::udp::endpoint> endpoints = m_config.udpEndpoints();
+	if (ns >= endpoints.size()) {
+		this->finishUDPQuery(ctx, index, asio::error::not_found, false, cb);
+		return;
+	}
+	
+	// A nameserver that's down over UDP is no better over TCP, and
+	// connecting to one that drops packets can take minutes to fail
+	auto next = [=](const asio::error_code &err) {
+		if (ns + 1 < endpoints.size()) {
+			this->queryUDP(ctx, index, ns + 1, cb);
+		} else {
+			this->finishUDPQuery(ctx, index, err, false, cb);
+		}
+	};
+	
+	this->connectUDP(endpoints[ns], [=](const asio::error_code &err, std::shared_ptr<asio::ip::udp::socket> sock) {
+		if (err) {
+			next(err);
+			return;
+		}
+		
+		auto buffer = std::make_shared<std::vector<unsigned char>>(this->wire(ctx->pkts[index], false));
+		this->sendUDPQuery(sock, *buffer, [=](const asio::error_code &err) {
+			// Try the next nameserver if this one didn't answer at all
+			if (err && err != asio::error::message_size) {
+				next(err);
+				return;
 			}
 			
-			uint16_t len;
-			std::copy(buffer.begin(), buffer.end(), reinterpret_cast<unsigned char*>(&len));
+			// Anyone can send a datagram that looks like a response, but they
+			// can't get in on a TCP connection; don't trust UDP with this one
+			std::shared_ptr<ldns_pkt> response;
+			if (!err) {
+				try {
+					response = this->unwire(buffer->begin(), buffer->end());
+				} catch (std::runtime_error &e) {
+					// Left empty, like any other unusable response
+				}
+			}
 			
-			len = ntohs(len);
-			buffer.resize(len);
+			// Oversized, malformed and truncated responses are retried over
+			// TCP; the query is left in place until then
+			if (!response || ldns_pkt_tc(&*response)) {
+				this->finishUDPQuery(ctx, index, {}, true, cb);
+				return;
+			}
 			
-			sock->async_receive(asio::buffer(buffer), [sock, &buffer, cb, len](const asio::error_code &err, std::size_t size) mutable {
-				if (err) {
-					cb(err);
-					return;
-				}
-				
-				if (size != len) {
-					throw std::runtime_error("Invalid number of bytes read (response data)");
-				}
-				
-				cb({});
-			});
+			ctx->pkts[index] = response;
+			this->finishUDPQuery(ctx, index, {}, false, cb);
 		});
 	});
 }
+
+void Resolver::finishUDPQuery(std::shared_ptr<ConnectionContext> ctx, std::size_t index, const asio::error_code &err, bool retry, MultiQueryCallback cb)
+{
+	{
+		std::lock_guard<std::mutex> lock(ctx->mutex);
+		if (retry) {
+			ctx->retries.push_back(index);
+		}
+		if (err && !ctx->error) {
+			ctx->error = err;
+		}
+		if (--ctx->pending > 0) {
+			return;
+		}
+	}
+	
+	if (ctx->error) {
+		cb(ctx->error, {}, {});
+		return;
+	}
+	if (ctx->retries.empty()) {
+		this->finishQueries(ctx, cb);
+		return;
+	}
+	
+	auto tcp = std::make_shared<ConnectionContext>();
+	for (std::size_t i : ctx->retries) {
+		tcp->pkts.push_back(ctx->pkts[i]);
+	}
+	tcp->it = tcp->pkts.begin();
+	this->queryTCP(tcp, [=](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+		if (err) {
+			cb(err, {}, {});
+			return;
+		}
+		
+		for (std::size_t i = 0; i < ctx->retries.size(); ++i) {
+			ctx->pkts[ctx->retries[i]] = pkts[i];
+		}
+		this->finishQueries(ctx, cb);
+	});
+}
+
+void Resolver::sendUDPQuery(std::shared_ptr<asio::ip::udp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
+{
+	auto exchange = std::make_shared<UDPExchange>(m_service, sock, buffer, m_config.ednsBufferSize(), cb);
+	exchange->timer.expires_from_now(m_config.timeout());
+	exchange->timer.async_wait([exchange](const asio::error_code &err) {
+		if (!err) {
+			exchange->finish(asio::error::timed_out);
+		}
+	});
+	
+	sock->async_send(asio::buffer(buffer), [exchange](const asio::error_code &err, std::size_t size) {
+		if (err) {
+			exchange->finish(err);
+			return;
+		}
+		
+		exchange->receive();
+	});
+}
+
+void Resolver::finishQueries(std::shared_ptr<ConnectionContext> ctx, MultiQueryCallback cb)
+{
+	std::vector<bool> dnssec;
+	dnssec.reserve(ctx->pkts.size());
+	for (auto pkt : ctx->pkts) {
+		dnssec.push_back(this->verifyDNSSEC(pkt));
+	}
+	cb({}, ctx->pkts, dnssec);
+}
@@ -12,7 +12,8 @@
 using namespace libdane;
 using namespace libdane::net;
 
-ResolverConfig::ResolverConfig()
+ResolverConfig::ResolverConfig():
+	m_port(53), m_ednsBufferSize(1232), m_timeout(2000), m_forceTCP(false)
 {
 	m_nameServers.push_back(asio::ip::address::from_string("2001:4860:4860::8888"));
 	m_nameServers.push_back(asio::ip::address::from_string("2001:4860:4860::8844"));
@@ -32,11 +33,32 @@ std::vector<asio::ip::tcp::endpoint> ResolverConfig::endpoints() const
 {
 	std::vector<asio::ip::tcp::endpoint> endpoints;
 	for (auto addr : m_nameServers) {
-		endpoints.emplace_back(addr, 53);
+		endpoints.emplace_back(addr, m_port);
 	}
 	return endpoints;
 }
 
+std::vector<asio::ip::udp::endpoint> ResolverConfig::udpEndpoints() const
+{
+	std::vector<asio::ip::udp::endpoint> endpoints;
+	for (auto addr : m_nameServers) {
+		endpoints.emplace_back(addr, m_port);
+	}
+	return endpoints;
+}
+
+unsigned short ResolverConfig::port() const { return m_port; }
+void ResolverConfig::setPort(unsigned short v) { m_port = v; }
+
+uint16_t ResolverConfig::ednsBufferSize() const { return m_ednsBufferSize; }
+void ResolverConfig::setEdnsBufferSize(uint16_t v) { m_ednsBufferSize = v; }
+
+std::chrono::milliseconds ResolverConfig::timeout() const { return m_timeout; }
+void ResolverConfig::setTimeout(std::chrono::milliseconds v) { m_timeout = v; }
+
+bool ResolverConfig::forceTCP() const { return m_forceTCP; }
+void ResolverConfig::setForceTCP(bool v) { m_forceTCP = v; }
+
 bool ResolverConfig::load()
 {
 	return this->loadResolvConf();
@@ -57,6 +79,7 @@ bool ResolverConfig::loadResolvConf(const std::string &path)
 bool ResolverConfig::parseResolvConf(const std::string &str)
 {
 	std::vector<asio::ip::address> nameServers;
+	bool forceTCP = false;
 	
 	std::stringstream ss(str);
 	std::string line;
@@ -66,9 +89,22 @@ bool ResolverConfig::parseResolvConf(const std::string &str)
 			std::string address = line.substr(nsprefix.size() + 1);
 			nameServers.push_back(asio::ip::address::from_string(address));
 		}
+		
+		// "options use-vc" forces queries over TCP, as it does for glibc
+		std::string optprefix("options");
+		if (line.compare(0, optprefix.size(), optprefix) == 0) {
+			std::stringstream options(line.substr(optprefix.size()));
+			std::string option;
+			while (options >> option) {
+				if (option == "use-vc") {
+					forceTCP = true;
+				}
+			}
+		}
 	}
 	
 	m_nameServers = nameServers;
+	m_forceTCP = forceTCP;
 	
 	return true;
 }
@@ -8,11 +8,12 @@
 #include <libdane/net/Util.h>
 #include <libdane/common.h>
 #include <sstream>
+#include <stdexcept>
 
 using namespace libdane;
 using namespace libdane::net;
 
-std::shared_ptr<ldns_rr> libdane::net::make_tlsa(Usage u, Selector sel, MatchingType mt, const std::vector<unsigned char> &data)
+std::shared_ptr<ldns_rr> libdane::net::make_tlsa(Usage u, Selector sel, MatchingType mt, ByteView data)
 {
 	uint8_t u8 = u;
 	uint8_t sel8 = sel;
@@ -31,6 +32,10 @@ std::shared_ptr<ldns_rr> libdane::net::make_tlsa(Usage u, Selector sel, Matching
 
 DANERecord libdane::net::record_from_tlsa(ldns_rr *rr)
 {
+	if (ldns_rr_rd_count(rr) != 4) {
+		throw std::runtime_error("Malformed TLSA record");
+	}
+	
 	ldns_rdf *usage_rd = ldns_rr_rdf(rr, 0);
 	ldns_rdf *selector_rd = ldns_rr_rdf(rr, 1);
 	ldns_rdf *mtype_rd = ldns_rr_rdf(rr, 2);
@@ -39,8 +44,7 @@ DANERecord libdane::net::record_from_tlsa(ldns_rr *rr)
 	Usage usage = static_cast<Usage>(ldns_rdf_data(usage_rd)[0]);
 	Selector selector = static_cast<Selector>(ldns_rdf_data(selector_rd)[0]);
 	MatchingType mtype = static_cast<MatchingType>(ldns_rdf_data(mtype_rd)[0]);
-	uint8_t* data_ptr = ldns_rdf_data(data_rd);
-	std::vector<unsigned char> data(data_ptr, data_ptr + ldns_rdf_size(data_rd));
+	ByteView data(ldns_rdf_data(data_rd), ldns_rdf_size(data_rd));
 	
 	return DANERecord(usage, selector, mtype, data);
 }
@@ -6,11 +6,12 @@
  */
 
 #include <libdane/net/mock/MockResolver.h>
+#include <algorithm>
 
 using namespace libdane::net::mock;
 
 MockResolver::MockResolver(asio::io_service &service):
-	Resolver(service)
+	Resolver(service), m_tcpQueries(0), m_udpQueries(0)
 {
 	
 }
@@ -49,11 +50,57 @@ void MockResolver::connect(const ResolverConfig &conf, std::function<void(const
 	cb({}, sock);
 }
 
-void MockResolver::sendQuery(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
+void MockResolver::sendQueries(std::shared_ptr<asio::ip::tcp::socket> sock, const std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
 {
-	auto pkt = this->unwire(buffer.begin() + 2, buffer.end());
+	std::vector<unsigned char> query;
+	for (std::size_t pos = 0; pos + 2 <= buffer.size(); pos += 2 + query.size()) {
+		std::size_t len = (buffer[pos] << 8) | buffer[pos + 1];
+		query.assign(buffer.begin() + pos + 2, buffer.begin() + std::min(pos + 2 + len, buffer.size()));
+		
+		++m_tcpQueries;
+		auto pkt = this->unwire(query.begin(), query.end());
+		auto ret = this->invokeMock(pkt);
+		auto wired = this->wire(ret, false);
+		
+		// Answer with the query's ID, like a server would
+		std::copy(query.begin(), query.begin() + 2, wired.begin());
+		m_answers.push_front(wired);
+	}
+	cb({});
+}
+
+void MockResolver::receiveResponse(std::shared_ptr<asio::ip::tcp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
+{
+	if (m_answers.empty()) {
+		cb(asio::error::eof);
+		return;
+	}
+	
+	buffer = m_answers.front();
+	m_answers.pop_front();
+	cb({});
+}
+
+void MockResolver::connectUDP(const asio::ip::udp::endpoint &endpoint, std::function<void(const asio::error_code &err, std::shared_ptr<asio::ip::udp::socket>)> cb) const
+{
+	auto sock = std::make_shared<asio::ip::udp::socket>(m_service);
+	cb({}, sock);
+}
+
+void MockResolver::sendUDPQuery(std::shared_ptr<asio::ip::udp::socket> sock, std::vector<unsigned char> &buffer, std::function<void(const asio::error_code &err)> cb)
+{
+	++m_udpQueries;
+	auto pkt = this->unwire(buffer.begin(), buffer.end());
 	auto ret = this->invokeMock(pkt);
 	auto wired = this->wire(ret, false);
+	if (wired.size() > m_config.ednsBufferSize()) {
+		cb(asio::error::message_size);
+		return;
+	}
+	
 	buffer.assign(wired.begin(), wired.end());
 	cb({});
 }
+
+unsigned int MockResolver::tcpQueries() const { return m_tcpQueries; }
+unsigned int MockResolver::udpQueries() const { return m_udpQueries; }
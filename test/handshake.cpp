@@ -0,0 +1,41 @@
+/**
+ * handshake.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include "handshake.h"
+#include <memory>
+
+using namespace libdane;
+
+namespace
+{
+	int verify_cb(int preverified, X509_STORE_CTX *ctx)
+	{
+		return (*static_cast<resources::HandshakeCallback*>(X509_STORE_CTX_get_app_data(ctx)))(preverified, ctx);
+	}
+}
+
+bool libdane::resources::handshake(const std::deque<Certificate> &chain, HandshakeCallback cb)
+{
+	auto store = std::shared_ptr<X509_STORE>(X509_STORE_new(), X509_STORE_free);
+	X509_STORE_add_cert(&*store, chain.back().x509());
+	
+	STACK_OF(X509) *untrusted = sk_X509_new_null();
+	for (auto it = chain.begin() + 1; it != chain.end(); ++it) {
+		sk_X509_push(untrusted, it->x509());
+	}
+	
+	auto ctx = std::shared_ptr<X509_STORE_CTX>(X509_STORE_CTX_new(), X509_STORE_CTX_free);
+	X509_STORE_CTX_init(&*ctx, &*store, chain.front().x509(), untrusted);
+	X509_STORE_CTX_set_flags(&*ctx, X509_V_FLAG_PARTIAL_CHAIN);
+	X509_STORE_CTX_set_time(&*ctx, 0, 1441065600);	// 2015-09-01
+	X509_STORE_CTX_set_app_data(&*ctx, &cb);
+	X509_STORE_CTX_set_verify_cb(&*ctx, verify_cb);
+	
+	bool result = X509_verify_cert(&*ctx) == 1;
+	sk_X509_free(untrusted);
+	return result;
+}
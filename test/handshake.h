@@ -0,0 +1,33 @@
+/**
+ * handshake.h
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#ifndef LIBDANE_TEST_HANDSHAKE_H
+#define LIBDANE_TEST_HANDSHAKE_H
+
+#include <libdane/Certificate.h>
+#include <deque>
+#include <functional>
+
+namespace libdane
+{
+	namespace resources
+	{
+		/// Verify callback; whatever it returns is passed on to OpenSSL
+		typedef std::function<bool(bool preverified, X509_STORE_CTX *ctx)> HandshakeCallback;
+		
+		/**
+		 * Runs OpenSSL's verification on a chain, trusting its last certificate.
+		 * 
+		 * @param  chain Chain to verify, leaf first
+		 * @param  cb    Invoked for every verify callback
+		 * @return       Whether verification passed
+		 */
+		bool handshake(const std::deque<Certificate> &chain, HandshakeCallback cb);
+	}
+}
+
+#endif
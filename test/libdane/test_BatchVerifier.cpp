@@ -0,0 +1,147 @@
+/**
+ * test_BatchVerifier.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/BatchVerifier.h>
+#include <libdane/_internal/parallel.h>
+#include "../resources.h"
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+
+using namespace libdane;
+
+SCENARIO("Chains can be verified in batches")
+{
+	std::deque<Certificate> google = Certificate::parsePEM(resources::googlePEM);
+	std::deque<Certificate> microsoft = Certificate::parsePEM(resources::microsoftPEM);
+	
+	std::vector<DANERecord> googleRecords = { DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, google[0]) };
+	std::vector<DANERecord> microsoftRecords = { DANERecord(TrustAnchorAssertion, FullCertificate, SHA256Hash, microsoft[1]) };
+	DANERecordSet googleSet(googleRecords.begin(), googleRecords.end());
+	DANERecordSet microsoftSet(microsoftRecords.begin(), microsoftRecords.end());
+	
+	GIVEN("A mix of passing and failing jobs")
+	{
+		std::vector<BatchVerifier::Job> jobs;
+		std::vector<bool> expected;
+		for (int i = 0; i < 1000; ++i) {
+			switch (i % 4) {
+				case 0:
+					jobs.emplace_back(google, googleSet);
+					expected.push_back(true);
+					break;
+				case 1:
+					jobs.emplace_back(microsoft, microsoftSet);
+					expected.push_back(true);
+					break;
+				case 2:
+					jobs.emplace_back(google, microsoftSet);
+					expected.push_back(false);
+					break;
+				case 3:
+					jobs.emplace_back(microsoft, googleSet);
+					expected.push_back(false);
+					break;
+			}
+		}
+		
+		THEN("A single thread should get them right")
+		{
+			BatchVerifier verifier(1);
+			CHECK(verifier.run(jobs) == expected);
+		}
+		
+		THEN("Several threads should get them right")
+		{
+			BatchVerifier verifier(4);
+			CHECK(verifier.threads() == 4);
+			CHECK(verifier.run(jobs) == expected);
+		}
+		
+		THEN("A part of them can be verified")
+		{
+			BatchVerifier verifier(3);
+			std::vector<bool> results = verifier.run(jobs.data() + 1, 5);
+			CHECK(results == std::vector<bool>(expected.begin() + 1, expected.begin() + 6));
+		}
+	}
+	
+	GIVEN("No jobs")
+	{
+		THEN("There should be no results")
+		{
+			BatchVerifier verifier;
+			CHECK(verifier.run(std::vector<BatchVerifier::Job>()).empty());
+		}
+	}
+}
+
+SCENARIO("Batches run on a persistent pool of workers")
+{
+	GIVEN("Work spread over several threads")
+	{
+		std::mutex mutex;
+		std::set<std::thread::id> ids;
+		auto record = [&](std::size_t, std::size_t) {
+			std::lock_guard<std::mutex> lock(mutex);
+			ids.insert(std::this_thread::get_id());
+		};
+		
+		THEN("Repeated runs should reuse the same threads")
+		{
+			for (int i = 0; i < 20; ++i) {
+				internal::parallel_for(1000, 4, record, 1);
+			}
+			CHECK(ids.size() <= internal::WorkerPool::shared().size() + 1);
+		}
+		
+		THEN("Concurrent runs should all finish")
+		{
+			std::vector<std::thread> callers;
+			std::atomic<std::size_t> total(0);
+			for (int i = 0; i < 4; ++i) {
+				callers.emplace_back([&]() {
+					internal::parallel_for(1000, 3, [&](std::size_t begin, std::size_t end) {
+						total += end - begin;
+					});
+				});
+			}
+			for (auto &caller : callers) {
+				caller.join();
+			}
+			CHECK(total == 4000);
+		}
+	}
+	
+	GIVEN("Work that throws")
+	{
+		auto fail = [](std::size_t begin, std::size_t end) {
+			if (begin <= 500 && 500 < end) {
+				throw std::runtime_error("Item 500");
+			}
+		};
+		
+		THEN("The exception should reach the caller")
+		{
+			CHECK_THROWS_AS(internal::parallel_for(1000, 4, fail, 1), std::runtime_error);
+			CHECK_THROWS_AS(internal::parallel_for(1000, 1, fail, 1), std::runtime_error);
+		}
+		
+		THEN("The pool should still work afterwards")
+		{
+			CHECK_THROWS(internal::parallel_for(1000, 4, fail, 1));
+			
+			std::atomic<std::size_t> total(0);
+			internal::parallel_for(1000, 4, [&](std::size_t begin, std::size_t end) {
+				total += end - begin;
+			});
+			CHECK(total == 1000);
+		}
+	}
+}
@@ -9,6 +9,9 @@
 #include <libdane/Certificate.h>
 #include <libdane/Util.h>
 #include "../resources.h"
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
 
 using namespace libdane;
 
@@ -92,6 +95,92 @@ SCENARIO("Operators work")
 			REQUIRE(a == a);
 			REQUIRE(a != b);
 		}
+		
+		THEN("Separately parsed copies should be equal")
+		{
+			Certificate c(resources::googlePEM);
+			REQUIRE(a.x509() != c.x509());
+			CHECK(a == c);
+			CHECK(b != c);
+		}
+		
+		THEN("Empty certificates should only equal each other")
+		{
+			CHECK(Certificate() == Certificate());
+			CHECK(a != Certificate());
+			CHECK(Certificate() != a);
+		}
+	}
+}
+
+SCENARIO("Certificates have fingerprints")
+{
+	GIVEN("The certificate chain for google.com")
+	{
+		std::deque<Certificate> certs = Certificate::parsePEM(resources::googlePEM);
+		
+		THEN("The fingerprint should be the SHA-256 of the DER")
+		{
+			const Certificate::Fingerprint &fp = certs[0].fingerprint();
+			CHECK(to_hex(fp.begin(), fp.end()) == "440e875366ad14f997127cb7199dd255fc01fb1c57a7adde9415dca228535404");
+			CHECK(&certs[0].fingerprint() == &fp);
+		}
+		
+		THEN("Certificates should work as keys in unordered containers")
+		{
+			std::unordered_set<Certificate> set(certs.begin(), certs.end());
+			CHECK(set.size() == certs.size());
+			CHECK(set.count(Certificate(resources::googlePEM)) == 1);
+			CHECK(set.count(Certificate::parsePEM(resources::microsoftPEM)[0]) == 0);
+			
+			std::unordered_map<Certificate, std::size_t> positions;
+			for (std::size_t i = 0; i < certs.size(); ++i) {
+				positions[certs[i]] = i;
+			}
+			CHECK(positions[Certificate::parsePEM(resources::googlePEM)[1]] == 1);
+		}
+	}
+	
+	GIVEN("An empty certificate")
+	{
+		Certificate cert;
+		
+		THEN("The fingerprint should be all zeroes")
+		{
+			CHECK(cert.fingerprint() == Certificate::Fingerprint());
+			CHECK(std::hash<Certificate>()(cert) == 0);
+		}
+	}
+	
+	GIVEN("Two certificates that can't be encoded")
+	{
+		X509 *x1 = X509_new();
+		X509 *x2 = X509_new();
+		Certificate a(x1), b(x2);
+		X509_free(x1);
+		X509_free(x2);
+		
+		THEN("They should have no fingerprints")
+		{
+			CHECK_FALSE(a.hasFingerprint());
+			CHECK_FALSE(b.hasFingerprint());
+			CHECK(a.fingerprint() == Certificate::Fingerprint());
+			CHECK(a.digest(FullCertificate, SHA256Hash).empty());
+		}
+		
+		THEN("They should only equal themselves")
+		{
+			CHECK(a != b);
+			CHECK(a == Certificate(a));
+			CHECK(a != Certificate());
+		}
+		
+		THEN("They shouldn't alias each other in unordered containers")
+		{
+			CHECK(std::hash<Certificate>()(a) != std::hash<Certificate>()(b));
+			std::unordered_set<Certificate> set = { a, b, Certificate(a) };
+			CHECK(set.size() == 2);
+		}
 	}
 }
 
@@ -121,3 +210,298 @@ SCENARIO("Certificate issuer status can be verified")
 		}
 	}
 }
+
+SCENARIO("Certificates share their underlying representation")
+{
+	GIVEN("A certificate")
+	{
+		Certificate cert = Certificate::parsePEM(resources::googlePEM).front();
+		
+		THEN("A copy should share the X509 object")
+		{
+			Certificate copy(cert);
+			CHECK(copy.x509() == cert.x509());
+			CHECK(copy == cert);
+		}
+		
+		THEN("A copy should outlive the original")
+		{
+			Certificate *orig = new Certificate(cert);
+			Certificate copy(*orig);
+			delete orig;
+			CHECK(copy.subjectDN() == cert.subjectDN());
+		}
+		
+		THEN("Copy assignment should share the X509 object")
+		{
+			Certificate copy;
+			copy = cert;
+			CHECK(copy.x509() == cert.x509());
+		}
+		
+		THEN("Moving should leave the original empty")
+		{
+			X509 *x509 = cert.x509();
+			Certificate moved(std::move(cert));
+			CHECK(moved.x509() == x509);
+			CHECK(!cert);
+			
+			Certificate assigned;
+			assigned = std::move(moved);
+			CHECK(assigned.x509() == x509);
+			CHECK(!moved);
+		}
+	}
+}
+
+SCENARIO("Digests are computed and cached")
+{
+	GIVEN("The certificate for google.com")
+	{
+		Certificate cert = Certificate::parsePEM(resources::googlePEM).front();
+		
+		THEN("Digests should match the hashed selections")
+		{
+			CHECK(cert.digest(FullCertificate, ExactMatch) == cert.encoded());
+			CHECK(cert.digest(SubjectPublicKeyInfo, ExactMatch) == cert.publicKey());
+			CHECK(to_hex(cert.digest(FullCertificate, SHA256Hash)) == "440e875366ad14f997127cb7199dd255fc01fb1c57a7adde9415dca228535404");
+			CHECK(to_hex(cert.digest(SubjectPublicKeyInfo, SHA256Hash)) == "7b1394143f8d123760572cc410d1441b3bea3aaf987d0e4b950749e72d554db9");
+			CHECK(cert.digest(FullCertificate, SHA512Hash) == hash(EVP_sha512(), cert.encoded()));
+			CHECK(cert.digest(SubjectPublicKeyInfo, SHA512Hash) == hash(EVP_sha512(), cert.publicKey()));
+		}
+		
+		THEN("Repeated calls should return the same cached data")
+		{
+			CHECK(&cert.digest(SubjectPublicKeyInfo, SHA256Hash) == &cert.digest(SubjectPublicKeyInfo, SHA256Hash));
+		}
+		
+		THEN("Copies and other wrappers should share the cache")
+		{
+			Certificate copy(cert);
+			Certificate wrapper(cert.x509());
+			CHECK(&copy.digest(FullCertificate, SHA256Hash) == &cert.digest(FullCertificate, SHA256Hash));
+			CHECK(&wrapper.digest(FullCertificate, SHA256Hash) == &cert.digest(FullCertificate, SHA256Hash));
+		}
+		
+		THEN("Concurrent readers should all see the same digest")
+		{
+			Certificate fresh(resources::googlePEM);
+			std::vector<const std::vector<unsigned char>*> results(8);
+			std::vector<std::thread> threads;
+			for (size_t i = 0; i < results.size(); ++i) {
+				threads.emplace_back([&, i]() {
+					results[i] = &fresh.digest(SubjectPublicKeyInfo, SHA512Hash);
+				});
+			}
+			for (auto &t : threads) {
+				t.join();
+			}
+			
+			for (auto res : results) {
+				CHECK(res == results[0]);
+			}
+			CHECK(*results[0] == hash(EVP_sha512(), fresh.publicKey()));
+		}
+		
+		THEN("Concurrent wrappers of a bare X509 should share one cache")
+		{
+			std::vector<unsigned char> der = cert.encoded();
+			const unsigned char *p = der.data();
+			X509 *x509 = d2i_X509(nullptr, &p, der.size());
+			REQUIRE(x509);
+			
+			std::vector<const std::vector<unsigned char>*> results(8);
+			std::vector<std::thread> threads;
+			for (size_t i = 0; i < results.size(); ++i) {
+				threads.emplace_back([&, i]() {
+					results[i] = &Certificate(x509).digest(FullCertificate, SHA256Hash);
+				});
+			}
+			for (auto &t : threads) {
+				t.join();
+			}
+			
+			for (auto res : results) {
+				CHECK(res == results[0]);
+			}
+			CHECK(*results[0] == cert.digest(FullCertificate, SHA256Hash));
+			X509_free(x509);
+		}
+		
+		THEN("Invalid selectors and types should throw")
+		{
+			CHECK_THROWS_AS(cert.digest(static_cast<Selector>(255), SHA256Hash), std::runtime_error);
+			CHECK_THROWS_AS(cert.digest(FullCertificate, static_cast<MatchingType>(255)), std::runtime_error);
+		}
+	}
+	
+	GIVEN("An empty certificate")
+	{
+		Certificate cert;
+		
+		THEN("Digests should be empty")
+		{
+			CHECK(cert.digest(FullCertificate, SHA256Hash).empty());
+		}
+	}
+}
+
+SCENARIO("Digests can be computed in batches")
+{
+	GIVEN("Two certificate chains, and an empty certificate")
+	{
+		std::vector<Certificate> certs;
+		for (const char *pem : { resources::googlePEM, resources::microsoftPEM }) {
+			for (const Certificate &cert : Certificate::parsePEM(pem)) {
+				certs.push_back(cert);
+			}
+		}
+		certs.push_back(certs.front());
+		certs.push_back(Certificate());
+		
+		THEN("They should be cached like the ones computed one at a time")
+		{
+			for (MatchingType type : { SHA256Hash, SHA512Hash }) {
+				for (Selector sel : { FullCertificate, SubjectPublicKeyInfo }) {
+					Certificate::prefetchDigests(certs, sel, type);
+					for (const Certificate &cert : certs) {
+						if (cert) {
+							CHECK(cert.digest(sel, type) == hash(md_from_matching_type(type), cert.select(sel)));
+						} else {
+							CHECK(cert.digest(sel, type).empty());
+						}
+					}
+				}
+			}
+			CHECK(&certs.front().digest(FullCertificate, SHA256Hash) == &certs[certs.size() - 2].digest(FullCertificate, SHA256Hash));
+		}
+		
+		THEN("Digests that are already cached should be left alone")
+		{
+			const std::vector<unsigned char> *digest = &certs[1].digest(SubjectPublicKeyInfo, SHA256Hash);
+			Certificate::prefetchDigests(certs, SubjectPublicKeyInfo, SHA256Hash);
+			CHECK(&certs[1].digest(SubjectPublicKeyInfo, SHA256Hash) == digest);
+		}
+		
+		THEN("Invalid selectors and types should throw")
+		{
+			CHECK_NOTHROW(Certificate::prefetchDigests(certs, FullCertificate, ExactMatch));
+			CHECK_THROWS_AS(Certificate::prefetchDigests(certs, static_cast<Selector>(255), SHA256Hash), std::runtime_error);
+			CHECK_THROWS_AS(Certificate::prefetchDigests(certs, FullCertificate, static_cast<MatchingType>(255)), std::runtime_error);
+		}
+	}
+}
+
+SCENARIO("PEM parsing is lenient about its surroundings")
+{
+	GIVEN("A chain with CRLF line endings, comments and a broken block")
+	{
+		std::string pem(resources::googlePEM);
+		std::string crlf;
+		for (char c : pem) {
+			if (c == '\n') {
+				crlf += '\r';
+			}
+			crlf += c;
+		}
+		crlf = "# Some comment\r\n-----BEGIN CERTIFICATE-----\r\n!!!!\r\n-----END CERTIFICATE-----\r\n" + crlf;
+		
+		std::deque<Certificate> certs = Certificate::parsePEM(crlf);
+		
+		THEN("Only the valid certificates should be parsed")
+		{
+			REQUIRE(certs.size() == 3);
+			CHECK(certs[0].subjectDN() == "/C=US/ST=California/L=Mountain View/O=Google Inc/CN=*.google.com");
+		}
+	}
+}
+
+SCENARIO("DER parsing works")
+{
+	GIVEN("A DER-encoded certificate")
+	{
+		Certificate cert(resources::googlePEM);
+		std::vector<unsigned char> der = cert.encoded();
+		
+		THEN("It should parse back into the same certificate")
+		{
+			Certificate parsed = Certificate::fromDER(der.data(), der.size());
+			REQUIRE(!!parsed);
+			CHECK(parsed == cert);
+		}
+		
+		THEN("Truncated data should not parse")
+		{
+			CHECK(!Certificate::fromDER(der.data(), der.size() / 2));
+		}
+	}
+}
+
+SCENARIO("Selections can be viewed without copying")
+{
+	GIVEN("The certificate chains for google.com and microsoft.com")
+	{
+		std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+		std::deque<Certificate> microsoft = Certificate::parsePEM(resources::microsoftPEM);
+		chain.insert(chain.end(), microsoft.begin(), microsoft.end());
+		REQUIRE(chain.size() == 5);
+		
+		THEN("Views should match the copied selections")
+		{
+			for (const Certificate &cert : chain) {
+				CHECK(cert.view(libdane::FullCertificate) == cert.encoded());
+				CHECK(cert.view(libdane::SubjectPublicKeyInfo) == cert.publicKey());
+			}
+		}
+		
+		THEN("The public key should be a slice of the DER")
+		{
+			for (const Certificate &cert : chain) {
+				ByteView der = cert.view(libdane::FullCertificate);
+				ByteView spki = cert.view(libdane::SubjectPublicKeyInfo);
+				CHECK(spki.begin() > der.begin());
+				CHECK(spki.end() < der.end());
+			}
+		}
+		
+		THEN("The public key should match what OpenSSL encodes")
+		{
+			for (const Certificate &cert : chain) {
+				unsigned char *buf = NULL;
+				int size = i2d_X509_PUBKEY(X509_get_X509_PUBKEY(cert.x509()), &buf);
+				REQUIRE(size > 0);
+				CHECK(cert.view(libdane::SubjectPublicKeyInfo) == ByteView(buf, size));
+				OPENSSL_free(buf);
+			}
+		}
+		
+		THEN("Views should stay valid as long as a copy does")
+		{
+			ByteView spki;
+			Certificate copy;
+			{
+				Certificate cert = chain[0];
+				chain.clear();
+				spki = cert.view(libdane::SubjectPublicKeyInfo);
+				copy = cert;
+			}
+			CHECK(spki == copy.publicKey());
+		}
+	}
+	
+	GIVEN("An empty certificate")
+	{
+		Certificate cert;
+		
+		THEN("Views should be empty")
+		{
+			CHECK(cert.view(libdane::FullCertificate).empty());
+			CHECK(cert.view(libdane::SubjectPublicKeyInfo).empty());
+		}
+		
+		THEN("Invalid selectors should throw")
+		{
+			CHECK_THROWS(cert.view(static_cast<libdane::Selector>(7)));
+		}
+	}
+}
@@ -0,0 +1,102 @@
+/**
+ * test_CertificateLoader.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/CertificateLoader.h>
+#include "../resources.h"
+#include <cstdio>
+#include <fstream>
+#include <stdexcept>
+
+using namespace libdane;
+
+SCENARIO("Certificates can be bulk loaded from buffers")
+{
+	std::deque<Certificate> expected = Certificate::parsePEM(resources::googlePEM);
+	REQUIRE(expected.size() == 3);
+	
+	GIVEN("A PEM buffer")
+	{
+		std::string pem(resources::googlePEM);
+		
+		THEN("All certificates should be loaded in order, on any number of threads")
+		{
+			for (unsigned int threads : { 1u, 2u, 8u, 0u }) {
+				CertificateLoader loader(threads);
+				std::vector<Certificate> certs = loader.load(pem.data(), pem.size());
+				REQUIRE(certs.size() == 3);
+				CHECK(certs[0] == expected[0]);
+				CHECK(certs[1] == expected[1]);
+				CHECK(certs[2] == expected[2]);
+			}
+		}
+	}
+	
+	GIVEN("Concatenated DER certificates")
+	{
+		std::string der;
+		for (const Certificate &cert : expected) {
+			std::vector<unsigned char> encoded = cert.encoded();
+			der.append(encoded.begin(), encoded.end());
+		}
+		
+		THEN("All certificates should be loaded in order")
+		{
+			CertificateLoader loader(2);
+			std::vector<Certificate> certs = loader.load(der.data(), der.size());
+			REQUIRE(certs.size() == 3);
+			CHECK(certs[0] == expected[0]);
+			CHECK(certs[2] == expected[2]);
+		}
+		
+		THEN("Trailing garbage should be ignored")
+		{
+			der.append("garbage");
+			CertificateLoader loader(2);
+			CHECK(loader.load(der.data(), der.size()).size() == 3);
+		}
+	}
+	
+	GIVEN("No data")
+	{
+		THEN("Nothing should be loaded")
+		{
+			CertificateLoader loader;
+			CHECK(loader.load(nullptr, 0).empty());
+		}
+	}
+}
+
+SCENARIO("Certificates can be bulk loaded from files")
+{
+	GIVEN("A PEM file")
+	{
+		std::string path = "test_CertificateLoader.pem";
+		{
+			std::ofstream fs(path, std::ios::binary);
+			fs << resources::googlePEM << resources::microsoftPEM;
+		}
+		
+		THEN("All certificates in it should be loaded")
+		{
+			CertificateLoader loader(2);
+			CHECK(loader.loadFile(path).size() == 5);
+			CHECK(loader.loadFiles({ path, path }).size() == 10);
+		}
+		
+		std::remove(path.c_str());
+	}
+	
+	GIVEN("A nonexistent file")
+	{
+		THEN("Loading it should throw")
+		{
+			CertificateLoader loader;
+			CHECK_THROWS_AS(loader.loadFile("/nonexistent/file.pem"), std::runtime_error);
+		}
+	}
+}
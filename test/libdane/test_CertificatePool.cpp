@@ -0,0 +1,96 @@
+/**
+ * test_CertificatePool.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/CertificatePool.h>
+#include "../resources.h"
+
+using namespace libdane;
+
+SCENARIO("Certificates can be interned")
+{
+	GIVEN("An empty pool")
+	{
+		CertificatePool pool(3);
+		
+		WHEN("The same chain is parsed twice through it")
+		{
+			std::deque<Certificate> a = Certificate::parsePEM(resources::googlePEM, &pool);
+			std::deque<Certificate> b = Certificate::parsePEM(resources::googlePEM, &pool);
+			REQUIRE(a.size() == 3);
+			REQUIRE(b.size() == 3);
+			
+			THEN("Only the first parse should miss")
+			{
+				CHECK(pool.misses() == 3);
+				CHECK(pool.hits() == 3);
+			}
+			
+			THEN("The certificates should be shared")
+			{
+				CHECK(a[0].x509() == b[0].x509());
+				CHECK(a[1].x509() == b[1].x509());
+				CHECK(a[2].x509() == b[2].x509());
+			}
+		}
+		
+		WHEN("More certificates than the capacity are interned")
+		{
+			Certificate::parsePEM(resources::googlePEM, &pool);
+			Certificate::parsePEM(resources::microsoftPEM, &pool);
+			
+			THEN("The pool should not grow beyond its capacity")
+			{
+				CHECK(pool.size() == 3);
+				CHECK(pool.evictions() == 2);
+			}
+		}
+		
+		WHEN("Separately parsed certificates are interned")
+		{
+			Certificate a(resources::googlePEM);
+			Certificate b(resources::googlePEM);
+			REQUIRE(a.x509() != b.x509());
+			
+			Certificate ia = pool.intern(a);
+			Certificate ib = pool.intern(b);
+			
+			THEN("They should be deduplicated")
+			{
+				CHECK(ia.x509() == a.x509());
+				CHECK(ib.x509() == a.x509());
+				CHECK(pool.size() == 1);
+			}
+		}
+		
+		WHEN("Garbage is interned")
+		{
+			const unsigned char garbage[] = { 0x30, 0x01, 0x00 };
+			Certificate cert = pool.intern(garbage, sizeof(garbage));
+			
+			THEN("It should yield nothing, and not be pooled")
+			{
+				CHECK(!cert);
+				CHECK(pool.size() == 0);
+			}
+		}
+	}
+	
+	GIVEN("A disabled pool")
+	{
+		CertificatePool pool(0);
+		Certificate a(resources::googlePEM);
+		Certificate b(resources::googlePEM);
+		
+		THEN("Nothing should be deduplicated")
+		{
+			CHECK(pool.intern(a).x509() == a.x509());
+			CHECK(pool.intern(b).x509() == b.x509());
+			CHECK(pool.size() == 0);
+		}
+	}
+}
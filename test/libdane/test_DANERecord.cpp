@@ -105,3 +105,132 @@ SCENARIO("Certificates can be verified, callback-style")
 		}
 	}
 }
+
+SCENARIO("Record data is stored compactly")
+{
+	Certificate cert = Certificate::parsePEM(resources::googlePEM).front();
+	
+	GIVEN("A record with a digest")
+	{
+		DANERecord rec(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA512Hash, cert);
+		
+		THEN("The data should be stored inline")
+		{
+			ByteView data = rec.data();
+			CHECK(data.size() == 64);
+			CHECK(data.begin() >= reinterpret_cast<const unsigned char*>(&rec));
+			CHECK(data.end() <= reinterpret_cast<const unsigned char*>(&rec + 1));
+			CHECK(data == cert.digest(SubjectPublicKeyInfo, SHA512Hash));
+		}
+	}
+	
+	GIVEN("A record with a full certificate")
+	{
+		DANERecord rec(DomainIssuedCertificate, FullCertificate, ExactMatch, cert);
+		
+		THEN("The data should be intact")
+		{
+			CHECK(rec.data() == cert.encoded());
+			CHECK(rec.verify(cert));
+		}
+		
+		THEN("Copies should have their own data")
+		{
+			DANERecord copy(rec);
+			CHECK(copy.data() == rec.data());
+			CHECK(copy.data().data() != rec.data().data());
+			
+			DANERecord assigned;
+			assigned = rec;
+			CHECK(assigned.data() == rec.data());
+			CHECK(assigned.usage() == DomainIssuedCertificate);
+			CHECK(assigned.selector() == FullCertificate);
+			CHECK(assigned.matching() == ExactMatch);
+		}
+		
+		THEN("Moving should take the data along")
+		{
+			const unsigned char *ptr = rec.data().data();
+			DANERecord moved(std::move(rec));
+			CHECK(moved.data().data() == ptr);
+			CHECK(moved.data() == cert.encoded());
+			CHECK(rec.data().empty());
+		}
+		
+		THEN("Data can be replaced by a piece of itself")
+		{
+			ByteView data = rec.data();
+			rec.setData(ByteView(data.data() + 4, 32));
+			CHECK(rec.data() == ByteView(cert.view(FullCertificate).data() + 4, 32));
+			
+			rec.setData(rec.data());
+			CHECK(rec.data() == ByteView(cert.view(FullCertificate).data() + 4, 32));
+		}
+	}
+}
+
+SCENARIO("Records can be normalized for matching")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	const Certificate &cert = chain.front();
+	
+	GIVEN("An exact match")
+	{
+		DANERecord rec(DomainIssuedCertificate, SubjectPublicKeyInfo, ExactMatch, cert);
+		DANERecord canonical = rec.normalized();
+		
+		THEN("It should become a SHA-256 digest matching the same certificate")
+		{
+			CHECK(canonical.usage() == DomainIssuedCertificate);
+			CHECK(canonical.selector() == SubjectPublicKeyInfo);
+			CHECK(canonical.matching() == SHA256Hash);
+			CHECK(canonical.data() == cert.digest(SubjectPublicKeyInfo, SHA256Hash));
+			CHECK(canonical.verify(cert));
+			CHECK_FALSE(canonical.verify(chain.back()));
+		}
+	}
+	
+	GIVEN("A digest")
+	{
+		DANERecord rec(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA512Hash, cert);
+		
+		THEN("It should be left alone")
+		{
+			DANERecord canonical = rec.normalized();
+			CHECK(canonical.matching() == SHA512Hash);
+			CHECK(canonical.data() == rec.data());
+		}
+	}
+	
+	THEN("Records that can't match anything should be flagged")
+	{
+		std::vector<unsigned char> digest(32, 0xAB);
+		CHECK(DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, digest).usable());
+		CHECK(DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, ExactMatch, digest).usable());
+		CHECK_FALSE(DANERecord(Usage(4), SubjectPublicKeyInfo, SHA256Hash, digest).usable());
+		CHECK_FALSE(DANERecord(DomainIssuedCertificate, Selector(2), SHA256Hash, digest).usable());
+		CHECK_FALSE(DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, MatchingType(255), digest).usable());
+		CHECK_FALSE(DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA512Hash, digest).usable());
+		CHECK_FALSE(DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, ExactMatch, ByteView()).usable());
+	}
+}
+
+SCENARIO("Records can be made for many certificates at once")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::vector<Certificate> certs(chain.begin(), chain.end());
+	
+	THEN("They should be the same as records made one at a time")
+	{
+		std::vector<DANERecord> records = DANERecord::fromCertificates(TrustAnchorAssertion, SubjectPublicKeyInfo, SHA512Hash, certs);
+		REQUIRE(records.size() == certs.size());
+		for (std::size_t i = 0; i < certs.size(); ++i) {
+			DANERecord expected(TrustAnchorAssertion, SubjectPublicKeyInfo, SHA512Hash, certs[i]);
+			CHECK(records[i].usage() == expected.usage());
+			CHECK(records[i].selector() == expected.selector());
+			CHECK(records[i].matching() == expected.matching());
+			CHECK(records[i].data() == expected.data());
+			CHECK(records[i].verify(certs[i]));
+		}
+	}
+}
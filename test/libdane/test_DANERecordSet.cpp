@@ -0,0 +1,246 @@
+/**
+ * test_DANERecordSet.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/DANERecordSet.h>
+#include <libdane/Certificate.h>
+#include "../resources.h"
+
+using namespace libdane;
+
+namespace
+{
+	/// Verifies a certificate against each record in turn, like libdane::verify()
+	bool verify_each(const std::vector<DANERecord> &records, bool preverified, const Certificate &cert, const std::deque<Certificate> &chain)
+	{
+		for (const DANERecord &rec : records) {
+			if (rec.verify(preverified, cert, chain)) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+SCENARIO("Record sets verify like their records")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	REQUIRE(chain.size() == 3);
+	
+	std::deque<Certificate> other = Certificate::parsePEM(resources::microsoftPEM);
+	REQUIRE(other.size() == 2);
+	
+	GIVEN("Records of every type, for the leaf and the root")
+	{
+		std::vector<DANERecord> all;
+		for (int u = CAConstraints; u <= DomainIssuedCertificate; ++u) {
+			for (int s = FullCertificate; s <= SubjectPublicKeyInfo; ++s) {
+				for (int m = ExactMatch; m <= SHA512Hash; ++m) {
+					const Certificate &cert = (u == CAConstraints || u == TrustAnchorAssertion) ? chain.back() : chain.front();
+					all.emplace_back(Usage(u), Selector(s), MatchingType(m), cert);
+				}
+			}
+		}
+		
+		THEN("Each record alone should give the same results")
+		{
+			for (const DANERecord &rec : all) {
+				std::vector<DANERecord> records(1, rec);
+				DANERecordSet set(records.begin(), records.end());
+				REQUIRE(set.size() == 1);
+				
+				for (bool preverified : { true, false }) {
+					for (const std::deque<Certificate> *c : { &chain, &other }) {
+						for (const Certificate &cert : *c) {
+							INFO(rec.toString() << ", preverified=" << preverified << ", " << cert.subjectDN());
+							CHECK(set.verify(preverified, cert, *c) == verify_each(records, preverified, cert, *c));
+						}
+					}
+				}
+			}
+		}
+		
+		THEN("Mixed sets should give the same results")
+		{
+			// Pair up every record with every other, in both orders
+			for (const DANERecord &a : all) {
+				for (const DANERecord &b : all) {
+					std::vector<DANERecord> records = { a, b };
+					DANERecordSet set(records.begin(), records.end());
+					
+					for (bool preverified : { true, false }) {
+						for (const Certificate &cert : other) {
+							CHECK(set.verify(preverified, cert, other) == verify_each(records, preverified, cert, other));
+						}
+						for (const Certificate &cert : chain) {
+							CHECK(set.verify(preverified, cert, chain) == verify_each(records, preverified, cert, chain));
+						}
+					}
+				}
+			}
+		}
+	}
+	
+	GIVEN("Several records sharing a type")
+	{
+		std::vector<DANERecord> records = {
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, other[0]),
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, other[1]),
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain[0]),
+		};
+		DANERecordSet set(records.begin(), records.end());
+		
+		THEN("Any of them should match")
+		{
+			CHECK(set.size() == 3);
+			CHECK(set.verify(false, chain[0], chain));
+			CHECK(set.verify(false, other[0], other));
+		}
+		
+		THEN("Clearing it should leave nothing to match")
+		{
+			set.clear();
+			CHECK(set.empty());
+			CHECK_FALSE(set.verify(false, chain[0], chain));
+		}
+	}
+	
+	GIVEN("A large set of records, one of which matches")
+	{
+		DANERecordSet set;
+		std::vector<unsigned char> data(32);
+		for (int i = 0; i < 1000; ++i) {
+			data[0] = i & 0xFF;
+			data[31] = i >> 8;
+			set.add(DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, data));
+			set.add(DANERecord(DomainIssuedCertificate, FullCertificate, ExactMatch, other[i % 2].encoded()));
+		}
+		set.add(DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain[0]));
+		
+		THEN("Only the matching certificate should pass")
+		{
+			CHECK(set.size() == 2001);
+			CHECK(set.verify(false, chain[0], chain));
+			CHECK(set.verify(false, other[0], other));
+			
+			std::deque<Certificate> unrelated = { chain[1], chain[2] };
+			CHECK_FALSE(set.verify(false, unrelated[0], unrelated));
+		}
+	}
+	
+	GIVEN("A set pinning the google.com leaf")
+	{
+		std::vector<DANERecord> records = {
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain[0]),
+		};
+		DANERecordSet set(records.begin(), records.end());
+		
+		THEN("The whole chain should pass")
+		{
+			CHECK(set.verifyChain(false, chain));
+		}
+		
+		THEN("Other chains should fail")
+		{
+			CHECK_FALSE(set.verifyChain(false, other));
+		}
+		
+		THEN("Chains with a broken link should fail")
+		{
+			std::deque<Certificate> broken = { chain[0], other[1] };
+			CHECK_FALSE(set.verifyChain(false, broken));
+		}
+		
+		THEN("Empty chains should fail")
+		{
+			CHECK_FALSE(set.verifyChain(false, std::deque<Certificate>()));
+		}
+	}
+	
+	GIVEN("An empty set")
+	{
+		DANERecordSet set;
+		
+		THEN("Nothing should pass")
+		{
+			CHECK_FALSE(set.verify(true, chain[1], chain));
+			CHECK_FALSE(set.verify(true, chain[0], chain));
+		}
+	}
+	
+	GIVEN("An invalid record")
+	{
+		DANERecordSet set;
+		
+		THEN("Adding it should throw")
+		{
+			CHECK_THROWS(set.add(DANERecord(Usage(4), FullCertificate, SHA256Hash, chain[0].digest(FullCertificate, SHA256Hash))));
+			CHECK_THROWS(set.add(DANERecord(DomainIssuedCertificate, Selector(2), SHA256Hash, chain[0].digest(FullCertificate, SHA256Hash))));
+			CHECK_THROWS(set.add(DANERecord(DomainIssuedCertificate, FullCertificate, MatchingType(3), chain[0].digest(FullCertificate, SHA256Hash))));
+			CHECK(set.empty());
+		}
+		
+		THEN("Adding one with data that doesn't fit its matching type should throw")
+		{
+			std::vector<unsigned char> none;
+			CHECK_THROWS_AS(set.add(DANERecord(DomainIssuedCertificate, FullCertificate, SHA256Hash, none)), std::runtime_error);
+			CHECK_THROWS_AS(set.add(DANERecord(DomainIssuedCertificate, FullCertificate, SHA512Hash, none)), std::runtime_error);
+			CHECK_THROWS_AS(set.add(DANERecord(DomainIssuedCertificate, FullCertificate, ExactMatch, none)), std::runtime_error);
+			CHECK_THROWS_AS(set.add(DANERecord(DomainIssuedCertificate, FullCertificate, SHA256Hash, chain[0].digest(FullCertificate, SHA512Hash))), std::runtime_error);
+			CHECK(set.empty());
+		}
+	}
+}
+
+SCENARIO("Record sets try the last matching group first")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	
+	GIVEN("A set where the matching record is the most expensive to reach")
+	{
+		std::vector<DANERecord> records = {
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, std::vector<unsigned char>(32, 0xAB)),
+			DANERecord(DomainIssuedCertificate, FullCertificate, SHA256Hash, std::vector<unsigned char>(32, 0xCD)),
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA512Hash, chain.front()),
+		};
+		DANERecordSet set(records.begin(), records.end());
+		
+		THEN("Only the first verification should look in every group")
+		{
+			CHECK(set.verify(false, chain.front(), chain));
+			CHECK(set.lookups() == 3);
+			
+			CHECK(set.verify(false, chain.front(), chain));
+			CHECK(set.lookups() == 4);
+			CHECK(set.verifications() == 2);
+			CHECK(set.averageLookups() == 2.0);
+			
+			THEN("Other certificates should still be checked against every group")
+			{
+				set.resetStats();
+				CHECK_FALSE(set.verify(false, chain[1], std::deque<Certificate>(chain.begin() + 1, chain.end())));
+				CHECK(set.lookups() == 3);
+			}
+			
+			THEN("Copies should remember it")
+			{
+				DANERecordSet copy(set);
+				copy.resetStats();
+				CHECK(copy.verify(false, chain.front(), chain));
+				CHECK(copy.lookups() == 1);
+			}
+			
+			THEN("Adding a group should forget it")
+			{
+				set.add(DANERecord(DomainIssuedCertificate, FullCertificate, SHA512Hash, std::vector<unsigned char>(64, 0xEF)));
+				set.resetStats();
+				CHECK(set.verify(false, chain.front(), chain));
+				CHECK(set.lookups() == 3);
+			}
+		}
+	}
+}
@@ -0,0 +1,182 @@
+/**
+ * test_HandshakeVerifier.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/HandshakeVerifier.h>
+#include <libdane/SignatureCache.h>
+#include <libdane/VerdictCache.h>
+#include "../resources.h"
+#include "../handshake.h"
+#include <functional>
+#include <memory>
+
+using namespace libdane;
+
+SCENARIO("Handshakes are evaluated once")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::deque<Certificate> other = Certificate::parsePEM(resources::microsoftPEM);
+	
+	GIVEN("Records for every usage")
+	{
+		for (int u = CAConstraints; u <= DomainIssuedCertificate; ++u) {
+			const Certificate &cert = (u == CAConstraints || u == TrustAnchorAssertion) ? chain.back() : chain.front();
+			std::vector<DANERecord> records(1, DANERecord(Usage(u), SubjectPublicKeyInfo, SHA256Hash, cert));
+			DANERecordSet set(records.begin(), records.end());
+			INFO(records[0].toString());
+			
+			THEN("Every depth should get the same verdict as verifying it alone")
+			{
+				for (bool preverified : { false, true }) {
+					resources::handshake(chain, [&](bool, X509_STORE_CTX *ctx) {
+						VerifyContext vctx(ctx);
+						CHECK(HandshakeVerifier::verify(set, preverified, ctx) == set.verify(preverified, vctx));
+						return true;
+					});
+				}
+			}
+		}
+	}
+	
+	GIVEN("A DomainIssuedCertificate record")
+	{
+		std::vector<DANERecord> records(1, DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain.front()));
+		DANERecordSet set(records.begin(), records.end());
+		
+		THEN("The chain should only be evaluated by the first callback")
+		{
+			HandshakeVerifier *first = nullptr;
+			int calls = 0;
+			bool result = resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+				bool verdict = HandshakeVerifier::verify(set, preverified, ctx);
+				HandshakeVerifier *verifier = HandshakeVerifier::attached(ctx);
+				REQUIRE(verifier);
+				if (!first) {
+					first = verifier;
+				}
+				CHECK(verifier == first);
+				CHECK(&verifier->set() == &set);
+				++calls;
+				return verdict;
+			});
+			CHECK(result);
+			CHECK(calls == 3);
+		}
+		
+		THEN("A different chain should fail")
+		{
+			CHECK_FALSE(resources::handshake(other, [&](bool preverified, X509_STORE_CTX *ctx) {
+				return HandshakeVerifier::verify(set, preverified, ctx);
+			}));
+		}
+		
+		THEN("A chain rebuilt with other certificates should be evaluated again")
+		{
+			resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+				CHECK(HandshakeVerifier::verify(set, preverified, ctx) == set.verify(preverified, VerifyContext(ctx)));
+				
+				// Same length, different leaf
+				STACK_OF(X509) *live = X509_STORE_CTX_get0_chain(ctx);
+				X509 *leaf = sk_X509_value(live, 0);
+				sk_X509_set(live, 0, other.front().x509());
+				HandshakeVerifier::verify(set, preverified, ctx);
+				CHECK_FALSE(HandshakeVerifier::attached(ctx)->verdict(0, false));
+				sk_X509_set(live, 0, leaf);
+				
+				CHECK(HandshakeVerifier::verify(set, preverified, ctx) == set.verify(preverified, VerifyContext(ctx)));
+				CHECK(HandshakeVerifier::attached(ctx)->verdict(0, false));
+				return true;
+			});
+		}
+		
+		THEN("Depths outside of the chain should fail")
+		{
+			resources::handshake(chain, [&](bool, X509_STORE_CTX *ctx) {
+				HandshakeVerifier verifier(set, VerifyContext(ctx));
+				CHECK(verifier.verdict(0, true));
+				CHECK_FALSE(verifier.verdict(-1, true));
+				CHECK_FALSE(verifier.verdict(3, true));
+				return true;
+			});
+		}
+	}
+	
+	GIVEN("A CAConstraints record")
+	{
+		std::vector<DANERecord> records(1, DANERecord(CAConstraints, SubjectPublicKeyInfo, SHA256Hash, chain.back()));
+		DANERecordSet set(records.begin(), records.end());
+		
+		THEN("The root should only pass if trusted")
+		{
+			resources::handshake(chain, [&](bool, X509_STORE_CTX *ctx) {
+				HandshakeVerifier verifier(set, VerifyContext(ctx));
+				CHECK(verifier.verdict(2, true));
+				CHECK_FALSE(verifier.verdict(2, false));
+				return true;
+			});
+		}
+	}
+}
+
+SCENARIO("Handshakes check each link at most once")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	SignatureCache &cache = SignatureCache::shared();
+	
+	for (Usage usage : { TrustAnchorAssertion, DomainIssuedCertificate }) {
+		const Certificate &cert = usage == TrustAnchorAssertion ? chain.back() : chain.front();
+		std::vector<DANERecord> records(1, DANERecord(usage, SubjectPublicKeyInfo, SHA256Hash, cert));
+		DANERecordSet set(records.begin(), records.end());
+		
+		// Pretend OpenSSL didn't like it, which is where DANE comes in
+		cache.clear();
+		bool result = resources::handshake(chain, [&](bool, X509_STORE_CTX *ctx) {
+			return HandshakeVerifier::verify(set, false, ctx);
+		});
+		
+		INFO(records[0].toString());
+		CHECK(result);
+		if (usage == DomainIssuedCertificate) {
+			CHECK(cache.hits() + cache.misses() == 0);
+		} else {
+			CHECK(cache.hits() + cache.misses() == 2);
+		}
+	}
+}
+
+SCENARIO("Handshakes only cache trusted verdicts once OpenSSL is done")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::vector<DANERecord> records(1, DANERecord(CAConstraints, SubjectPublicKeyInfo, SHA256Hash, chain.back()));
+	DANERecordSet set(records.begin(), records.end());
+	VerdictCache cache;
+	set.setVerdictCache(&cache);
+	set.setTTL(300);
+	
+	GIVEN("A chain OpenSSL trusts")
+	{
+		std::vector<std::size_t> sizes;
+		bool result = resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+			bool verdict = HandshakeVerifier::verify(set, preverified, ctx);
+			sizes.push_back(cache.size());
+			return verdict;
+		});
+		
+		THEN("It should pass")
+		{
+			CHECK(result);
+		}
+		
+		THEN("Only the leaf's trusted verdict should be cached")
+		{
+			// Every untrusted verdict is cached up front; trusted ones for
+			// links above the leaf were evaluated before OpenSSL had checked
+			// the links below them
+			CHECK(sizes == std::vector<std::size_t>({ 3, 3, 4 }));
+		}
+	}
+}
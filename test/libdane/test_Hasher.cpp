@@ -0,0 +1,236 @@
+/**
+ * test_Hasher.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/Hasher.h>
+#include <libdane/Util.h>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <list>
+#include <new>
+#include <stdexcept>
+
+using namespace libdane;
+
+// Count every allocation made through operator new in this binary; OpenSSL's
+// own allocations go through malloc, and aren't what's being tested here
+static std::size_t allocations = 0;
+
+void *operator new(std::size_t size)
+{
+	++allocations;
+	if (void *ptr = std::malloc(size ? size : 1)) {
+		return ptr;
+	}
+	throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept
+{
+	std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept
+{
+	std::free(ptr);
+}
+
+/// Counts the allocations made by a function
+template<typename FuncT>
+static std::size_t count_allocations(FuncT fn)
+{
+	std::size_t before = allocations;
+	fn();
+	return allocations - before;
+}
+
+SCENARIO("Hasher works")
+{
+	std::string str("lorem ipsum dolor sit amet");
+	std::string sha256 = "2f8586076db2559d3e72a43c4ae8a1f5957abb23ca4a1f46e380dd640536eedb";
+	
+	GIVEN("A hasher")
+	{
+		Hasher hasher(EVP_sha256());
+		
+		THEN("It should know its size")
+		{
+			CHECK(hasher.size() == 32);
+		}
+		
+		THEN("Hashing in one go should give the right result")
+		{
+			hasher.update(str);
+			std::vector<unsigned char> digest(hasher.size());
+			CHECK(hasher.final(digest.data()) == 32);
+			CHECK(to_hex(digest) == sha256);
+		}
+		
+		THEN("Hashing in pieces should give the same result")
+		{
+			hasher.update(str.data(), 6);
+			hasher.update(ByteView(reinterpret_cast<const unsigned char*>(str.data()) + 6, 6));
+			std::deque<char> rest(str.begin() + 12, str.end());
+			hasher.update(rest.begin(), rest.end());
+			
+			std::vector<unsigned char> digest;
+			hasher.final(std::back_inserter(digest));
+			CHECK(to_hex(digest) == sha256);
+		}
+		
+		THEN("Empty updates should be ignored")
+		{
+			std::deque<char> empty;
+			hasher.update(empty.begin(), empty.end());
+			hasher.update(nullptr, 0);
+			hasher.update(str.begin(), str.end());
+			hasher.update(std::string());
+			
+			std::vector<unsigned char> digest;
+			hasher.final(std::back_inserter(digest));
+			CHECK(to_hex(digest) == sha256);
+		}
+	}
+	
+	GIVEN("More data than fits in a buffer at once")
+	{
+		std::vector<unsigned char> data(4096 + 17);
+		for (std::size_t i = 0; i < data.size(); ++i) {
+			data[i] = static_cast<unsigned char>(i * 31);
+		}
+		
+		THEN("Non-contiguous ranges should give the same result")
+		{
+			std::deque<unsigned char> deque(data.begin(), data.end());
+			std::list<unsigned char> list(data.begin(), data.end());
+			CHECK(hash(EVP_sha512(), deque.begin(), deque.end()) == hash(EVP_sha512(), data));
+			CHECK(hash(EVP_sha512(), list.begin(), list.end()) == hash(EVP_sha512(), data));
+		}
+		
+		THEN("Wide values should be hashed as their representation")
+		{
+			std::vector<std::uint32_t> words(data.size() / 4);
+			std::memcpy(words.data(), data.data(), words.size() * 4);
+			std::deque<std::uint32_t> deque(words.begin(), words.end());
+			
+			std::vector<unsigned char> expected = hash(EVP_sha256(), data.begin(), data.begin() + words.size() * 4);
+			CHECK(hash(EVP_sha256(), words.begin(), words.end()) == expected);
+			CHECK(hash(EVP_sha256(), deque.begin(), deque.end()) == expected);
+		}
+	}
+	
+	GIVEN("An invalid digest")
+	{
+		THEN("It should throw")
+		{
+			CHECK_THROWS_AS(Hasher(nullptr), std::runtime_error);
+		}
+	}
+}
+
+SCENARIO("hash() and match() don't copy their input")
+{
+	std::string str("lorem ipsum dolor sit amet");
+	std::string sha256 = "2f8586076db2559d3e72a43c4ae8a1f5957abb23ca4a1f46e380dd640536eedb";
+	
+	const unsigned char *bytes = reinterpret_cast<const unsigned char*>(str.data());
+	std::vector<unsigned char> vec(str.begin(), str.end());
+	std::deque<char> deque(str.begin(), str.end());
+	std::wstring wstr(L"lorem ipsum");
+	
+	// What ldns_rdf_data() and ByteView::data() hand out
+	const std::uint8_t *rdf = bytes;
+	ByteView view(bytes, str.size());
+	
+	// Warm up the thread's context, and the fetched digests
+	hash(EVP_sha256(), str);
+	hash(EVP_sha512(), str);
+	
+	GIVEN("An output buffer")
+	{
+		unsigned char out[EVP_MAX_MD_SIZE];
+		
+		THEN("Hashing pointers shouldn't allocate")
+		{
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, bytes, bytes + str.size()); }) == 0);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, rdf, rdf + str.size()); }) == 0);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, str.data(), str.data() + str.size()); }) == 0);
+			CHECK(to_hex(std::vector<unsigned char>(out, out + 32)) == sha256);
+		}
+		
+		THEN("Hashing vectors shouldn't allocate")
+		{
+			CHECK(count_allocations([&]{ hash<unsigned char>(EVP_sha256(), out, vec.cbegin(), vec.cend()); }) == 0);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, vec.begin(), vec.end()); }) == 0);
+			CHECK(to_hex(std::vector<unsigned char>(out, out + 32)) == sha256);
+		}
+		
+		THEN("Hashing strings shouldn't allocate")
+		{
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, wstr.begin(), wstr.end()); }) == 0);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, str.begin(), str.end()); }) == 0);
+			CHECK(to_hex(std::vector<unsigned char>(out, out + 32)) == sha256);
+		}
+		
+		THEN("Hashing deques shouldn't allocate")
+		{
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, deque.begin(), deque.end()); }) == 0);
+			CHECK(to_hex(std::vector<unsigned char>(out, out + 32)) == sha256);
+		}
+		
+		THEN("Hashing views shouldn't allocate")
+		{
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), out, view.begin(), view.end()); }) == 0);
+			CHECK(to_hex(std::vector<unsigned char>(out, out + 32)) == sha256);
+		}
+		
+		THEN("Matching shouldn't allocate")
+		{
+			CHECK(count_allocations([&]{ match(SHA512Hash, out, view.begin(), view.end()); }) == 0);
+			CHECK(count_allocations([&]{ match(SHA256Hash, out, deque.begin(), deque.end()); }) == 0);
+			CHECK(to_hex(std::vector<unsigned char>(out, out + 32)) == sha256);
+		}
+		
+		THEN("A Hasher on the thread's context shouldn't allocate")
+		{
+			CHECK(count_allocations([&]{
+				Hasher hasher(EVP_sha256(), internal::digest_context());
+				hasher.update(view);
+				hasher.final(out);
+			}) == 0);
+			CHECK(to_hex(std::vector<unsigned char>(out, out + 32)) == sha256);
+		}
+	}
+	
+	GIVEN("The convenience overloads")
+	{
+		THEN("They should only allocate their results")
+		{
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), deque.begin(), deque.end()); }) == 1);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), vec); }) == 1);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), str); }) == 1);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), wstr); }) == 1);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), "lorem ipsum dolor sit amet"); }) == 1);
+			CHECK(count_allocations([&]{ hash(EVP_sha256(), view.begin(), view.end()); }) == 1);
+			CHECK(count_allocations([&]{ match(SHA256Hash, deque.begin(), deque.end()); }) == 1);
+			CHECK(count_allocations([&]{ match(SHA256Hash, str); }) == 1);
+			CHECK(count_allocations([&]{ match(SHA256Hash, "lorem ipsum dolor sit amet"); }) == 1);
+		}
+		
+		THEN("They should still give the right results")
+		{
+			CHECK(to_hex(hash(EVP_sha256(), deque.begin(), deque.end())) == sha256);
+			CHECK(to_hex(hash(EVP_sha256(), "lorem ipsum dolor sit amet")) == sha256);
+			CHECK(to_hex(match(SHA256Hash, deque.begin(), deque.end())) == sha256);
+			CHECK(to_hex(match(SHA256Hash, "lorem ipsum dolor sit amet")) == sha256);
+			CHECK(match(ExactMatch, "lorem ipsum dolor sit amet") == vec);
+			CHECK(hash(EVP_sha256(), wstr) == hash(EVP_sha256(), reinterpret_cast<const unsigned char*>(wstr.data()), reinterpret_cast<const unsigned char*>(wstr.data() + wstr.size())));
+		}
+	}
+}
@@ -0,0 +1,99 @@
+/**
+ * test_Matcher.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/Matcher.h>
+#include <libdane/DANERecord.h>
+#include "../resources.h"
+
+using namespace libdane;
+
+SCENARIO("Matchers can be looked up")
+{
+	GIVEN("Every valid combination")
+	{
+		THEN("The right matcher should be returned")
+		{
+			for (int u = CAConstraints; u <= DomainIssuedCertificate; ++u) {
+				for (int s = FullCertificate; s <= SubjectPublicKeyInfo; ++s) {
+					for (int m = ExactMatch; m <= SHA512Hash; ++m) {
+						const MatcherFunctions *matcher = matcher_for(Usage(u), Selector(s), MatchingType(m));
+						REQUIRE(matcher != nullptr);
+						CHECK(matcher->usage == u);
+						CHECK(matcher->selector == s);
+						CHECK(matcher->matching == m);
+					}
+				}
+			}
+		}
+	}
+	
+	GIVEN("Invalid combinations")
+	{
+		THEN("Nothing should be returned")
+		{
+			CHECK(matcher_for(Usage(4), FullCertificate, SHA256Hash) == nullptr);
+			CHECK(matcher_for(DomainIssuedCertificate, Selector(2), SHA256Hash) == nullptr);
+			CHECK(matcher_for(DomainIssuedCertificate, FullCertificate, MatchingType(3)) == nullptr);
+			CHECK(matcher_for(DomainIssuedCertificate, FullCertificate, MatchingType(-1)) == nullptr);
+		}
+	}
+}
+
+SCENARIO("Matchers verify like the records they specialize")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::deque<Certificate> other = Certificate::parsePEM(resources::microsoftPEM);
+	
+	GIVEN("Records of every type")
+	{
+		THEN("Digests should match the runtime-dispatched ones")
+		{
+			for (int s = FullCertificate; s <= SubjectPublicKeyInfo; ++s) {
+				for (int m = ExactMatch; m <= SHA512Hash; ++m) {
+					const MatcherFunctions *matcher = matcher_for(DomainIssuedCertificate, Selector(s), MatchingType(m));
+					CHECK(&matcher->digest(chain[0]) == &chain[0].digest(Selector(s), MatchingType(m)));
+				}
+			}
+		}
+		
+		THEN("Only the right certificate should match")
+		{
+			for (int u = CAConstraints; u <= DomainIssuedCertificate; ++u) {
+				for (int s = FullCertificate; s <= SubjectPublicKeyInfo; ++s) {
+					for (int m = ExactMatch; m <= SHA512Hash; ++m) {
+						const MatcherFunctions *matcher = matcher_for(Usage(u), Selector(s), MatchingType(m));
+						DANERecord rec(Usage(u), Selector(s), MatchingType(m), chain[0]);
+						CHECK(matcher->match(rec.data(), chain[0]));
+						CHECK_FALSE(matcher->match(rec.data(), other[0]));
+					}
+				}
+			}
+		}
+		
+		THEN("The right end of the chain should be checked")
+		{
+			std::vector<unsigned char> garbage(32, 0xFE);
+			
+			// Leaf-pinning usages pass everything but the leaf
+			CHECK(Matcher<DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[1], chain));
+			CHECK(Matcher<DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[2], chain));
+			CHECK_FALSE(Matcher<DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[0], chain));
+			
+			// Anchor-pinning usages pass everything but the root
+			CHECK(Matcher<TrustAnchorAssertion, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[0], chain));
+			CHECK(Matcher<TrustAnchorAssertion, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[1], chain));
+			CHECK_FALSE(Matcher<TrustAnchorAssertion, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[2], chain));
+			
+			// PKIX usages need preverification
+			CHECK_FALSE(Matcher<CAConstraints, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[0], chain));
+			CHECK(Matcher<CAConstraints, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, true, chain[0], chain));
+			CHECK_FALSE(Matcher<ServiceCertificateConstraint, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, false, chain[1], chain));
+			CHECK(Matcher<ServiceCertificateConstraint, SubjectPublicKeyInfo, SHA256Hash>::verify(garbage, true, chain[1], chain));
+		}
+	}
+}
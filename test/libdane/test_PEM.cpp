@@ -0,0 +1,94 @@
+/**
+ * test_PEM.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/PEM.h>
+#include <libdane/Util.h>
+#include <cstring>
+#include <string>
+
+using namespace libdane;
+
+SCENARIO("PEM blocks can be found")
+{
+	GIVEN("A string with two blocks and some noise")
+	{
+		std::string str = "noise\n-----BEGIN THING-----\nAAAA\n-----END THING-----\nmore noise\n-----BEGIN THING-----\r\nBBBB\r\n-----END THING-----";
+		const char *begin = str.data();
+		const char *end = str.data() + str.size();
+		const char *body_begin, *body_end;
+		
+		THEN("Both blocks should be found, in order")
+		{
+			const char *it = pem_find(begin, end, "THING", body_begin, body_end);
+			REQUIRE(it != nullptr);
+			CHECK(std::string(body_begin, body_end) == "\nAAAA\n");
+			
+			it = pem_find(it, end, "THING", body_begin, body_end);
+			REQUIRE(it != nullptr);
+			CHECK(it == end);
+			CHECK(std::string(body_begin, body_end) == "\r\nBBBB\r\n");
+			
+			CHECK(pem_find(it, end, "THING", body_begin, body_end) == nullptr);
+		}
+		
+		THEN("Blocks with other labels should not be found")
+		{
+			CHECK(pem_find(begin, end, "OTHER THING", body_begin, body_end) == nullptr);
+		}
+	}
+	
+	GIVEN("A block with no END line")
+	{
+		std::string str = "-----BEGIN THING-----\nAAAA\n";
+		const char *body_begin, *body_end;
+		
+		THEN("It should not be found")
+		{
+			CHECK(pem_find(str.data(), str.data() + str.size(), "THING", body_begin, body_end) == nullptr);
+		}
+	}
+}
+
+SCENARIO("Base64 can be decoded")
+{
+	std::vector<unsigned char> out;
+	
+	GIVEN("Valid base64 with whitespace in it")
+	{
+		std::string str = "bG9y\r\nZW0g aXBz\tdW0=\n";
+		
+		THEN("It should decode correctly")
+		{
+			REQUIRE(base64_decode(str.data(), str.data() + str.size(), out));
+			CHECK(std::string(out.begin(), out.end()) == "lorem ipsum");
+		}
+	}
+	
+	GIVEN("Different amounts of padding")
+	{
+		THEN("It should decode correctly")
+		{
+			const char *a = "Zg==", *b = "Zm8=", *c = "Zm9v";
+			REQUIRE(base64_decode(a, a + 4, out));
+			REQUIRE(base64_decode(b, b + 4, out));
+			REQUIRE(base64_decode(c, c + 4, out));
+			CHECK(std::string(out.begin(), out.end()) == "ffofoo");
+		}
+	}
+	
+	GIVEN("Invalid base64")
+	{
+		THEN("It should be rejected")
+		{
+			const char *strs[] = { "Zm9v!", "Z", "Zg=", "Zg===", "Zg==Zg==" };
+			for (const char *str : strs) {
+				CHECK_FALSE(base64_decode(str, str + std::strlen(str), out));
+			}
+		}
+	}
+}
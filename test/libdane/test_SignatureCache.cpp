@@ -0,0 +1,109 @@
+/**
+ * test_SignatureCache.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/SignatureCache.h>
+#include <libdane/Certificate.h>
+#include "../resources.h"
+
+using namespace libdane;
+
+SCENARIO("Signature checks are cached")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::deque<Certificate> other = Certificate::parsePEM(resources::microsoftPEM);
+	
+	GIVEN("An empty cache")
+	{
+		SignatureCache cache(2);
+		
+		THEN("Lookups should miss")
+		{
+			CHECK_FALSE(cache.contains(chain[0], chain[1]));
+			CHECK(cache.hits() == 0);
+			CHECK(cache.misses() == 1);
+		}
+		
+		WHEN("A pair is inserted")
+		{
+			cache.insert(chain[0], chain[1]);
+			
+			THEN("Looking it up should hit")
+			{
+				CHECK(cache.contains(chain[0], chain[1]));
+				CHECK(cache.hits() == 1);
+			}
+			
+			THEN("Looking up the reverse pair should miss")
+			{
+				CHECK_FALSE(cache.contains(chain[1], chain[0]));
+				CHECK(cache.misses() == 1);
+			}
+			
+			THEN("Clearing it should remove everything")
+			{
+				cache.clear();
+				CHECK(cache.size() == 0);
+				CHECK_FALSE(cache.contains(chain[0], chain[1]));
+			}
+		}
+		
+		WHEN("More pairs than the capacity are inserted")
+		{
+			cache.insert(chain[0], chain[1]);
+			cache.insert(chain[1], chain[2]);
+			CHECK(cache.contains(chain[0], chain[1]));
+			cache.insert(other[0], other[1]);
+			
+			THEN("The least recently used one should be evicted")
+			{
+				CHECK(cache.size() == 2);
+				CHECK(cache.evictions() == 1);
+				CHECK(cache.contains(chain[0], chain[1]));
+				CHECK_FALSE(cache.contains(chain[1], chain[2]));
+				CHECK(cache.contains(other[0], other[1]));
+			}
+		}
+	}
+	
+	GIVEN("A disabled cache")
+	{
+		SignatureCache cache(0);
+		cache.insert(chain[0], chain[1]);
+		
+		THEN("Nothing should be stored")
+		{
+			CHECK(cache.size() == 0);
+			CHECK_FALSE(cache.contains(chain[0], chain[1]));
+		}
+	}
+	
+	GIVEN("The shared cache")
+	{
+		SignatureCache &cache = SignatureCache::shared();
+		cache.clear();
+		
+		THEN("Certificate::verify() should only check each passing pair once")
+		{
+			CHECK(chain[0].verify(chain[1]));
+			CHECK(cache.misses() == 1);
+			CHECK(cache.hits() == 0);
+			
+			CHECK(chain[0].verify(chain[1]));
+			CHECK(cache.misses() == 1);
+			CHECK(cache.hits() == 1);
+		}
+		
+		THEN("Failed checks should not be cached")
+		{
+			CHECK_FALSE(chain[1].verify(chain[0]));
+			CHECK_FALSE(chain[1].verify(chain[0]));
+			CHECK(cache.size() == 0);
+			CHECK(cache.misses() == 2);
+		}
+	}
+}
@@ -7,7 +7,10 @@
 
 #include <catch.hpp>
 #include <libdane/Util.h>
+#include <cstdio>
+#include <random>
 #include <stdexcept>
+#include <thread>
 
 using namespace libdane;
 
@@ -71,11 +74,23 @@ SCENARIO("from_hex() works")
 	
 	GIVEN("Garbage data")
 	{
-		std::vector<unsigned char> data = from_hex("lorem ipsum dolor sit amet");
+		THEN("It should be rejected, not crash")
+		{
+			REQUIRE_THROWS_AS(from_hex("lorem ipsum dolor sit amet"), std::invalid_argument);
+			REQUIRE_THROWS_AS(from_hex("13370"), std::invalid_argument);
+			REQUIRE_THROWS_AS(from_hex("13 7"), std::invalid_argument);
+			REQUIRE_THROWS_AS(from_hex(std::string(1000, 'a') + "g"), std::invalid_argument);
+			REQUIRE_THROWS_AS(from_hex(std::wstring(L"\u0130\u0131")), std::invalid_argument);
+		}
+	}
+	
+	GIVEN("Mixed case")
+	{
+		std::vector<unsigned char> data = from_hex("aBcDeF");
 		
-		THEN("The resulting blob should be full of zeroes, not crash")
+		THEN("The hex string should be abcdef")
 		{
-			REQUIRE(to_hex(data) == "0000000000000d000000000a0e");
+			REQUIRE(to_hex(data) == "abcdef");
 		}
 	}
 }
@@ -431,6 +446,105 @@ SCENARIO("All hash() overloads work")
 	}
 }
 
+SCENARIO("hash() reuses its digest contexts")
+{
+	std::string str("lorem ipsum dolor sit amet");
+	std::string sha256 = "2f8586076db2559d3e72a43c4ae8a1f5957abb23ca4a1f46e380dd640536eedb";
+	
+	GIVEN("A single thread")
+	{
+		THEN("It should get the same context every time")
+		{
+			REQUIRE(internal::digest_context() != nullptr);
+			REQUIRE(internal::digest_context() == internal::digest_context());
+		}
+		
+		THEN("Switching between digests should give the right results")
+		{
+			for (int i = 0; i < 3; ++i) {
+				REQUIRE(to_hex(hash(EVP_sha256(), str)) == sha256);
+				REQUIRE(hash(EVP_sha512(), str).size() == 64);
+				REQUIRE(hash(EVP_sha1(), str).size() == 20);
+			}
+		}
+	}
+	
+	GIVEN("Several threads")
+	{
+		THEN("Each should get its own context")
+		{
+			EVP_MD_CTX *mine = internal::digest_context();
+			EVP_MD_CTX *theirs = nullptr;
+			std::string result;
+			std::thread thread([&]() {
+				theirs = internal::digest_context();
+				result = to_hex(hash(EVP_sha256(), str));
+			});
+			thread.join();
+			
+			REQUIRE(theirs != nullptr);
+			REQUIRE(theirs != mine);
+			REQUIRE(result == sha256);
+		}
+	}
+	
+	GIVEN("Fetched digests")
+	{
+		THEN("They should hash the same as the ones they replace")
+		{
+			REQUIRE(internal::fetched_md(nullptr) == nullptr);
+			REQUIRE(EVP_MD_size(internal::fetched_md(EVP_sha256())) == 32);
+			REQUIRE(EVP_MD_size(internal::fetched_md(EVP_sha512())) == 64);
+			REQUIRE(internal::fetched_md(EVP_sha1()) == EVP_sha1());
+		}
+	}
+}
+
+SCENARIO("hash_batch() matches hash()")
+{
+	std::mt19937 rng(1);
+	std::vector<std::vector<unsigned char>> buffers;
+	for (std::size_t size = 0; size <= 300; ++size) {
+		buffers.emplace_back(size);
+	}
+	buffers.emplace_back(5000);
+	for (std::vector<unsigned char> &buf : buffers) {
+		for (unsigned char &c : buf) {
+			c = rng() & 0xFF;
+		}
+	}
+	std::vector<ByteView> views(buffers.begin(), buffers.end());
+	
+	THEN("Every kernel should give the same digests as hash()")
+	{
+		for (const EVP_MD *md : { EVP_sha256(), EVP_sha512(), EVP_sha1() }) {
+			std::size_t size = EVP_MD_size(md);
+			for (const internal::HashKernel *kernel : internal::hash_kernels(md)) {
+				INFO("Digest: " << EVP_MD_name(md) << ", kernel: " << kernel->name);
+				
+				// Odd counts leave lanes empty
+				for (std::size_t count : { views.size(), std::size_t(7), std::size_t(1) }) {
+					std::vector<unsigned char> out(count * size);
+					kernel->hash(md, views.data(), count, out.data());
+					for (std::size_t i = 0; i < count; ++i) {
+						INFO("Buffer size: " << views[i].size());
+						REQUIRE(std::vector<unsigned char>(out.begin() + i * size, out.begin() + (i + 1) * size) == hash(md, buffers[i]));
+					}
+				}
+			}
+		}
+	}
+	
+	THEN("The public function should do the same")
+	{
+		std::vector<unsigned char> out(views.size() * 32);
+		hash_batch(EVP_sha256(), views.data(), views.size(), out.data());
+		REQUIRE(std::vector<unsigned char>(out.end() - 32, out.end()) == hash(EVP_sha256(), buffers.back()));
+		REQUIRE_NOTHROW(hash_batch(EVP_sha256(), nullptr, 0, nullptr));
+		REQUIRE_THROWS_AS(hash_batch(nullptr, views.data(), views.size(), out.data()), std::invalid_argument);
+	}
+}
+
 SCENARIO("md_from_matching_type() works")
 {
 	GIVEN("Hash types")
@@ -554,3 +668,52 @@ SCENARIO("All match() overloads work")
 		REQUIRE(match(ExactMatch, str.c_str()) == data);
 	}
 }
+
+SCENARIO("Every hex kernel gives the same results")
+{
+	std::mt19937 rng(1);
+	std::vector<unsigned char> data(300);
+	for (unsigned char &c : data) {
+		c = rng() & 0xFF;
+	}
+	
+	// Known good, slow implementation
+	std::string expected;
+	for (unsigned char c : data) {
+		char buf[3];
+		std::snprintf(buf, sizeof(buf), "%02x", c);
+		expected += buf;
+	}
+	
+	THEN("Every length should encode and decode correctly")
+	{
+		for (const internal::HexKernel *kernel : internal::hex_kernels()) {
+			INFO("Kernel: " << kernel->name);
+			for (std::size_t size = 0; size <= data.size(); ++size) {
+				std::string str(size * 2, '\0');
+				kernel->encode(data.data(), size, &str[0]);
+				REQUIRE(str == expected.substr(0, size * 2));
+				
+				std::vector<unsigned char> decoded(size);
+				REQUIRE(kernel->decode(str.data(), size, decoded.data()));
+				REQUIRE(decoded == std::vector<unsigned char>(data.begin(), data.begin() + size));
+			}
+		}
+	}
+	
+	THEN("Invalid characters should be caught anywhere")
+	{
+		std::vector<unsigned char> out(100);
+		for (const internal::HexKernel *kernel : internal::hex_kernels()) {
+			INFO("Kernel: " << kernel->name);
+			for (std::size_t i = 0; i < 200; ++i) {
+				for (char c : { 'g', 'G', '/', ':', '@', '`', ' ', '\0', '\x80', '\xB0' }) {
+					std::string str = expected.substr(0, 200);
+					str[i] = c;
+					INFO("Position " << i << ", character " << static_cast<int>(c));
+					REQUIRE_FALSE(kernel->decode(str.data(), 100, out.data()));
+				}
+			}
+		}
+	}
+}
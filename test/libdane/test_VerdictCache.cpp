@@ -0,0 +1,223 @@
+/**
+ * test_VerdictCache.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/VerdictCache.h>
+#include <libdane/DANERecordSet.h>
+#include <libdane/VerifyContext.h>
+#include "../resources.h"
+#include "../handshake.h"
+#include <functional>
+#include <memory>
+
+using namespace libdane;
+
+namespace
+{
+	/// A cache with a clock that only moves when told to
+	class ManualVerdictCache : public VerdictCache
+	{
+	public:
+		ManualVerdictCache(): m_now(Clock::now()) {}
+		void advance(std::uint32_t seconds) { m_now += std::chrono::seconds(seconds); }
+		
+	protected:
+		virtual Clock::time_point now() const { return m_now; }
+		
+	private:
+		Clock::time_point m_now;
+	};
+	
+	/// Returns a key that differs from those with other IDs
+	VerdictCache::Key make_key(unsigned char id)
+	{
+		VerdictCache::Key key = VerdictCache::Key();
+		key.rrset[0] = id;
+		return key;
+	}
+}
+
+SCENARIO("Verdict keys identify a verification exactly")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	std::deque<Certificate> other = Certificate::parsePEM(resources::microsoftPEM);
+	DANERecordSet::Digest rrset = {{ 1, 2, 3 }};
+	VerdictCache::Key key = VerdictCache::makeKey(rrset, true, 0, chain);
+	
+	THEN("The same inputs should give the same key")
+	{
+		CHECK(VerdictCache::makeKey(rrset, true, 0, chain) == key);
+	}
+	
+	THEN("Any difference that could change the verdict should give a different key")
+	{
+		DANERecordSet::Digest otherRRset = {{ 3, 2, 1 }};
+		CHECK(VerdictCache::makeKey(otherRRset, true, 0, chain) != key);
+		CHECK(VerdictCache::makeKey(rrset, false, 0, chain) != key);
+		CHECK(VerdictCache::makeKey(rrset, true, 1, chain) != key);
+		CHECK(VerdictCache::makeKey(rrset, true, 0, other) != key);
+		
+		std::deque<Certificate> reissued = { chain[0], other[1] };
+		CHECK(VerdictCache::makeKey(rrset, true, 0, reissued) != key);
+		
+		std::deque<Certificate> truncated(chain.begin(), chain.end() - 1);
+		CHECK(VerdictCache::makeKey(rrset, true, 1, truncated) != VerdictCache::makeKey(rrset, true, 1, chain));
+	}
+	
+	THEN("Depths outside of the chain should throw")
+	{
+		CHECK_THROWS(VerdictCache::makeKey(rrset, true, -1, chain));
+		CHECK_THROWS(VerdictCache::makeKey(rrset, true, 3, chain));
+	}
+	
+	THEN("Chains with fingerprints should be cacheable")
+	{
+		CHECK(VerdictCache::cacheable(0, chain));
+		CHECK(VerdictCache::cacheable(2, chain));
+		CHECK_FALSE(VerdictCache::cacheable(3, chain));
+	}
+	
+	THEN("Certificates that can't be encoded shouldn't be cacheable")
+	{
+		X509 *x509 = X509_new();
+		Certificate broken(x509);
+		X509_free(x509);
+		
+		CHECK_FALSE(VerdictCache::cacheable(0, { broken, chain[1] }));
+		CHECK_FALSE(VerdictCache::cacheable(0, { chain[0], broken }));
+		CHECK_FALSE(VerdictCache::cacheable(1, { chain[0], chain[1], broken }));
+	}
+}
+
+SCENARIO("Verdicts are cached until they expire")
+{
+	GIVEN("A cache with a verdict in it")
+	{
+		ManualVerdictCache cache;
+		VerdictCache::Key key = make_key(1), other = make_key(2);
+		cache.insert(key, true, 60);
+		REQUIRE(cache.size() == 1);
+		
+		THEN("It should be found")
+		{
+			bool verdict = false;
+			CHECK(cache.lookup(key, verdict));
+			CHECK(verdict);
+			CHECK_FALSE(cache.lookup(other, verdict));
+			CHECK(cache.hits() == 1);
+			CHECK(cache.misses() == 1);
+			CHECK(cache.hitRatio() == 0.5);
+		}
+		
+		THEN("It should expire with its TTL")
+		{
+			bool verdict;
+			cache.advance(59);
+			CHECK(cache.lookup(key, verdict));
+			cache.advance(1);
+			CHECK_FALSE(cache.lookup(key, verdict));
+			CHECK(cache.expirations() == 1);
+			CHECK(cache.size() == 0);
+		}
+		
+		THEN("TTLs should be capped")
+		{
+			bool verdict;
+			cache.setMaxTTL(10);
+			cache.insert(other, false, 60);
+			cache.advance(10);
+			CHECK_FALSE(cache.lookup(other, verdict));
+		}
+		
+		THEN("A TTL of 0 should not be cached")
+		{
+			cache.insert(other, false, 0);
+			CHECK(cache.size() == 1);
+		}
+	}
+	
+	GIVEN("A full cache")
+	{
+		VerdictCache cache(2);
+		for (unsigned char i = 0; i < 3; ++i) {
+			VerdictCache::Key key = make_key(i);
+			cache.insert(key, true, 60);
+		}
+		
+		THEN("The oldest entry should have been evicted")
+		{
+			bool verdict;
+			VerdictCache::Key first = make_key(0), last = make_key(2);
+			CHECK(cache.size() == 2);
+			CHECK(cache.evictions() == 1);
+			CHECK_FALSE(cache.lookup(first, verdict));
+			CHECK(cache.lookup(last, verdict));
+		}
+	}
+}
+
+SCENARIO("Record sets use verdict caches")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	
+	GIVEN("A set of records for google.com")
+	{
+		std::vector<DANERecord> records = {
+			DANERecord(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, chain.front()),
+			DANERecord(TrustAnchorAssertion, FullCertificate, SHA512Hash, chain.back()),
+		};
+		DANERecordSet set(records.begin(), records.end());
+		
+		THEN("Its digest should not depend on the order of the records")
+		{
+			DANERecordSet reversed(records.rbegin(), records.rend());
+			CHECK(reversed.digest() == set.digest());
+			CHECK(DANERecordSet().digest() != set.digest());
+			
+			reversed.clear();
+			CHECK(reversed.digest() == DANERecordSet().digest());
+		}
+		
+		THEN("Verdicts should be cached, and the same as uncached ones")
+		{
+			VerdictCache cache;
+			set.setVerdictCache(&cache);
+			set.setTTL(300);
+			
+			for (int round = 0; round < 2; ++round) {
+				std::vector<bool> results;
+				resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+					VerifyContext vctx(ctx);
+					bool result = set.verify(preverified, vctx);
+					
+					set.setVerdictCache(nullptr);
+					CHECK(set.verify(preverified, vctx) == result);
+					set.setVerdictCache(&cache);
+					
+					results.push_back(result);
+					return true;
+				});
+				CHECK(results == std::vector<bool>({ true, true, true }));
+			}
+			
+			CHECK(cache.size() == 3);
+			CHECK(cache.misses() == 3);
+			CHECK(cache.hits() == 3);
+		}
+		
+		THEN("Nothing should be cached without a TTL")
+		{
+			VerdictCache cache;
+			set.setVerdictCache(&cache);
+			resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+				set.verify(preverified, VerifyContext(ctx));
+				return true;
+			});
+			CHECK(cache.size() == 0);
+		}
+	}
+}
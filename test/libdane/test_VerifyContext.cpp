@@ -0,0 +1,129 @@
+/**
+ * test_VerifyContext.cpp
+ * test_libdane
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/VerifyContext.h>
+#include <libdane/CertificatePool.h>
+#include <libdane/SignatureCache.h>
+#include "../resources.h"
+#include "../handshake.h"
+#include <functional>
+#include <memory>
+
+using namespace libdane;
+
+SCENARIO("Verify contexts know where in the chain they are")
+{
+	GIVEN("The certificate chain for google.com")
+	{
+		std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+		
+		THEN("Every certificate should be found at its depth")
+		{
+			std::vector<int> depths;
+			resources::handshake(chain, [&](bool, X509_STORE_CTX *ctx) {
+				VerifyContext vctx(ctx);
+				REQUIRE(vctx.chain().size() == chain.size());
+				
+				int depth = vctx.depth();
+				depths.push_back(depth);
+				REQUIRE(depth >= 0);
+				CHECK(vctx.currentCert() == chain[depth]);
+				return true;
+			});
+			CHECK(depths == std::vector<int>({ 2, 1, 0 }));
+		}
+		
+		THEN("Pooled certificates should be found too")
+		{
+			CertificatePool pool;
+			std::deque<Certificate> pooled = Certificate::parsePEM(resources::googlePEM, &pool);
+			
+			std::vector<int> depths;
+			resources::handshake(chain, [&](bool, X509_STORE_CTX *ctx) {
+				VerifyContext vctx(ctx, &pool);
+				int depth = vctx.depth();
+				depths.push_back(depth);
+				REQUIRE(depth >= 0);
+				CHECK(vctx.currentCert().x509() == pooled[depth].x509());
+				return true;
+			});
+			CHECK(depths == std::vector<int>({ 2, 1, 0 }));
+		}
+	}
+	
+	GIVEN("An empty context")
+	{
+		VerifyContext vctx;
+		
+		THEN("There should be no current certificate")
+		{
+			CHECK(vctx.depth() == -1);
+			CHECK(!vctx.currentCert());
+		}
+	}
+}
+
+SCENARIO("Verify contexts only check links OpenSSL hasn't")
+{
+	std::deque<Certificate> chain = Certificate::parsePEM(resources::googlePEM);
+	SignatureCache &cache = SignatureCache::shared();
+	
+	GIVEN("A chain OpenSSL is happy with")
+	{
+		THEN("Preverified links should be taken at face value")
+		{
+			cache.clear();
+			resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+				VerifyContext vctx(ctx);
+				REQUIRE(preverified);
+				CHECK(vctx.verifyIssuer(preverified, vctx.depth()));
+				return true;
+			});
+			CHECK(cache.hits() + cache.misses() == 0);
+		}
+		
+		THEN("Other links should be checked, except for the root's")
+		{
+			cache.clear();
+			resources::handshake(chain, [&](bool, X509_STORE_CTX *ctx) {
+				VerifyContext vctx(ctx);
+				CHECK(vctx.verifyIssuer(false, vctx.depth()));
+				return true;
+			});
+			CHECK(cache.hits() + cache.misses() == 2);
+		}
+		
+		THEN("Links OpenSSL hasn't called back about should be checked")
+		{
+			cache.clear();
+			bool first = true;
+			resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+				// The root comes first; nothing below it has been checked yet
+				if (first) {
+					first = false;
+					VerifyContext vctx(ctx);
+					REQUIRE(vctx.depth() == 2);
+					CHECK(vctx.verifyIssuer(preverified, 1));
+					CHECK(vctx.verifyIssuer(preverified, 0));
+				}
+				return true;
+			});
+			CHECK(cache.hits() + cache.misses() == 2);
+		}
+		
+		THEN("Depths outside of the chain should fail")
+		{
+			resources::handshake(chain, [&](bool preverified, X509_STORE_CTX *ctx) {
+				VerifyContext vctx(ctx);
+				CHECK_FALSE(vctx.verifyIssuer(preverified, -1));
+				CHECK_FALSE(vctx.verifyIssuer(preverified, 3));
+				return true;
+			});
+		}
+	}
+}
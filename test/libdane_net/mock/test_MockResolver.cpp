@@ -7,7 +7,10 @@
 
 #include <catch.hpp>
 #include <libdane/net/mock/MockResolver.h>
+#include <libdane/net/Util.h>
 
+using namespace libdane;
+using namespace libdane::net;
 using namespace libdane::net::mock;
 
 SCENARIO("Mock functions can be enqueued")
@@ -92,3 +95,205 @@ SCENARIO("Mock functions can be enqueued")
 		}
 	}
 }
+
+SCENARIO("Queries are sent over UDP, and retried over TCP")
+{
+	asio::io_service service;
+	MockResolver res(service);
+	
+	std::vector<unsigned char> digest(32, 0xFE);
+	std::vector<unsigned char> cert(2000, 0xFE);
+	auto answer = [](std::shared_ptr<ldns_pkt> q, uint16_t flags, const std::vector<unsigned char> &data) {
+		ldns_pkt_set_flags(&*q, LDNS_QR|LDNS_RD|LDNS_RA|flags);
+		auto rr = make_tlsa(DomainIssuedCertificate, FullCertificate, data.size() == 32 ? SHA256Hash : ExactMatch, data);
+		
+		// Records without an owner can't be put on the wire
+		ldns_rr *owned = ldns_rr_clone(&*rr);
+		ldns_rr_set_owner(owned, ldns_rdf_clone(ldns_rr_owner(ldns_rr_list_rr(ldns_pkt_question(&*q), 0))));
+		ldns_pkt_push_rr(&*q, LDNS_SECTION_ANSWER, owned);
+		return q;
+	};
+	
+	std::vector<DANERecord> records;
+	bool called = false;
+	auto lookup = [&]() {
+		res.lookupDANE("_25._tcp.example.com", [&](const asio::error_code &err, std::vector<DANERecord> recs, bool dnssec) {
+			REQUIRE_FALSE(err);
+			records = recs;
+			called = true;
+		});
+		service.run();
+	};
+	
+	GIVEN("A response that fits in a datagram")
+	{
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, digest); });
+		lookup();
+		
+		THEN("It should only be sent over UDP")
+		{
+			REQUIRE(called);
+			CHECK(res.udpQueries() == 1);
+			CHECK(res.tcpQueries() == 0);
+			REQUIRE(records.size() == 1);
+			CHECK(records[0].matching() == SHA256Hash);
+		}
+	}
+	
+	GIVEN("A truncated response")
+	{
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, LDNS_TC, digest); });
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, cert); });
+		lookup();
+		
+		THEN("It should be retried over TCP")
+		{
+			REQUIRE(called);
+			CHECK(res.udpQueries() == 1);
+			CHECK(res.tcpQueries() == 1);
+			REQUIRE(records.size() == 1);
+			CHECK(records[0].matching() == ExactMatch);
+		}
+	}
+	
+	GIVEN("A response larger than the EDNS0 buffer size")
+	{
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, cert); });
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, cert); });
+		lookup();
+		
+		THEN("It should be retried over TCP")
+		{
+			REQUIRE(called);
+			CHECK(res.udpQueries() == 1);
+			CHECK(res.tcpQueries() == 1);
+			REQUIRE(records.size() == 1);
+			CHECK(records[0].data().size() == cert.size());
+		}
+	}
+	
+	GIVEN("A malformed response")
+	{
+		res.mock([&](std::shared_ptr<ldns_pkt> q) {
+			// Claims more answers than it carries
+			answer(q, 0, digest);
+			ldns_pkt_set_ancount(&*q, 2);
+			return q;
+		});
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, digest); });
+		lookup();
+		
+		THEN("It should be retried over TCP")
+		{
+			REQUIRE(called);
+			CHECK(res.udpQueries() == 1);
+			CHECK(res.tcpQueries() == 1);
+			CHECK(records.size() == 1);
+		}
+	}
+	
+	GIVEN("A config that forces TCP")
+	{
+		res.config().setForceTCP(true);
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, digest); });
+		lookup();
+		
+		THEN("UDP should never be tried")
+		{
+			REQUIRE(called);
+			CHECK(res.udpQueries() == 0);
+			CHECK(res.tcpQueries() == 1);
+		}
+	}
+	
+	GIVEN("A malformed response over TCP")
+	{
+		res.config().setForceTCP(true);
+		res.mock([&](std::shared_ptr<ldns_pkt> q) {
+			answer(q, 0, digest);
+			ldns_pkt_set_ancount(&*q, 2);
+			return q;
+		});
+		
+		asio::error_code error;
+		res.lookupDANE("_25._tcp.example.com", [&](const asio::error_code &err, std::vector<DANERecord> recs, bool dnssec) {
+			error = err;
+			called = true;
+		});
+		service.run();
+		
+		THEN("The lookup should fail")
+		{
+			REQUIRE(called);
+			CHECK(res.tcpQueries() == 1);
+			CHECK(error == asio::error::invalid_argument);
+		}
+	}
+	
+	GIVEN("A batch where only some responses are truncated")
+	{
+		std::vector<std::shared_ptr<ldns_pkt>> pkts;
+		for (std::string name : { "a.example.com", "b.example.com", "c.example.com" }) {
+			pkts.push_back(res.makeQuery(name, LDNS_RR_TYPE_TLSA));
+		}
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, digest); });
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, LDNS_TC, digest); });
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, digest); });
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, cert); });
+		
+		std::vector<std::shared_ptr<ldns_pkt>> results;
+		res.query(pkts, [&](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			REQUIRE_FALSE(err);
+			results = pkts;
+		});
+		service.run();
+		
+		THEN("Only those should be retried, and end up in the right place")
+		{
+			CHECK(res.udpQueries() == 3);
+			CHECK(res.tcpQueries() == 1);
+			REQUIRE(results.size() == 3);
+			CHECK(res.decodeTLSA(results[0])[0].matching() == SHA256Hash);
+			CHECK(res.decodeTLSA(results[1])[0].matching() == ExactMatch);
+			CHECK(res.decodeTLSA(results[2])[0].matching() == SHA256Hash);
+			CHECK_FALSE(ldns_pkt_tc(&*results[1]));
+		}
+	}
+	
+	GIVEN("A batch over TCP, answered out of order")
+	{
+		res.config().setForceTCP(true);
+		std::vector<std::shared_ptr<ldns_pkt>> pkts;
+		for (std::string name : { "a.example.com", "b.example.com", "c.example.com" }) {
+			pkts.push_back(res.makeQuery(name, LDNS_RR_TYPE_TLSA));
+		}
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, digest); });
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, cert); });
+		res.mock([&](std::shared_ptr<ldns_pkt> q) { return answer(q, 0, digest); });
+		
+		std::vector<std::shared_ptr<ldns_pkt>> results;
+		res.query(pkts, [&](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			REQUIRE_FALSE(err);
+			results = pkts;
+		});
+		service.run();
+		
+		THEN("All queries should be sent at once, and answers end up in the right place")
+		{
+			CHECK(res.udpQueries() == 0);
+			CHECK(res.tcpQueries() == 3);
+			REQUIRE(results.size() == 3);
+			CHECK(res.decodeTLSA(results[0])[0].matching() == SHA256Hash);
+			CHECK(res.decodeTLSA(results[1])[0].matching() == ExactMatch);
+			CHECK(res.decodeTLSA(results[2])[0].matching() == SHA256Hash);
+		}
+		
+		THEN("Each query should have had its own ID")
+		{
+			REQUIRE(results.size() == 3);
+			CHECK(ldns_pkt_id(&*results[0]) != ldns_pkt_id(&*results[1]));
+			CHECK(ldns_pkt_id(&*results[0]) != ldns_pkt_id(&*results[2]));
+			CHECK(ldns_pkt_id(&*results[1]) != ldns_pkt_id(&*results[2]));
+		}
+	}
+}
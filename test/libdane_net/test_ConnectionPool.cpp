@@ -0,0 +1,203 @@
+/**
+ * test_ConnectionPool.cpp
+ * test_libdane_net
+ * 
+ * Copyright 2015 uppfinnarn and Halon Security. All rights reserved.
+ */
+
+#include <catch.hpp>
+#include <libdane/net/ConnectionPool.h>
+#include <atomic>
+#include <thread>
+
+using namespace libdane::net;
+
+SCENARIO("Connections are pooled")
+{
+	asio::io_service service;
+	ConnectionPool pool(service);
+	
+	// A listener on the loopback interface, and a way to connect to it
+	asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+	asio::ip::tcp::endpoint endpoint = acceptor.local_endpoint();
+	std::vector<std::shared_ptr<asio::ip::tcp::socket>> accepted;
+	auto connect = [&]() {
+		auto sock = std::make_shared<asio::ip::tcp::socket>(service);
+		sock->connect(endpoint);
+		accepted.push_back(std::make_shared<asio::ip::tcp::socket>(service));
+		acceptor.accept(*accepted.back());
+		return sock;
+	};
+	
+	GIVEN("A connection")
+	{
+		auto sock = connect();
+		REQUIRE(pool.put(sock));
+		
+		THEN("It should be idle")
+		{
+			CHECK(pool.idle() == 1);
+		}
+		
+		THEN("It should be handed back out")
+		{
+			CHECK(pool.take({ endpoint }) == sock);
+			CHECK(pool.idle() == 0);
+			CHECK(sock->is_open());
+		}
+		
+		THEN("It should only be handed out for its own nameserver")
+		{
+			asio::ip::tcp::endpoint other(asio::ip::address_v4::loopback(), endpoint.port() + 1);
+			CHECK(pool.take({ other }) == nullptr);
+			CHECK(pool.take({ other, endpoint }) == sock);
+		}
+		
+		THEN("It should have keepalive enabled")
+		{
+			asio::socket_base::keep_alive option;
+			sock->get_option(option);
+			CHECK(option.value());
+		}
+		
+		WHEN("The server closes it")
+		{
+			accepted.back()->close();
+			service.run();
+			
+			THEN("It should be dropped")
+			{
+				CHECK(pool.idle() == 0);
+				CHECK(pool.take({ endpoint }) == nullptr);
+				CHECK_FALSE(sock->is_open());
+			}
+		}
+		
+		WHEN("It's taken out and returned again")
+		{
+			REQUIRE(pool.take({ endpoint }) == sock);
+			service.poll();
+			REQUIRE(pool.put(sock));
+			
+			THEN("It should still be usable")
+			{
+				CHECK(pool.idle() == 1);
+				CHECK(pool.take({ endpoint }) == sock);
+			}
+		}
+	}
+	
+	GIVEN("An idle timeout")
+	{
+		pool.setIdleTimeout(std::chrono::milliseconds(10));
+		auto sock = connect();
+		REQUIRE(pool.put(sock));
+		
+		THEN("Connections should be closed when it runs out")
+		{
+			service.run();
+			CHECK(pool.idle() == 0);
+			CHECK_FALSE(sock->is_open());
+		}
+	}
+	
+	GIVEN("A full pool")
+	{
+		pool.setMaxIdle(2);
+		auto a = connect();
+		auto b = connect();
+		auto c = connect();
+		REQUIRE(pool.put(a));
+		REQUIRE(pool.put(b));
+		
+		THEN("Further connections should be closed instead")
+		{
+			CHECK_FALSE(pool.put(c));
+			CHECK_FALSE(c->is_open());
+			CHECK(pool.idle() == 2);
+		}
+		
+		THEN("The most recently returned connection should come out first")
+		{
+			CHECK(pool.take({ endpoint }) == b);
+			CHECK(pool.take({ endpoint }) == a);
+			CHECK(pool.take({ endpoint }) == nullptr);
+		}
+		
+		THEN("Clearing it should close everything")
+		{
+			pool.clear();
+			CHECK(pool.idle() == 0);
+			CHECK_FALSE(a->is_open());
+			CHECK_FALSE(b->is_open());
+		}
+	}
+	
+	GIVEN("Pooling is disabled")
+	{
+		pool.setMaxIdle(0);
+		auto sock = connect();
+		
+		THEN("Connections should just be closed")
+		{
+			CHECK_FALSE(pool.put(sock));
+			CHECK_FALSE(sock->is_open());
+		}
+	}
+	
+	GIVEN("Threads sharing the pool")
+	{
+		for (int i = 0; i < 4; ++i) {
+			REQUIRE(pool.put(connect()));
+		}
+		
+		// The pool's own handlers run alongside, on threads of their own
+		asio::io_service::work work(service);
+		std::vector<std::thread> threads;
+		for (int i = 0; i < 2; ++i) {
+			threads.emplace_back([&]() { service.run(); });
+		}
+		
+		std::atomic<int> taken(0), failed(0);
+		std::vector<std::thread> workers;
+		for (int i = 0; i < 4; ++i) {
+			workers.emplace_back([&]() {
+				for (int j = 0; j < 1000; ++j) {
+					auto sock = pool.take({ endpoint });
+					if (!sock) {
+						continue;
+					}
+					++taken;
+					if (pool.idle() > 3 || !pool.put(sock)) {
+						++failed;
+					}
+				}
+			});
+		}
+		for (std::thread &worker : workers) {
+			worker.join();
+		}
+		
+		service.stop();
+		for (std::thread &thread : threads) {
+			thread.join();
+		}
+		
+		THEN("Every connection should make it back in")
+		{
+			CHECK(taken > 0);
+			CHECK(failed == 0);
+			CHECK(pool.idle() == 4);
+		}
+	}
+	
+	GIVEN("Sockets that aren't connected")
+	{
+		THEN("They shouldn't be pooled")
+		{
+			CHECK_FALSE(pool.put(nullptr));
+			CHECK_FALSE(pool.put(std::make_shared<asio::ip::tcp::socket>(service)));
+			CHECK(pool.idle() == 0);
+		}
+	}
+}
@@ -7,6 +7,7 @@
 
 #include <catch.hpp>
 #include <libdane/net/Resolver.h>
+#include <libdane/net/Util.h>
 #include <libdane/Util.h>
 #include <algorithm>
 
@@ -56,6 +57,23 @@ SCENARIO("Query construction works")
 			CHECK(ldns_pkt_edns(&*pkt));
 			CHECK(ldns_pkt_edns_do(&*pkt));
 		}
+		
+		THEN("It should advertise the configured EDNS0 buffer size")
+		{
+			CHECK(ldns_pkt_edns_udp_size(&*pkt) == 1232);
+			
+			res.config().setEdnsBufferSize(4096);
+			CHECK(ldns_pkt_edns_udp_size(&*res.makeQuery("google.com", LDNS_RR_TYPE_A)) == 4096);
+		}
+		
+		THEN("It should have a random ID")
+		{
+			std::vector<uint16_t> ids;
+			for (int i = 0; i < 8; ++i) {
+				ids.push_back(ldns_pkt_id(&*res.makeQuery("google.com", LDNS_RR_TYPE_A)));
+			}
+			CHECK(std::count(ids.begin(), ids.end(), ids[0]) < 8);
+		}
 	}
 }
 
@@ -66,7 +84,9 @@ SCENARIO("Wire encoding works")
 	
 	GIVEN("A valid packet")
 	{
+		// IDs are random; pin one down to get a stable checksum
 		auto pkt = res.makeQuery("google.com", LDNS_RR_TYPE_A);
+		ldns_pkt_set_id(&*pkt, 1337);
 		
 		WHEN("Encoded for UDP")
 		{
@@ -74,7 +94,7 @@ SCENARIO("Wire encoding works")
 			
 			THEN("The checksum should be correct")
 			{
-				REQUIRE(to_hex(hash(EVP_sha256(), udp)) == "8d5c5dac2d1245c7f6eb23e1ea7e148664d49bc280481128e6f3693b26dd97de");
+				REQUIRE(to_hex(hash(EVP_sha256(), udp)) == "37b6ae2d6c3fb5758e697b00f40b0063d7102a3e7e25fa9d9b9c6c6891b6a284");
 			}
 			
 			THEN("Encoded for TCP")
@@ -127,3 +147,203 @@ SCENARIO("DNSSEC verification works")
 		}
 	}
 }
+
+SCENARIO("TLSA responses are decoded")
+{
+	asio::io_service service;
+	Resolver res(service);
+	
+	GIVEN("A response with both usable and unusable records")
+	{
+		std::vector<unsigned char> digest(32, 0xFE);
+		std::shared_ptr<ldns_pkt> pkt(ldns_pkt_new(), ldns_pkt_free);
+		for (auto rr : {
+			make_tlsa(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA256Hash, digest),
+			make_tlsa(Usage(4), SubjectPublicKeyInfo, SHA256Hash, digest),
+			make_tlsa(DomainIssuedCertificate, SubjectPublicKeyInfo, SHA512Hash, digest),
+			make_tlsa(TrustAnchorAssertion, FullCertificate, ExactMatch, digest),
+		}) {
+			ldns_pkt_push_rr(&*pkt, LDNS_SECTION_ANSWER, ldns_rr_clone(&*rr));
+		}
+		
+		THEN("Only the usable ones should be returned")
+		{
+			std::vector<DANERecord> records = res.decodeTLSA(pkt);
+			REQUIRE(records.size() == 2);
+			CHECK(records[0].usage() == DomainIssuedCertificate);
+			CHECK(records[1].usage() == TrustAnchorAssertion);
+			CHECK(records[1].matching() == ExactMatch);
+		}
+	}
+}
+
+SCENARIO("Queries go out over UDP at once, and fail over between nameservers")
+{
+	asio::io_service service;
+	Resolver res(service);
+	res.config().setTimeout(std::chrono::milliseconds(50));
+	
+	// Two nameservers on the loopback interface, sharing a port; only the
+	// second one answers, and only once it's got every query
+	asio::ip::address silentAddress = asio::ip::address::from_string("127.0.0.1");
+	asio::ip::address serverAddress = asio::ip::address::from_string("127.0.0.2");
+	asio::ip::udp::socket silent(service, asio::ip::udp::endpoint(silentAddress, 0));
+	asio::ip::udp::socket server(service, asio::ip::udp::endpoint(serverAddress, silent.local_endpoint().port()));
+	res.config().setPort(silent.local_endpoint().port());
+	
+	std::vector<std::shared_ptr<ldns_pkt>> pkts;
+	for (std::string name : { "a.example.com", "b.example.com", "c.example.com" }) {
+		pkts.push_back(res.makeQuery(name, LDNS_RR_TYPE_TLSA));
+	}
+	
+	std::vector<std::pair<asio::ip::udp::endpoint, std::vector<unsigned char>>> received;
+	std::function<void()> serve = [&]() {
+		auto buffer = std::make_shared<std::vector<unsigned char>>(512);
+		auto from = std::make_shared<asio::ip::udp::endpoint>();
+		server.async_receive_from(asio::buffer(*buffer), *from, [&, buffer, from](const asio::error_code &err, std::size_t size) {
+			if (err == asio::error::operation_aborted) {
+				return;
+			}
+			REQUIRE_FALSE(err);
+			
+			// Echo the query back, flagged as a response
+			buffer->resize(size);
+			(*buffer)[2] |= 0x80;
+			received.emplace_back(*from, *buffer);
+			if (received.size() < pkts.size()) {
+				serve();
+				return;
+			}
+			for (auto &pair : received) {
+				server.send_to(asio::buffer(pair.second), pair.first);
+			}
+		});
+	};
+	serve();
+	
+	asio::error_code error = asio::error::would_block;
+	std::vector<std::shared_ptr<ldns_pkt>> results;
+	auto query = [&]() {
+		res.query(pkts, [&](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			error = err;
+			results = pkts;
+		});
+		service.run();
+	};
+	
+	GIVEN("A nameserver that answers")
+	{
+		res.config().setNameServers({ serverAddress });
+		query();
+		
+		THEN("Every query should have been in flight at once")
+		{
+			CHECK_FALSE(error);
+			REQUIRE(results.size() == pkts.size());
+			for (std::size_t i = 0; i < results.size(); ++i) {
+				CHECK(ldns_pkt_qr(&*results[i]));
+				CHECK(ldns_rr_compare(ldns_rr_list_rr(ldns_pkt_question(&*results[i]), 0), ldns_rr_list_rr(ldns_pkt_question(&*pkts[i]), 0)) == 0);
+			}
+		}
+	}
+	
+	GIVEN("A nameserver that doesn't answer, ahead of one that does")
+	{
+		res.config().setNameServers({ silentAddress, serverAddress });
+		query();
+		
+		THEN("Queries should fail over to the next one")
+		{
+			CHECK_FALSE(error);
+			REQUIRE(results.size() == pkts.size());
+			for (auto &pkt : results) {
+				CHECK(ldns_pkt_qr(&*pkt));
+			}
+			CHECK(silent.available() > 0);
+		}
+	}
+	
+	GIVEN("Only a nameserver that doesn't answer")
+	{
+		res.config().setNameServers({ silentAddress });
+		res.query(pkts, [&](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			error = err;
+			results = pkts;
+			server.close();
+		});
+		service.run();
+		
+		THEN("The queries should time out, without trying TCP")
+		{
+			// Nothing listens for TCP on the port, so that would be refused
+			CHECK(error == asio::error::timed_out);
+			CHECK(results.empty());
+		}
+	}
+}
+
+SCENARIO("Queries over TCP time out")
+{
+	asio::io_service service;
+	Resolver res(service);
+	res.config().setTimeout(std::chrono::milliseconds(50));
+	res.config().setForceTCP(true);
+	
+	// A nameserver that accepts the connection, then never says anything
+	asio::ip::address address = asio::ip::address::from_string("127.0.0.1");
+	asio::ip::tcp::acceptor acceptor(service, asio::ip::tcp::endpoint(address, 0));
+	asio::ip::tcp::socket server(service);
+	acceptor.async_accept(server, [&](const asio::error_code &err) {
+		if (err != asio::error::operation_aborted) {
+			REQUIRE_FALSE(err);
+		}
+	});
+	res.config().setNameServers({ address });
+	res.config().setPort(acceptor.local_endpoint().port());
+	
+	GIVEN("A query to a nameserver that doesn't answer")
+	{
+		asio::error_code error;
+		bool called = false;
+		res.query({ res.makeQuery("example.com", LDNS_RR_TYPE_TLSA) }, [&](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			error = err;
+			called = true;
+		});
+		service.run();
+		
+		THEN("It should fail, and the connection shouldn't be pooled")
+		{
+			REQUIRE(called);
+			CHECK(error == asio::error::timed_out);
+			CHECK(res.pool().idle() == 0);
+		}
+	}
+	
+	GIVEN("A nameserver that drops connection attempts")
+	{
+		// Once its backlog is full, the kernel ignores new connections to a
+		// socket, like a firewall dropping them would
+		asio::ip::tcp::acceptor full(service);
+		full.open(asio::ip::tcp::v4());
+		full.bind(asio::ip::tcp::endpoint(address, 0));
+		full.listen(0);
+		asio::ip::tcp::socket waiting(service);
+		waiting.connect(full.local_endpoint());
+		res.config().setPort(full.local_endpoint().port());
+		
+		asio::error_code error;
+		bool called = false;
+		res.query({ res.makeQuery("example.com", LDNS_RR_TYPE_TLSA) }, [&](const asio::error_code &err, std::vector<std::shared_ptr<ldns_pkt>> pkts, const std::vector<bool> dnssec) {
+			error = err;
+			called = true;
+			acceptor.close();
+		});
+		service.run();
+		
+		THEN("Connecting should time out")
+		{
+			REQUIRE(called);
+			CHECK(error == asio::error::timed_out);
+		}
+	}
+}
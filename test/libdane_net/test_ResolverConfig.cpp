@@ -28,6 +28,24 @@ SCENARIO("Constructors are working")
 			CHECK(addrs[2].to_string() == "8.8.8.8");
 			CHECK(addrs[3].to_string() == "8.8.4.4");
 		}
+		
+		THEN("It should default to UDP, with a 1232 byte EDNS0 buffer")
+		{
+			CHECK(conf.port() == 53);
+			CHECK(conf.ednsBufferSize() == 1232);
+			CHECK_FALSE(conf.forceTCP());
+			CHECK(conf.timeout().count() > 0);
+		}
+		
+		THEN("Endpoints should use the configured port")
+		{
+			conf.setPort(5353);
+			REQUIRE(conf.endpoints().size() == 4);
+			REQUIRE(conf.udpEndpoints().size() == 4);
+			CHECK(conf.endpoints()[2].port() == 5353);
+			CHECK(conf.udpEndpoints()[2].port() == 5353);
+			CHECK(conf.udpEndpoints()[2].address().to_string() == "8.8.8.8");
+		}
 	}
 }
 
@@ -126,4 +144,26 @@ SCENARIO("Parsing resolv.conf files works")
 			CHECK(conf.nameServers()[1].to_string() == "192.168.0.101");
 		}
 	}
+	
+	GIVEN("A file with options")
+	{
+		std::string str(
+			"nameserver 192.168.0.100\n"
+			"options timeout:1 use-vc\n"
+		);
+		ResolverConfig conf;
+		REQUIRE(conf.parseResolvConf(str));
+		
+		THEN("use-vc should force TCP")
+		{
+			REQUIRE(conf.nameServers().size() == 1);
+			CHECK(conf.forceTCP());
+		}
+		
+		THEN("Reparsing a file without it should turn it back off")
+		{
+			REQUIRE(conf.parseResolvConf("nameserver 192.168.0.100\n"));
+			CHECK_FALSE(conf.forceTCP());
+		}
+	}
 }
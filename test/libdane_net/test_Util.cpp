@@ -130,6 +130,27 @@ SCENARIO("Records can be parsed from TLSA RRs")
 	}
 }
 
+SCENARIO("Unusable records are flagged")
+{
+	GIVEN("A record with an unknown usage")
+	{
+		DANERecord rec = record_from_tlsa(make_tlsa(Usage(4), FullCertificate, SHA256Hash, std::vector<unsigned char>(32, 0xFE)));
+		REQUIRE_FALSE(rec.usable());
+	}
+	
+	GIVEN("A record with a truncated digest")
+	{
+		DANERecord rec = record_from_tlsa(make_tlsa(CAConstraints, FullCertificate, SHA256Hash, { 0xFE }));
+		REQUIRE_FALSE(rec.usable());
+	}
+	
+	GIVEN("A valid record")
+	{
+		DANERecord rec = record_from_tlsa(make_tlsa(CAConstraints, FullCertificate, SHA256Hash, std::vector<unsigned char>(32, 0xFE)));
+		REQUIRE(rec.usable());
+	}
+}
+
 SCENARIO("Resource record names can be generated")
 {
 	REQUIRE(resource_record_name("example.com", 25, TCP) == "_25._tcp.example.com");